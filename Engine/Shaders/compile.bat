@@ -1,3 +0,0 @@
-C:\Users\rober\Documents\VulkanSDK\1.3.280.0\Bin\glslc.exe shader.vert -o vert.spv
-C:\Users\rober\Documents\VulkanSDK\1.3.280.0\Bin\glslc.exe shader.frag -o frag.spv
-pause
\ No newline at end of file
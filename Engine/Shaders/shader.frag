@@ -1,5 +1,8 @@
 #version 450
 
+// Specialized per pipeline, the branch is compiled out of variants that do not tint
+layout(constant_id = 0) const bool VERTEX_COLOR_TINT = false;
+
 layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) in vec3 fragColor;
@@ -9,4 +12,7 @@ layout(location = 0) out vec4 outColor;
 
 void main() {
     outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+    if (VERTEX_COLOR_TINT) {
+        outColor.rgb *= fragColor;
+    }
+}
@@ -1,21 +1,34 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+// Rewritten every frame in the frame ring and bound with a dynamic offset, per sprite data comes in as instance attributes
+layout(binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+    mat4 viewProj;
+} frame;
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+// Per instance, xyz is the translation and w the rotation about Z in radians
+layout(location = 3) in vec4 inTranslationRotation;
+layout(location = 4) in vec2 inScale;
+// Slot of the sprite's texture in the bindless texture table, unused by the shaders that bind one texture per set
+layout(location = 5) in uint inTextureIdx;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIdx;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
+    float s = sin(inTranslationRotation.w);
+    float c = cos(inTranslationRotation.w);
+    vec2 scaled = inPosition * inScale;
+    vec3 worldPosition = vec3(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y, 0.0) + inTranslationRotation.xyz;
+
+    gl_Position = frame.viewProj * vec4(worldPosition, 1.0);
     fragColor = inColor; 
     fragTexCoord = inTexCoord;
+    fragTextureIdx = inTextureIdx;
 }
-
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Specialized per pipeline, the branch is compiled out of variants that do not tint
+layout(constant_id = 0) const bool VERTEX_COLOR_TINT = false;
+
+// The bindless texture table, set 0 is the per frame set shared with shader.frag
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTextureIdx;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Instances of one draw may use different textures, so the index is not uniform across the draw
+    outColor = texture(textures[nonuniformEXT(fragTextureIdx)], fragTexCoord);
+    if (VERTEX_COLOR_TINT) {
+        outColor.rgb *= fragColor;
+    }
+}
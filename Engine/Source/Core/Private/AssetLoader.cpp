@@ -0,0 +1,150 @@
+#include "AssetLoader.h"
+
+#include "Threading.h"
+
+#include <stb_image.h>
+
+#include <cassert>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+TextureData DecodeTextureImage(const std::filesystem::path& path, const bool bSRGB)
+{
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		throw std::runtime_error(std::format("Failed to load texture image {}: {}", path.string(), stbi_failure_reason()));
+	}
+
+	// Minified sprites sample the smaller mips instead of skipping across the full size texture
+	TextureData texture = BuildMipChain(std::span<const uint8_t>(pixels, static_cast<size_t>(width) * height * 4), width, height, bSRGB);
+
+	stbi_image_free(pixels);
+
+	return texture;
+}
+
+AssetLoader::~AssetLoader()
+{
+	if (mLoadThread.joinable())
+	{
+		mLoadThread.join();
+	}
+}
+
+AssetID AssetLoader::LoadTexture(const std::filesystem::path& sourcePath, const bool bSRGB)
+{
+	assert(!mLoadThread.joinable() && !mWaited);
+
+	TextureAsset& texture = mTextures.emplace_back();
+	texture.sourcePath = sourcePath;
+	texture.bSRGB = bSRGB;
+
+	return static_cast<AssetID>(mTextures.size() - 1);
+}
+
+void AssetLoader::Start(ThreadPool& threadPool)
+{
+	assert(!mLoadThread.joinable() && !mWaited);
+
+	mStatistics.textureCount = static_cast<uint32_t>(mTextures.size());
+
+	// ParallelFor blocks its caller, so it is called from a thread of its own that takes the place of the main thread
+	mLoadThread = std::thread([this, &threadPool]()
+	{
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::vector<double> jobMilliseconds(mTextures.size(), 0.0);
+		std::vector<std::exception_ptr> jobErrors(mTextures.size());
+
+		// One asset per batch, assets differ too much in size for bigger batches to balance
+		threadPool.ParallelFor(static_cast<uint32_t>(mTextures.size()), 1, [this, &jobMilliseconds, &jobErrors](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t textureIdx = begin; textureIdx < end; textureIdx++)
+			{
+				const auto jobStartTime = std::chrono::high_resolution_clock::now();
+				try
+				{
+					LoadTextureJob(mTextures[textureIdx]);
+				}
+				catch (...)
+				{
+					jobErrors[textureIdx] = std::current_exception();
+				}
+				jobMilliseconds[textureIdx] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - jobStartTime).count();
+			}
+		});
+
+		for (size_t jobIdx = 0; jobIdx < jobErrors.size(); jobIdx++)
+		{
+			mStatistics.decodeMilliseconds += jobMilliseconds[jobIdx];
+			if (jobErrors[jobIdx] && !mError)
+			{
+				mError = jobErrors[jobIdx];
+			}
+		}
+		for (const TextureAsset& texture : mTextures)
+		{
+			mStatistics.cookedCount += texture.IsCooked() ? 1 : 0;
+		}
+
+		mStatistics.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	});
+}
+
+void AssetLoader::Wait()
+{
+	assert(mLoadThread.joinable());
+
+	mLoadThread.join();
+	mWaited = true;
+
+	if (mError)
+	{
+		std::rethrow_exception(std::exchange(mError, nullptr));
+	}
+}
+
+const TextureAsset& AssetLoader::GetTexture(const AssetID texture) const
+{
+	assert(mWaited && texture < mTextures.size());
+	return mTextures[texture];
+}
+
+void AssetLoader::Release()
+{
+	assert(!mLoadThread.joinable());
+	mTextures.clear();
+}
+
+void AssetLoader::LoadTextureJob(TextureAsset& texture)
+{
+	// The build cooks into its own tree, under the name of the source image
+	std::filesystem::path cookedPath = std::filesystem::path(FIREFLY_COOKED_TEXTURE_DIR) / texture.sourcePath.filename();
+	cookedPath.replace_extension(TEXTURE_FILE_EXTENSION);
+
+	// Mapping asks the OS to read the file ahead, so it is mostly in memory by the time it is staged for upload
+	if (texture.cookedFile.Open(cookedPath))
+	{
+		if (ParseTextureFile(texture.cookedFile.GetData(), texture.cooked) && texture.cooked.bSRGB == texture.bSRGB)
+		{
+			return;
+		}
+
+		std::cerr << std::format("Ignoring cooked texture {}, it is invalid or out of date\n", cookedPath.string());
+		texture.cookedFile.Close();
+		texture.cooked = {};
+	}
+
+	texture.decoded = DecodeTextureImage(texture.sourcePath, texture.bSRGB);
+
+	// Whether the device samples BC formats is not known yet, compressing either way keeps the work off the main thread.
+	// Already inside a job of the pool, so one texture is compressed by one thread.
+	const ETextureFormat compressedFormat = HasTranslucentTexels(texture.decoded) ? ETextureFormat::BC3 : ETextureFormat::BC1;
+	texture.compressed = CompressTexture(texture.decoded, compressedFormat);
+}
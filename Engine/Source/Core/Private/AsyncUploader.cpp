@@ -0,0 +1,267 @@
+#include "AsyncUploader.h"
+
+#include <cassert>
+
+void AsyncUploader::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, DeviceMemoryAllocator& allocator, const VkQueue transferQueue, const uint32_t transferQueueFamilyIdx, const uint32_t graphicsQueueFamilyIdx, const VkDeviceSize stagingCapacity)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mTransferQueue = transferQueue;
+	mTransferQueueFamilyIdx = transferQueueFamilyIdx;
+	mGraphicsQueueFamilyIdx = graphicsQueueFamilyIdx;
+	mNeedsOwnershipTransfer = transferQueueFamilyIdx != graphicsQueueFamilyIdx;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = transferQueueFamilyIdx;
+
+	VkResult poolResult = vkCreateCommandPool(mDevice, &poolInfo, nullptr, &mCommandPool);
+	VK_CHECK(poolResult, "Failed to create upload command pool: {}");
+
+	VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+	semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &semaphoreTypeInfo;
+
+	VkResult semaphoreResult = vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &mTimelineSemaphore);
+	VK_CHECK(semaphoreResult, "Failed to create upload timeline semaphore: {}");
+
+	mStaging.Init(physicalDevice, device, allocator, stagingCapacity);
+}
+
+void AsyncUploader::Shutdown()
+{
+	std::lock_guard lock(mMutex);
+
+	mStaging.Shutdown();
+
+	mSubmittedBatches.clear();
+	mFreeCommandBuffers.clear();
+
+	// Frees every command buffer allocated from it
+	vkDestroyCommandPool(mDevice, mCommandPool, nullptr);
+	mCommandPool = VK_NULL_HANDLE;
+
+	vkDestroySemaphore(mDevice, mTimelineSemaphore, nullptr);
+	mTimelineSemaphore = VK_NULL_HANDLE;
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+void AsyncUploader::EnqueueBufferUpload(const VkBuffer dstBuffer, const VkDeviceSize dstOffset, const void* pData, const VkDeviceSize size)
+{
+	std::lock_guard lock(mMutex);
+	mStaging.EnqueueBufferCopy(dstBuffer, dstOffset, pData, size);
+}
+
+void AsyncUploader::EnqueueImageUpload(const VkImage dstImage, const VkImageSubresourceRange& range, const std::span<const VkBufferImageCopy> regions, const void* pData, const VkDeviceSize size)
+{
+	std::lock_guard lock(mMutex);
+	mStaging.EnqueueImageCopy(dstImage, range, regions, pData, size);
+}
+
+uint64_t AsyncUploader::Submit()
+{
+	std::lock_guard lock(mMutex);
+
+	ReclaimLocked();
+
+	if (!mStaging.HasPendingCopies())
+	{
+		return mLastSubmittedValue;
+	}
+
+	const uint64_t timelineValue = mLastSubmittedValue + 1;
+
+	SubmittedBatch& batch = mSubmittedBatches.emplace_back();
+	batch.timelineValue = timelineValue;
+	batch.commandBuffer = GetCommandBufferLocked();
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult beginResult = vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+	VK_CHECK(beginResult, "Failed to begin upload command buffer: {}");
+
+	mStaging.RecordCopies(batch.commandBuffer, batch.bufferBarriers, batch.imageBarriers);
+
+	if (mNeedsOwnershipTransfer)
+	{
+		for (VkBufferMemoryBarrier& barrier : batch.bufferBarriers)
+		{
+			barrier.srcQueueFamilyIndex = mTransferQueueFamilyIdx;
+			barrier.dstQueueFamilyIndex = mGraphicsQueueFamilyIdx;
+		}
+		for (VkImageMemoryBarrier& barrier : batch.imageBarriers)
+		{
+			barrier.srcQueueFamilyIndex = mTransferQueueFamilyIdx;
+			barrier.dstQueueFamilyIndex = mGraphicsQueueFamilyIdx;
+		}
+	}
+	else
+	{
+		// The semaphore already makes the buffer writes visible, only the image layouts still need to change
+		batch.bufferBarriers.clear();
+	}
+
+	// Release, the destination half of the barrier is ignored and done by Acquire instead
+	vkCmdPipelineBarrier(
+		batch.commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0,
+		nullptr,
+		static_cast<uint32_t>(batch.bufferBarriers.size()),
+		batch.bufferBarriers.data(),
+		static_cast<uint32_t>(batch.imageBarriers.size()),
+		batch.imageBarriers.data()
+	);
+
+	VkResult endResult = vkEndCommandBuffer(batch.commandBuffer);
+	VK_CHECK(endResult, "Failed to end upload command buffer: {}");
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &timelineValue;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &mTimelineSemaphore;
+
+	VkResult submitResult = vkQueueSubmit(mTransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	VK_CHECK(submitResult, "Failed to submit uploads: {}");
+
+	mStaging.Retire(timelineValue);
+
+	if (!mNeedsOwnershipTransfer)
+	{
+		// Nothing to acquire later
+		batch.imageBarriers.clear();
+	}
+
+	mLastSubmittedValue = timelineValue;
+	return timelineValue;
+}
+
+uint64_t AsyncUploader::Acquire(const VkCommandBuffer graphicsCommandBuffer, const uint64_t uploadValue)
+{
+	std::lock_guard lock(mMutex);
+
+	assert(uploadValue <= mLastSubmittedValue);
+
+	if (uploadValue <= mLastAcquiredValue)
+	{
+		return 0;
+	}
+
+	if (mNeedsOwnershipTransfer)
+	{
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+
+		for (SubmittedBatch& batch : mSubmittedBatches)
+		{
+			if (batch.timelineValue <= mLastAcquiredValue)
+			{
+				continue;
+			}
+			if (batch.timelineValue > uploadValue)
+			{
+				break;
+			}
+
+			// Must match the release exactly apart from the access masks
+			for (VkBufferMemoryBarrier& barrier : batch.bufferBarriers)
+			{
+				VkBufferMemoryBarrier& acquireBarrier = bufferBarriers.emplace_back(barrier);
+				acquireBarrier.srcAccessMask = VK_ACCESS_NONE;
+				acquireBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+			}
+			for (VkImageMemoryBarrier& barrier : batch.imageBarriers)
+			{
+				VkImageMemoryBarrier& acquireBarrier = imageBarriers.emplace_back(barrier);
+				acquireBarrier.srcAccessMask = VK_ACCESS_NONE;
+				acquireBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			}
+
+			batch.bufferBarriers.clear();
+			batch.imageBarriers.clear();
+		}
+
+		if (!bufferBarriers.empty() || !imageBarriers.empty())
+		{
+			// The source stages match the stages the submission waits on the semaphore at, chaining the barrier after the wait
+			vkCmdPipelineBarrier(
+				graphicsCommandBuffer,
+				CONSUMER_STAGES,
+				CONSUMER_STAGES,
+				0,
+				0,
+				nullptr,
+				static_cast<uint32_t>(bufferBarriers.size()),
+				bufferBarriers.data(),
+				static_cast<uint32_t>(imageBarriers.size()),
+				imageBarriers.data()
+			);
+		}
+	}
+
+	mLastAcquiredValue = uploadValue;
+	return uploadValue;
+}
+
+uint64_t AsyncUploader::GetCompletedValue() const
+{
+	uint64_t completedValue = 0;
+	VkResult result = vkGetSemaphoreCounterValue(mDevice, mTimelineSemaphore, &completedValue);
+	VK_CHECK(result, "Failed to read upload timeline semaphore: {}");
+	return completedValue;
+}
+
+void AsyncUploader::ReclaimLocked()
+{
+	const uint64_t completedValue = GetCompletedValue();
+
+	mStaging.BeginFrame(completedValue);
+
+	while (!mSubmittedBatches.empty() && mSubmittedBatches.front().timelineValue <= completedValue && mSubmittedBatches.front().timelineValue <= mLastAcquiredValue)
+	{
+		mFreeCommandBuffers.push_back(mSubmittedBatches.front().commandBuffer);
+		mSubmittedBatches.pop_front();
+	}
+}
+
+VkCommandBuffer AsyncUploader::GetCommandBufferLocked()
+{
+	if (!mFreeCommandBuffers.empty())
+	{
+		// vkBeginCommandBuffer resets it implicitly
+		VkCommandBuffer commandBuffer = mFreeCommandBuffers.back();
+		mFreeCommandBuffers.pop_back();
+		return commandBuffer;
+	}
+
+	VkCommandBufferAllocateInfo allocateInfo{};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = mCommandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkResult allocateResult = vkAllocateCommandBuffers(mDevice, &allocateInfo, &commandBuffer);
+	VK_CHECK(allocateResult, "Failed to allocate upload command buffer: {}");
+	return commandBuffer;
+}
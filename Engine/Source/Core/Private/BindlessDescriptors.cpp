@@ -0,0 +1,243 @@
+#include "BindlessDescriptors.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+bool BindlessDescriptors::IsSupported(const VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+	return vulkan12Features.descriptorIndexing == VK_TRUE &&
+		vulkan12Features.runtimeDescriptorArray == VK_TRUE &&
+		vulkan12Features.descriptorBindingPartiallyBound == VK_TRUE &&
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
+		vulkan12Features.shaderStorageBufferArrayNonUniformIndexing == VK_TRUE;
+}
+
+void BindlessDescriptors::EnableFeatures(VkPhysicalDeviceVulkan12Features& features)
+{
+	features.descriptorIndexing = VK_TRUE;
+	features.runtimeDescriptorArray = VK_TRUE;
+	features.descriptorBindingPartiallyBound = VK_TRUE;
+	features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+}
+
+void BindlessDescriptors::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, const uint32_t maxTextures, const uint32_t maxStorageBuffers)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+
+	// Update after bind sets have limits of their own, usually far above the regular per stage ones
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	mTextures.name = "texture";
+	mTextures.capacity = std::min({maxTextures,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers});
+
+	mStorageBuffers.name = "storage buffer";
+	mStorageBuffers.capacity = std::min({maxStorageBuffers,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+	// Slots that were never written or were removed are fine to leave stale as long as no shader reads them
+	const VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	const std::array<VkDescriptorBindingFlags, 2> layoutBindingFlags = {bindingFlags, bindingFlags};
+
+	std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings{};
+	layoutBindings[0].binding = TEXTURE_BINDING;
+	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[0].descriptorCount = mTextures.capacity;
+	layoutBindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+	layoutBindings[1].binding = STORAGE_BUFFER_BINDING;
+	layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[1].descriptorCount = mStorageBuffers.capacity;
+	layoutBindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(layoutBindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = layoutBindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutInfo.pBindings = layoutBindings.data();
+
+	VkResult layoutResult = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mSetLayout);
+	VK_CHECK(layoutResult, "Failed to create bindless descriptor set layout: {}");
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = mTextures.capacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = mStorageBuffers.capacity;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkResult poolResult = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool);
+	VK_CHECK(poolResult, "Failed to create bindless descriptor pool: {}");
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &mSetLayout;
+
+	VkResult setResult = vkAllocateDescriptorSets(mDevice, &allocInfo, &mDescriptorSet);
+	VK_CHECK(setResult, "Failed to allocate bindless descriptor set: {}");
+}
+
+void BindlessDescriptors::Shutdown()
+{
+	// Frees the set with it
+	vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mDevice, mSetLayout, nullptr);
+
+	mDescriptorPool = VK_NULL_HANDLE;
+	mSetLayout = VK_NULL_HANDLE;
+	mDescriptorSet = VK_NULL_HANDLE;
+	mDevice = VK_NULL_HANDLE;
+
+	mTextures = {};
+	mStorageBuffers = {};
+}
+
+BindlessIndex BindlessDescriptors::AddTexture(const VkImageView imageView, const VkSampler sampler)
+{
+	std::lock_guard lock(mMutex);
+
+	const BindlessIndex slot = AllocateSlot(mTextures);
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = imageView;
+	imageInfo.sampler = sampler;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = mDescriptorSet;
+	write.dstBinding = TEXTURE_BINDING;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(mDevice, 1, &write, 0, nullptr);
+
+	return slot;
+}
+
+BindlessIndex BindlessDescriptors::AddStorageBuffer(const VkBuffer buffer, const VkDeviceSize offset, const VkDeviceSize range)
+{
+	std::lock_guard lock(mMutex);
+
+	const BindlessIndex slot = AllocateSlot(mStorageBuffers);
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = mDescriptorSet;
+	write.dstBinding = STORAGE_BUFFER_BINDING;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(mDevice, 1, &write, 0, nullptr);
+
+	return slot;
+}
+
+void BindlessDescriptors::RemoveTexture(const BindlessIndex texture, const uint64_t frameNumber)
+{
+	std::lock_guard lock(mMutex);
+	RetireSlot(mTextures, texture, frameNumber);
+}
+
+void BindlessDescriptors::RemoveStorageBuffer(const BindlessIndex buffer, const uint64_t frameNumber)
+{
+	std::lock_guard lock(mMutex);
+	RetireSlot(mStorageBuffers, buffer, frameNumber);
+}
+
+void BindlessDescriptors::RecycleSlots(const uint64_t completedFrameNumber)
+{
+	std::lock_guard lock(mMutex);
+	RecycleTable(mTextures, completedFrameNumber);
+	RecycleTable(mStorageBuffers, completedFrameNumber);
+}
+
+void BindlessDescriptors::Bind(const VkCommandBuffer commandBuffer, const VkPipelineBindPoint bindPoint, const VkPipelineLayout layout, const uint32_t setIdx) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, setIdx, 1, &mDescriptorSet, 0, nullptr);
+}
+
+BindlessIndex BindlessDescriptors::AllocateSlot(Table& table)
+{
+	if (!table.freeSlots.empty())
+	{
+		const BindlessIndex slot = table.freeSlots.back();
+		table.freeSlots.pop_back();
+		return slot;
+	}
+
+	if (table.nextUnusedSlot == table.capacity)
+	{
+		throw std::runtime_error(std::format("Bindless {} table is full at {} entries", table.name, table.capacity));
+	}
+
+	return table.nextUnusedSlot++;
+}
+
+void BindlessDescriptors::RetireSlot(Table& table, const BindlessIndex slot, const uint64_t frameNumber)
+{
+	assert(slot < table.nextUnusedSlot);
+	assert(table.retiredSlots.empty() || table.retiredSlots.back().frameNumber <= frameNumber);
+
+	table.retiredSlots.push_back({slot, frameNumber});
+}
+
+void BindlessDescriptors::RecycleTable(Table& table, const uint64_t completedFrameNumber)
+{
+	while (!table.retiredSlots.empty() && table.retiredSlots.front().frameNumber <= completedFrameNumber)
+	{
+		table.freeSlots.push_back(table.retiredSlots.front().slot);
+		table.retiredSlots.pop_front();
+	}
+}
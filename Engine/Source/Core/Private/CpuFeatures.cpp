@@ -0,0 +1,33 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+bool IsAvx2Supported()
+{
+#ifndef FIREFLY_SIMD_X64
+	return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7)
+	{
+		return false;
+	}
+
+	// The OS also has to save the upper halves of the YMM registers for us
+	__cpuid(cpuInfo, 1);
+	const bool bOsxSave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool bAvx = (cpuInfo[2] & (1 << 28)) != 0;
+	if (!bOsxSave || !bAvx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(cpuInfo, 7, 0);
+	return (cpuInfo[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
@@ -0,0 +1,200 @@
+#include "Culling.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+	uint32_t CullSpheresScalar(const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, const uint32_t begin, const uint32_t end, uint32_t* outIndices)
+	{
+		uint32_t count = 0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			bool bVisible = true;
+			for (const glm::vec4& plane : planes)
+			{
+				bVisible &= plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w >= -spheres.radius[i];
+			}
+
+			// Branchless so the loop does not stall on unpredictable results
+			outIndices[count] = i;
+			count += bVisible;
+		}
+		return count;
+	}
+
+#ifdef FIREFLY_SIMD_X64
+	const bool bAvx2Supported = IsAvx2Supported();
+
+	// Row m lists the lanes set in the lane mask m in ascending order, so the visible indices of a group are written
+	// with one store instead of a mispredicted branch per lane. The 4 lane path only uses the rows below 16.
+	constexpr std::array<std::array<uint32_t, 8>, 256> VISIBLE_LANES = []()
+	{
+		std::array<std::array<uint32_t, 8>, 256> visibleLanes{};
+		for (uint32_t mask = 0; mask < visibleLanes.size(); mask++)
+		{
+			uint32_t visibleCount = 0;
+			for (uint32_t lane = 0; lane < 8; lane++)
+			{
+				if ((mask >> lane) & 1)
+				{
+					visibleLanes[mask][visibleCount++] = lane;
+				}
+			}
+		}
+		return visibleLanes;
+	}();
+
+	uint32_t CullSpheresSSE2(const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, uint32_t begin, const uint32_t end, uint32_t* outIndices)
+	{
+		// Every plane component broadcast once, the loop only loads spheres
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (size_t planeIdx = 0; planeIdx < planes.size(); planeIdx++)
+		{
+			planeX[planeIdx] = _mm_set1_ps(planes[planeIdx].x);
+			planeY[planeIdx] = _mm_set1_ps(planes[planeIdx].y);
+			planeZ[planeIdx] = _mm_set1_ps(planes[planeIdx].z);
+			planeW[planeIdx] = _mm_set1_ps(planes[planeIdx].w);
+		}
+		const __m128 signBit = _mm_set1_ps(-0.f);
+
+		uint32_t count = 0;
+		for (; begin + 4 <= end; begin += 4)
+		{
+			const __m128 x = _mm_loadu_ps(spheres.centerX.data() + begin);
+			const __m128 y = _mm_loadu_ps(spheres.centerY.data() + begin);
+			const __m128 z = _mm_loadu_ps(spheres.centerZ.data() + begin);
+			const __m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(spheres.radius.data() + begin), signBit);
+
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (size_t planeIdx = 0; planeIdx < planes.size(); planeIdx++)
+			{
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[planeIdx], x), _mm_mul_ps(planeY[planeIdx], y)), _mm_mul_ps(planeZ[planeIdx], z)), planeW[planeIdx]);
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+			}
+
+			// All four lanes are stored, the ones past the visible count are overwritten later or lie past the returned count
+			const uint32_t visibleBits = static_cast<uint32_t>(_mm_movemask_ps(visible));
+			const __m128i visibleLanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(VISIBLE_LANES[visibleBits].data()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(outIndices + count), _mm_add_epi32(visibleLanes, _mm_set1_epi32(static_cast<int>(begin))));
+			count += std::popcount(visibleBits);
+		}
+
+		return count + CullSpheresScalar(spheres, planes, begin, end, outIndices + count);
+	}
+
+	FIREFLY_TARGET_AVX2 uint32_t CullSpheresAVX2(const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, uint32_t begin, const uint32_t end, uint32_t* outIndices)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (size_t planeIdx = 0; planeIdx < planes.size(); planeIdx++)
+		{
+			planeX[planeIdx] = _mm256_set1_ps(planes[planeIdx].x);
+			planeY[planeIdx] = _mm256_set1_ps(planes[planeIdx].y);
+			planeZ[planeIdx] = _mm256_set1_ps(planes[planeIdx].z);
+			planeW[planeIdx] = _mm256_set1_ps(planes[planeIdx].w);
+		}
+		const __m256 signBit = _mm256_set1_ps(-0.f);
+
+		uint32_t count = 0;
+		for (; begin + 8 <= end; begin += 8)
+		{
+			const __m256 x = _mm256_loadu_ps(spheres.centerX.data() + begin);
+			const __m256 y = _mm256_loadu_ps(spheres.centerY.data() + begin);
+			const __m256 z = _mm256_loadu_ps(spheres.centerZ.data() + begin);
+			const __m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(spheres.radius.data() + begin), signBit);
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (size_t planeIdx = 0; planeIdx < planes.size(); planeIdx++)
+			{
+				const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[planeIdx], x), _mm256_mul_ps(planeY[planeIdx], y)), _mm256_mul_ps(planeZ[planeIdx], z)), planeW[planeIdx]);
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+			}
+
+			const uint32_t visibleBits = static_cast<uint32_t>(_mm256_movemask_ps(visible));
+			const __m256i visibleLanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(VISIBLE_LANES[visibleBits].data()));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(outIndices + count), _mm256_add_epi32(visibleLanes, _mm256_set1_epi32(static_cast<int>(begin))));
+			count += std::popcount(visibleBits);
+		}
+
+		return count + CullSpheresSSE2(spheres, planes, begin, end, outIndices + count);
+	}
+#endif
+}
+
+std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProj)
+{
+	// Rows of the matrix, glm stores columns
+	const glm::mat4 rows = glm::transpose(viewProj);
+
+	std::array<glm::vec4, 6> planes =
+	{
+		rows[3] + rows[0], // Left
+		rows[3] - rows[0], // Right
+		rows[3] + rows[1], // Bottom, or top with Y flipped
+		rows[3] - rows[1], // Top, or bottom
+		rows[3] + rows[2], // Near
+		rows[3] - rows[2]  // Far
+	};
+
+	for (glm::vec4& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return planes;
+}
+
+void BoundingSpheres::Resize(const uint32_t count)
+{
+	centerX.resize(count);
+	centerY.resize(count);
+	centerZ.resize(count);
+	radius.resize(count);
+}
+
+uint32_t CullSpheres(const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, const uint32_t begin, const uint32_t end, uint32_t* outIndices)
+{
+#ifdef FIREFLY_SIMD_X64
+	if (bAvx2Supported)
+	{
+		return CullSpheresAVX2(spheres, planes, begin, end, outIndices);
+	}
+	return CullSpheresSSE2(spheres, planes, begin, end, outIndices);
+#else
+	return CullSpheresScalar(spheres, planes, begin, end, outIndices);
+#endif
+}
+
+std::span<const uint32_t> FrustumCuller::Cull(ThreadPool& threadPool, const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, const uint32_t batchSize)
+{
+	const uint32_t count = spheres.Size();
+	mVisibleIndices.resize(count);
+
+	// A single batch goes straight into place on this thread, without waking the pool or packing afterwards
+	if (count <= batchSize || threadPool.GetThreadCount() == 1)
+	{
+		return std::span<const uint32_t>(mVisibleIndices.data(), CullSpheres(spheres, planes, 0, count, mVisibleIndices.data()));
+	}
+
+	mBatchVisibleCounts.resize((count + batchSize - 1) / batchSize);
+
+	// ParallelFor batches start at multiples of batchSize, which gives each its slot in mBatchVisibleCounts
+	threadPool.ParallelFor(count, batchSize, [this, &spheres, &planes, batchSize](uint32_t begin, uint32_t end, uint32_t threadIdx)
+	{
+		mBatchVisibleCounts[begin / batchSize] = CullSpheres(spheres, planes, begin, end, mVisibleIndices.data() + begin);
+	});
+
+	// Close the gaps behind every batch, moving down keeps the indices ascending
+	uint32_t visibleCount = 0;
+	for (uint32_t batchIdx = 0; batchIdx < static_cast<uint32_t>(mBatchVisibleCounts.size()); batchIdx++)
+	{
+		const uint32_t* pBatchIndices = mVisibleIndices.data() + batchIdx * batchSize;
+		if (mVisibleIndices.data() + visibleCount != pBatchIndices)
+		{
+			std::copy(pBatchIndices, pBatchIndices + mBatchVisibleCounts[batchIdx], mVisibleIndices.data() + visibleCount);
+		}
+		visibleCount += mBatchVisibleCounts[batchIdx];
+	}
+
+	return std::span<const uint32_t>(mVisibleIndices.data(), visibleCount);
+}
@@ -0,0 +1,210 @@
+#include "EntityAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+EntityAllocator::EntityAllocator(const uint32_t inCapacity)
+	: mCapacity(inCapacity)
+	, mVersions(new EntityVersion[inCapacity]())
+	, mFreeListNext(new std::atomic<EntityIndex>[inCapacity])
+	, mFreeListHead(PackHead(INVALID_ENTITY_INDEX, 0))
+	, mReservationBlocks(new ReservationBlock[MAX_THREAD_SLOTS])
+{
+	assert(inCapacity < INVALID_ENTITY_INDEX);
+
+	for (uint32_t i = 0; i < inCapacity; ++i)
+	{
+		mFreeListNext[i].store(INVALID_ENTITY_INDEX, std::memory_order_relaxed);
+	}
+}
+
+EntityID EntityAllocator::Allocate()
+{
+	const uint32_t slot = GetCurrentThreadSlot();
+	ReservationBlock& block = mReservationBlocks[slot];
+
+	EntityIndex index = INVALID_ENTITY_INDEX;
+
+	// The flag only guards against another thread that hashed onto the same slot, we never wait on it
+	if (!block.inUse.test_and_set(std::memory_order_acquire))
+	{
+		if (block.count == 0)
+		{
+			RefillBlock(block);
+		}
+
+		if (block.count > 0)
+		{
+			index = block.indices[--block.count];
+		}
+
+		block.inUse.clear(std::memory_order_release);
+	}
+
+	// The slot's block was busy with a thread sharing the slot, so nothing was reserved for us yet either
+	if (index == INVALID_ENTITY_INDEX && !PopFreeIndex(index) && !StealFromOtherBlocks(slot, index) && !ReserveFromHighWaterMark(index))
+	{
+		return CreateEntityId(INVALID_ENTITY_INDEX, 0);
+	}
+
+	return CreateEntityId(index, mVersions[index]);
+}
+
+void EntityAllocator::Free(const EntityID id)
+{
+	const EntityIndex index = GetEntityIndex(id);
+
+	assert(index < mCapacity);
+	assert(mVersions[index] == GetEntityVersion(id));
+
+	mVersions[index] = GetEntityVersion(id) + 1;
+
+	ReservationBlock& block = mReservationBlocks[GetCurrentThreadSlot()];
+	if (!block.inUse.test_and_set(std::memory_order_acquire))
+	{
+		const bool bCached = block.count < RESERVATION_BLOCK_SIZE;
+		if (bCached)
+		{
+			block.indices[block.count++] = index;
+		}
+
+		block.inUse.clear(std::memory_order_release);
+
+		if (bCached)
+		{
+			return;
+		}
+	}
+
+	PushFreeIndex(index);
+}
+
+void EntityAllocator::FlushThreadCaches()
+{
+	for (uint32_t slot = 0; slot < MAX_THREAD_SLOTS; ++slot)
+	{
+		ReservationBlock& block = mReservationBlocks[slot];
+		while (block.count > 0)
+		{
+			PushFreeIndex(block.indices[--block.count]);
+		}
+	}
+}
+
+uint32_t EntityAllocator::GetHighWaterMark() const
+{
+	// The counter is bumped a whole block at a time so it may run past the end
+	return std::min(mHighWaterMark.load(std::memory_order_acquire), mCapacity);
+}
+
+bool EntityAllocator::PopFreeIndex(EntityIndex& outIndex)
+{
+	uint64_t head = mFreeListHead.load(std::memory_order_acquire);
+	while (true)
+	{
+		const EntityIndex headIndex = static_cast<EntityIndex>(head);
+		if (headIndex == INVALID_ENTITY_INDEX)
+		{
+			return false;
+		}
+
+		// This may read a link that is being rewritten by another thread, the tag makes the exchange below fail in that case
+		const EntityIndex nextIndex = mFreeListNext[headIndex].load(std::memory_order_relaxed);
+		const uint64_t newHead = PackHead(nextIndex, static_cast<uint32_t>(head >> 32) + 1);
+
+		if (mFreeListHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			outIndex = headIndex;
+			return true;
+		}
+	}
+}
+
+void EntityAllocator::PushFreeIndex(const EntityIndex index)
+{
+	uint64_t head = mFreeListHead.load(std::memory_order_relaxed);
+	while (true)
+	{
+		mFreeListNext[index].store(static_cast<EntityIndex>(head), std::memory_order_relaxed);
+		const uint64_t newHead = PackHead(index, static_cast<uint32_t>(head >> 32) + 1);
+
+		if (mFreeListHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+void EntityAllocator::RefillBlock(ReservationBlock& block)
+{
+	assert(block.count == 0);
+
+	// Prefer recycled indices so the entity table stays dense
+	while (block.count < RESERVATION_BLOCK_SIZE / 2)
+	{
+		EntityIndex index;
+		if (!PopFreeIndex(index))
+		{
+			break;
+		}
+		block.indices[block.count++] = index;
+	}
+
+	if (block.count > 0)
+	{
+		return;
+	}
+
+	const uint32_t first = mHighWaterMark.fetch_add(RESERVATION_BLOCK_SIZE, std::memory_order_acq_rel);
+	if (first >= mCapacity)
+	{
+		return;
+	}
+
+	const uint32_t last = std::min(first + RESERVATION_BLOCK_SIZE, mCapacity);
+	// Stored in reverse so the lowest index is handed out first
+	for (uint32_t index = last; index > first; --index)
+	{
+		block.indices[block.count++] = index - 1;
+	}
+}
+
+bool EntityAllocator::ReserveFromHighWaterMark(EntityIndex& outIndex)
+{
+	// A single index, the blocks of the threads sharing the slot refill themselves next time
+	const uint32_t index = mHighWaterMark.fetch_add(1, std::memory_order_acq_rel);
+	if (index >= mCapacity)
+	{
+		return false;
+	}
+
+	outIndex = index;
+	return true;
+}
+
+bool EntityAllocator::StealFromOtherBlocks(const uint32_t ownSlot, EntityIndex& outIndex)
+{
+	for (uint32_t offset = 1; offset < MAX_THREAD_SLOTS; ++offset)
+	{
+		ReservationBlock& block = mReservationBlocks[(ownSlot + offset) % MAX_THREAD_SLOTS];
+		if (block.inUse.test_and_set(std::memory_order_acquire))
+		{
+			continue;
+		}
+
+		const bool bFound = block.count > 0;
+		if (bFound)
+		{
+			outIndex = block.indices[--block.count];
+		}
+
+		block.inUse.clear(std::memory_order_release);
+
+		if (bFound)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
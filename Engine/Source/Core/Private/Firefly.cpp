@@ -1,6 +1,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "Firefly.h"
+#include "EmbeddedShaders.h"
+#include "Texture.h"
 
 #include <cassert>
 #include <stdexcept>
@@ -9,7 +11,8 @@
 #include <set>
 #include <algorithm>
 #include <chrono>
-#include <fstream>
+#include <cmath>
+#include <span>
 
 
 VkVertexInputBindingDescription Vertex::getBindingDescription()
@@ -43,15 +46,57 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
 	return attributeDescriptions;
 }
 
+VkVertexInputBindingDescription InstanceData::getBindingDescription()
+{
+	VkVertexInputBindingDescription bindingDescription{};
+	bindingDescription.binding = 1;
+	bindingDescription.stride = sizeof(InstanceData);
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	return bindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 3> InstanceData::getAttributeDescriptions()
+{
+	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+	attributeDescriptions[0].binding = 1;
+	attributeDescriptions[0].location = 3;
+	attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attributeDescriptions[0].offset = offsetof(InstanceData, translationRotation);
+
+	attributeDescriptions[1].binding = 1;
+	attributeDescriptions[1].location = 4;
+	attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+	attributeDescriptions[1].offset = offsetof(InstanceData, scale);
+
+	attributeDescriptions[2].binding = 1;
+	attributeDescriptions[2].location = 5;
+	attributeDescriptions[2].format = VK_FORMAT_R32_UINT;
+	attributeDescriptions[2].offset = offsetof(InstanceData, textureIdx);
+
+	return attributeDescriptions;
+}
+
 void Engine::run()
 {
+	// The main thread records too, so it counts towards the recording threads
+	const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	threadPool.Init(std::min(hardwareThreads, MAX_RECORDING_THREADS) - 1);
+
+	// Decoded on the pool while the window, instance and device are created, initGraphics waits for them
+	sceneTexture = assetLoader.LoadTexture("Engine/Textures/SMPTE_Color_Bars.png");
+	assetLoader.Start(threadPool);
+
 	initWindow();
 	initGraphics();
+	initScene();
 
 	mainLoop();
 
 	cleanupGraphics();
 	cleanupWindow();
+
+	threadPool.Shutdown();
 }
 
 void Engine::mainLoop()
@@ -63,9 +108,27 @@ void Engine::mainLoop()
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 		float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - previousTime).count();
-		
+
+		// Waiting first means input is sampled as late as possible, at the cost of the CPU no longer running ahead of the GPU
+		const bool bWaitBeforeSampling = framePacer.ShouldWaitBeforeSampling();
+		if (bWaitBeforeSampling)
+		{
+			waitForFrameSlot();
+		}
+
 		stepSimulation(deltaTime);
+
+		// Frame boundary, what simulation wrote becomes the copy extraction reads
+		scene.SwapComponentBuffers();
+
+		if (!bWaitBeforeSampling)
+		{
+			waitForFrameSlot();
+		}
+
 		drawFrame(deltaTime);
+
+		reportFrameTimings();
 		
 		previousTime = currentTime;
 	}
@@ -82,10 +145,17 @@ void Engine::stepSimulation(float deltaTime)
 	{
 		processEvent(event);
 	}
+	framePacer.OnInputSampled();
 
 	InputState.KeyboardStateChangedMask.Mask = PreviousInputState.KeyboardStateMask.Mask ^ InputState.KeyboardStateMask.Mask;
 
 	const FInputState::FKeyboardState KeyboardState = InputState.GetKeyboardState();
+
+	// Transforms are double buffered, reads see last frame's, so the new values go through the write accessor
+	for (const EntityID id : scene.GetQueryEntities(renderableQuery))
+	{
+		scene.GetWriteComponent<Transform>(id)->rotation += deltaTime * glm::radians(50.f);
+	}
 	
 	if(KeyboardState.EKey && !KeyboardState.QKey)
 	{
@@ -114,6 +184,29 @@ void Engine::stepSimulation(float deltaTime)
 		cameraPosition.x -= deltaTime * 1.f;
 	}
 
+	if (InputState.GetKeyboardStateChange().PKey && InputState.GetKeyboardState().PKey)
+	{
+		const EFramePacingMode nextMode = static_cast<EFramePacingMode>((static_cast<uint32_t>(framePacer.GetMode()) + 1) % static_cast<uint32_t>(EFramePacingMode::Count));
+		framePacer.SetMode(nextMode);
+
+		// The swapchain is recreated after the next present so the present mode follows
+		frameBufferResized = true;
+	}
+
+	if (InputState.GetKeyboardStateChange().TKey && InputState.GetKeyboardState().TKey)
+	{
+		// Another specialization of the same shaders, drawn with the current variant until it has compiled
+		for (SpecializationConstant& constant : spritePipelineDesc.specializationConstants)
+		{
+			if (constant.constantID == SPRITE_CONSTANT_VERTEX_COLOR_TINT)
+			{
+				constant.value = constant.value == VK_FALSE ? VK_TRUE : VK_FALSE;
+			}
+		}
+		spritePipeline = pipelineManager.RequestGraphicsPipeline(spritePipelineDesc, spritePipeline);
+	}
+
+#ifndef NDEBUG
 	if (InputState.GetKeyboardStateChange().LKey && InputState.GetKeyboardState().LKey)
 	{
 		EntityID e0 = scene.CreateEntity();
@@ -139,6 +232,7 @@ void Engine::stepSimulation(float deltaTime)
 		scene.GetOrAddComponent<TestComponent2>(e5);
 		scene.DebugPrintState();
 	}
+#endif
 }
 
 void Engine::processEvent(const SDL_Event& event)
@@ -191,43 +285,87 @@ void Engine::cleanupWindow()
 	SDL_Quit();
 }
 
-void Engine::drawFrame(float deltaTime)
+void Engine::initScene()
 {
-	vkWaitForFences(vulkanDevice, 1, &inFlightFences[inFlightFrameIdx], VK_TRUE, UINT64_MAX);
+	renderableQuery = scene.RegisterQuery<Transform, Sprite>();
 
-	static auto startTime = std::chrono::high_resolution_clock::now();
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	// Simulation writes the next transforms while extraction reads the current ones
+	scene.DeclareDoubleBuffered<Transform>();
 
+	Prefab spritePrefab;
+	spritePrefab.Set(Transform{}).Set(Sprite{0, textureBindlessIdx});
+	const PrefabID spritePrefabId = scene.RegisterPrefab(spritePrefab);
 
-	uint32_t swapChainImageIndex;
-	VkResult acquireImageResult = vkAcquireNextImageKHR(vulkanDevice, vulkanSwapchain, UINT64_MAX, imageAvailableSemaphores[inFlightFrameIdx], VK_NULL_HANDLE, &swapChainImageIndex);
-	if (acquireImageResult == VK_ERROR_OUT_OF_DATE_KHR)
+	// Lay the sprites out on a square grid covering the area in front of the camera
+	const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(NUM_SPRITES))));
+	const float spacing = 4.f / gridSize;
+
+	std::vector<EntityID> spriteIds(NUM_SPRITES);
+	uint32_t spriteIdx = 0;
+	scene.InstantiatePrefab<Transform>(spritePrefabId, spriteIds, [&](std::span<const EntityID>, std::span<Transform> transforms)
 	{
-		// Handle minimization of window
-		int width = 0, height = 0;
-		SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
-		while (width == 0 || height == 0) {
-			SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
-			SDL_Event event;
-			SDL_WaitEvent(&event);
-			processEvent(event);
+		for (Transform& transform : transforms)
+		{
+			transform.position = glm::vec3((spriteIdx % gridSize) * spacing - 2.f, (spriteIdx / gridSize) * spacing - 2.f, 0.f);
+			transform.rotation = glm::radians(static_cast<float>(spriteIdx % 360));
+			transform.scale = glm::vec2(spacing * 0.8f);
+			++spriteIdx;
 		}
+	});
+}
 
-		vkDeviceWaitIdle(vulkanDevice);
+void Engine::waitForFrameSlot()
+{
+	const auto waitStart = FramePacer::Clock::now();
+	vkWaitForFences(vulkanDevice, 1, &inFlightFences[inFlightFrameIdx], VK_TRUE, UINT64_MAX);
+	framePacer.OnFrameSlotReady(inFlightFrameIdx, waitStart, FramePacer::Clock::now());
 
-		for (VkImageView imageView : vulkanSwapchainImageViews)
+	// Throws on the first difference, so a validation run fails loudly
+	if (gpuCullingValidationFrames > 0 && gpuCulling.ValidateFrame(inFlightFrameIdx, threadPool))
+	{
+		if (++gpuCullingValidatedFrames == gpuCullingValidationFrames)
 		{
-			vkDestroyImageView(vulkanDevice, imageView, nullptr);
+			std::cout << std::format("GPU culling matched the CPU in all {} validated frames\n", gpuCullingValidatedFrames);
+			windowCloseRequested = true;
 		}
-		vulkanSwapchainImageViews.clear();
+	}
 
-		vkDestroySwapchainKHR(vulkanDevice, vulkanSwapchain, nullptr);
-		vulkanSwapchain = VK_NULL_HANDLE;
-		vulkanSwapchainImages.clear();
+	// The last frame submitted with this fence has finished, so have all frames before it
+	stagingRing.BeginFrame(inFlightFrameNumbers[inFlightFrameIdx]);
 
-		createSwapChain();
-		createImageViews();
+	// Resetting whole pools is cheaper than resetting their command buffers one by one
+	for (uint32_t threadIdx = 0; threadIdx < threadPool.GetThreadCount(); threadIdx++)
+	{
+		RecordingContext& recordingContext = recordingContexts[inFlightFrameIdx * threadPool.GetThreadCount() + threadIdx];
+		if (recordingContext.numUsedCommandBuffers > 0)
+		{
+			vkResetCommandPool(vulkanDevice, recordingContext.commandPool, 0);
+			recordingContext.numUsedCommandBuffers = 0;
+		}
+	}
+
+	destroyRetiredSwapchains(inFlightFrameNumbers[inFlightFrameIdx]);
+
+	if (bindlessSupported)
+	{
+		bindlessDescriptors.RecycleSlots(inFlightFrameNumbers[inFlightFrameIdx]);
+	}
+}
+
+void Engine::drawFrame(float deltaTime)
+{
+	static auto startTime = std::chrono::high_resolution_clock::now();
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+
+	uint32_t swapChainImageIndex;
+	VkResult acquireImageResult = vkAcquireNextImageKHR(vulkanDevice, vulkanSwapchain, UINT64_MAX, imageAvailableSemaphores[inFlightFrameIdx], VK_NULL_HANDLE, &swapChainImageIndex);
+	if (acquireImageResult == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// Nothing was acquired, so nothing waits on the semaphore and the fence stays signalled for the next attempt
+		recreateSwapChain();
+		return;
 	}
 	else if (acquireImageResult != VK_SUBOPTIMAL_KHR)
 	{
@@ -239,16 +377,29 @@ void Engine::drawFrame(float deltaTime)
 	VkResult resetCommandBufferResult = vkResetCommandBuffer(vulkanGraphicsCommandBuffers[inFlightFrameIdx], 0);
 	VK_CHECK(resetCommandBufferResult, "Failed to reset command buffer: {}");
 
+	frameRing.BeginFrame(inFlightFrameIdx);
+
+	std::array<glm::vec4, 6> frustumPlanes;
 	{
-		UniformBufferObject ubo{};
-		ubo.model = glm::rotate(glm::mat4(1.f), modelRotationRad += deltaTime * glm::radians(50.f), glm::vec3(0.f, 0.f, 1.f));
-		ubo.view = glm::lookAt(cameraPosition, glm::vec3(0.f, cameraPosition.y, 0.f), glm::vec3(0.f, 0.f, 1.f));
-		ubo.proj = glm::perspective(glm::radians(45.f), vulkanSwapchainSurfaceExtent.width / (float)vulkanSwapchainSurfaceExtent.height, 0.1f, 10.f);
+		FrameUniforms frameUniforms{};
+		frameUniforms.view = glm::lookAt(cameraPosition, glm::vec3(0.f, cameraPosition.y, 0.f), glm::vec3(0.f, 0.f, 1.f));
+		frameUniforms.proj = glm::perspective(glm::radians(45.f), vulkanSwapchainSurfaceExtent.width / (float)vulkanSwapchainSurfaceExtent.height, 0.1f, 10.f);
 		// GLM originally designed for OpenGL with inverted Y coordinate
-		ubo.proj[1][1] *= -1;
-		memcpy(vulkanUniformBufferMappedMemory[inFlightFrameIdx], &ubo, sizeof(ubo));
+		frameUniforms.proj[1][1] *= -1;
+		frameUniforms.viewProj = frameUniforms.proj * frameUniforms.view;
+
+		frustumPlanes = ExtractFrustumPlanes(frameUniforms.viewProj);
+		std::copy(frustumPlanes.begin(), frustumPlanes.end(), frameUniforms.frustumPlanes);
+
+		const FrameRingAllocation frameUniformsAllocation = frameRing.Allocate(sizeof(FrameUniforms));
+		memcpy(frameUniformsAllocation.pMapped, &frameUniforms, sizeof(frameUniforms));
+		frameUniformsOffset = frameUniformsAllocation.offset;
 	}
 
+	extractRenderInstances(frustumPlanes);
+
+	uint64_t uploadWaitValue = 0;
+
 	/// CONSTRUCT COMMAND BUFFER
 	{
 		VkCommandBuffer inFlightCommandBuffer = vulkanGraphicsCommandBuffers[inFlightFrameIdx];
@@ -260,116 +411,89 @@ void Engine::drawFrame(float deltaTime)
 
 		VK_CHECK(commandBufferBeginResult, "Failed to begin recording command buffer: {}");
 
-		VkImageMemoryBarrier colorImageMemoryBarrier{};
-		colorImageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		colorImageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		colorImageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorImageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		colorImageMemoryBarrier.image = vulkanSwapchainImages[swapChainImageIndex];
-		colorImageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorImageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		colorImageMemoryBarrier.subresourceRange.levelCount = 1;
-		colorImageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		colorImageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		vkCmdPipelineBarrier(
-			vulkanGraphicsCommandBuffers[inFlightFrameIdx],
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // TOP_OF_PIPE means wait for nothing, just immediately perform the image layout transition
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // Block any writes to our color out until this layout transition is done
-			0,
-			0,
-			nullptr,
-			0,
-			nullptr,
-			1,
-			&colorImageMemoryBarrier
-		);
+		framePacer.WriteBeginTimestamp(inFlightCommandBuffer, inFlightFrameIdx);
+
+		// Uploads enqueued since the last frame, the barriers inside make them visible to this frame's draws
+		stagingRing.Flush(inFlightCommandBuffer, frameNumber);
+
+		// Streamed uploads that already finished are picked up for free, only the ones this frame cannot draw without are waited on
+		asyncUploader.Submit();
+		uploadWaitValue = asyncUploader.Acquire(inFlightCommandBuffer, std::max(requiredUploadValue, asyncUploader.GetCompletedValue()));
+
+		// The GPU culling writes its own draws
+		drawCommands.clear();
+		for (uint32_t meshIdx = 0; meshIdx < static_cast<uint32_t>(meshes.size()) && !gpuCullingSupported; meshIdx++)
+		{
+			const MeshBatch& batch = meshBatches[meshIdx];
+			if (batch.instanceCount > 0)
+			{
+				drawCommands.push_back({meshIdx, batch.firstInstance, batch.instanceCount});
+			}
+		}
 
-		VkClearValue clearValue = { {{0.f, 0.f, 0.f, 1.f}} };
-
-		VkRenderingAttachmentInfo renderingAttachmentInfo{};
-		renderingAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-		renderingAttachmentInfo.imageView = vulkanSwapchainImageViews[swapChainImageIndex];
-		renderingAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		renderingAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		renderingAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		renderingAttachmentInfo.clearValue = clearValue;
-
-		VkRenderingInfo renderingInfo{};
-		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-		renderingInfo.renderArea.offset = { 0, 0 };
-		renderingInfo.renderArea.extent = vulkanSwapchainSurfaceExtent;
-		renderingInfo.layerCount = 1;
-		renderingInfo.colorAttachmentCount = 1;
-		renderingInfo.pColorAttachments = &renderingAttachmentInfo;
-
-		vkCmdBeginRendering(inFlightCommandBuffer, &renderingInfo);
-
-		vkCmdBindPipeline(inFlightCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanGraphicsPipeline);
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(vulkanSwapchainSurfaceExtent.width);
-		viewport.height = static_cast<float>(vulkanSwapchainSurfaceExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(inFlightCommandBuffer, 0, 1, &viewport);
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = vulkanSwapchainSurfaceExtent;
-		vkCmdSetScissor(inFlightCommandBuffer, 0, 1, &scissor);
-
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(inFlightCommandBuffer, 0, 1, &vulkanVertexBuffer, offsets);
-
-		vkCmdBindIndexBuffer(inFlightCommandBuffer, vulkanIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
-
-		vkCmdBindDescriptorSets(inFlightCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 1, &vulkanDescriptorSets[inFlightFrameIdx], 0, nullptr);
-
-		vkCmdDrawIndexed(inFlightCommandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-		vkCmdEndRendering(inFlightCommandBuffer);
-
-		VkImageMemoryBarrier presentImageMemoryBarrier{};
-		presentImageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		presentImageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		presentImageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		presentImageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		presentImageMemoryBarrier.image = vulkanSwapchainImages[swapChainImageIndex];
-		presentImageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		presentImageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-		presentImageMemoryBarrier.subresourceRange.levelCount = 1;
-		presentImageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-		presentImageMemoryBarrier.subresourceRange.layerCount = 1;
-
-		vkCmdPipelineBarrier(
-			inFlightCommandBuffer,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-			0,
-			0,
-			nullptr,
-			0,
-			nullptr,
-			1,
-			&presentImageMemoryBarrier
+		// The graph works out the layout transitions, the swapchain image comes in undefined and leaves ready to present
+		renderGraph.BeginFrame(frameNumber, inFlightFrameNumbers[inFlightFrameIdx]);
+
+		VkImageSubresourceRange swapchainRange{};
+		swapchainRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		swapchainRange.baseMipLevel = 0;
+		swapchainRange.levelCount = 1;
+		swapchainRange.baseArrayLayer = 0;
+		swapchainRange.layerCount = 1;
+
+		const RenderGraphResource swapchainImage = renderGraph.ImportImage(
+			vulkanSwapchainImages[swapChainImageIndex],
+			vulkanSwapchainImageViews[swapChainImageIndex],
+			swapchainRange,
+			ERenderGraphAccess::SwapchainAcquire,
+			ERenderGraphAccess::Present
 		);
 
+		// Added first so the culling runs before the sprite pass draws what it wrote
+		GpuCulling::Outputs culled;
+		if (gpuCullingSupported)
+		{
+			culled = gpuCulling.AddPasses(renderGraph, inFlightFrameIdx, frameUniformsOffset, instanceDataOffset, renderInstanceCount);
+		}
+
+		const RenderGraphPass spritePass = renderGraph.AddPass("Sprites", [this, swapchainImage](VkCommandBuffer commandBuffer)
+		{
+			recordSpritePass(commandBuffer, renderGraph.GetImageView(swapchainImage));
+		});
+		renderGraph.UseResource(spritePass, swapchainImage, ERenderGraphAccess::ColorAttachmentWrite);
+
+		if (gpuCullingSupported)
+		{
+			renderGraph.UseResource(spritePass, culled.draws, ERenderGraphAccess::IndirectBufferRead);
+			renderGraph.UseResource(spritePass, culled.instances, ERenderGraphAccess::VertexBufferRead);
+		}
+
+		renderGraph.Compile();
+		renderGraph.Execute(inFlightCommandBuffer);
+
+		framePacer.WriteEndTimestamp(inFlightCommandBuffer, inFlightFrameIdx);
+
 		VkResult endCommandBufferResult = vkEndCommandBuffer(inFlightCommandBuffer);
 
 		VK_CHECK(endCommandBufferResult, "Failed to construct command buffer: {}");
 	}
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[inFlightFrameIdx] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[inFlightFrameIdx], asyncUploader.GetTimelineSemaphore() };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, AsyncUploader::CONSUMER_STAGES };
+	// The binary semaphore's value is ignored
+	uint64_t waitValues[] = { 0, uploadWaitValue };
 
 	VkSemaphore signalSempahores[] = { renderingFinishedSemaphores[inFlightFrameIdx] };
 
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = uploadWaitValue != 0 ? 2 : 1;
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues;
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = uploadWaitValue != 0 ? 2 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
@@ -380,6 +504,11 @@ void Engine::drawFrame(float deltaTime)
 	VkResult submitQuueResult = vkQueueSubmit(vulkanGraphicsQueue, 1, &submitInfo, inFlightFences[inFlightFrameIdx]);
 	VK_CHECK(submitQuueResult, "Failed to submit draw command buffer: {}");
 
+	framePacer.OnSubmitted(inFlightFrameIdx);
+
+	inFlightFrameNumbers[inFlightFrameIdx] = frameNumber;
+	frameNumber++;
+
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
@@ -394,36 +523,43 @@ void Engine::drawFrame(float deltaTime)
 	{
 		frameBufferResized = false;
 
-		int width = 0, height = 0;
-		SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
-		while (width == 0 || height == 0) {
-			SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
-			SDL_Event event;
-			SDL_WaitEvent(&event);
-			processEvent(event);
-		}
-
-		vkDeviceWaitIdle(vulkanDevice);
-
-		for (VkImageView imageView : vulkanSwapchainImageViews)
-		{
-			vkDestroyImageView(vulkanDevice, imageView, nullptr);
-		}
-		vulkanSwapchainImageViews.clear();
-
-		vkDestroySwapchainKHR(vulkanDevice, vulkanSwapchain, nullptr);
-		vulkanSwapchain = VK_NULL_HANDLE;
-		vulkanSwapchainImages.clear();
-
-		createSwapChain();
-		createImageViews();
+		recreateSwapChain();
 	}
 	else
 	{
 		VK_CHECK(presentResult, "Failed to present image: {}");
 	}
 
-	inFlightFrameIdx = (inFlightFrameIdx + 1) & MAX_FRAMES_IN_FLIGHT;
+	// Picks up a change of pacing mode here, slots past the new count simply stop being used
+	inFlightFrameIdx = (inFlightFrameIdx + 1) % framePacer.GetFramesInFlight();
+}
+
+void Engine::reportFrameTimings()
+{
+	const auto now = std::chrono::high_resolution_clock::now();
+	if (now - lastTimingReportTime < std::chrono::seconds(1))
+	{
+		return;
+	}
+	lastTimingReportTime = now;
+
+	FrameTimings timings;
+	uint32_t frameCount = 0;
+	if (!framePacer.ConsumeAverageTimings(timings, frameCount))
+	{
+		return;
+	}
+
+	const std::string title = std::format(
+		"Firefly | {} | {} fps | cpu {:.2f} ms (wait {:.2f} ms) | gpu {:.2f} ms | input to present ~{:.1f} ms",
+		GetFramePacingModeName(framePacer.GetMode()),
+		frameCount,
+		timings.cpuFrameMs,
+		timings.cpuWaitMs,
+		timings.gpuMs,
+		timings.inputToPresentMs
+	);
+	SDL_SetWindowTitle(sdlWindow, title.c_str());
 }
 
 void Engine::initGraphics()
@@ -687,14 +823,18 @@ void Engine::initGraphics()
 				}
 			}
 
-			// Check if the device supports dynamic rendering
+			// Check if the device supports dynamic rendering and synchronization2
 			{
 				VkPhysicalDeviceDynamicRenderingFeatures physicalDeviceDynamicRenderingFeatures{};
 				physicalDeviceDynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
 
+				VkPhysicalDeviceSynchronization2Features physicalDeviceSynchronization2Features{};
+				physicalDeviceSynchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+				physicalDeviceSynchronization2Features.pNext = &physicalDeviceDynamicRenderingFeatures;
+
 				VkPhysicalDeviceFeatures2 physicalDeviceFeatures{};
 				physicalDeviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-				physicalDeviceFeatures.pNext = &physicalDeviceDynamicRenderingFeatures;
+				physicalDeviceFeatures.pNext = &physicalDeviceSynchronization2Features;
 				vkGetPhysicalDeviceFeatures2(physicalDevice, &physicalDeviceFeatures);
 
 				if (physicalDeviceDynamicRenderingFeatures.dynamicRendering == VK_FALSE)
@@ -702,6 +842,11 @@ void Engine::initGraphics()
 					continue;
 				}
 
+				if (physicalDeviceSynchronization2Features.synchronization2 == VK_FALSE)
+				{
+					continue;
+				}
+
 				if(physicalDeviceFeatures.features.samplerAnisotropy == VK_FALSE)
 				{
 					continue;
@@ -776,7 +921,7 @@ void Engine::initGraphics()
 					}
 				}
 
-				if (graphicsQueueIdx.has_value() && presentQueueIdx.has_value())
+				if (graphicsQueueIdx.has_value() && presentQueueIdx.has_value() && dedicatedTransferQueue)
 				{
 					break;
 				}
@@ -796,13 +941,49 @@ void Engine::initGraphics()
 			}
 		}
 
+		// Optional, textures stay uncompressed without it
+		VkPhysicalDeviceFeatures supportedFeatures{};
+		vkGetPhysicalDeviceFeatures(vulkanPhysicalDevice, &supportedFeatures);
+		textureCompressionBCSupported = supportedFeatures.textureCompressionBC == VK_TRUE;
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 
 		VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeautres{};
 		dynamicRenderingFeautres.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
 		dynamicRenderingFeautres.dynamicRendering = VK_TRUE;
 
+		// The render graph records its barriers with vkCmdPipelineBarrier2
+		VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+		synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+		synchronization2Features.synchronization2 = VK_TRUE;
+		synchronization2Features.pNext = &dynamicRenderingFeautres;
+
+		// Uploads on the transfer queue signal a timeline semaphore
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.timelineSemaphore = VK_TRUE;
+		vulkan12Features.pNext = &synchronization2Features;
+
+		// Optional, without descriptor indexing every draw samples the texture in the per frame set
+		bindlessSupported = bindlessRequested && BindlessDescriptors::IsSupported(vulkanPhysicalDevice);
+		if (bindlessSupported)
+		{
+			BindlessDescriptors::EnableFeatures(vulkan12Features);
+		}
+
+		// Optional, without it the CPU culls and builds one draw per mesh
+		gpuCullingSupported = gpuCullingRequested && GpuCulling::IsSupported(vulkanPhysicalDevice, graphicsQueueIdx.value());
+		if (gpuCullingValidationFrames > 0 && !gpuCullingSupported)
+		{
+			throw std::runtime_error("GPU culling validation needs GPU culling, which is off or unsupported");
+		}
+		if (gpuCullingSupported)
+		{
+			GpuCulling::EnableFeatures(vulkanPhysicalDevice, deviceFeatures, vulkan12Features);
+		}
+
 		VkDeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -814,7 +995,7 @@ void Engine::initGraphics()
 		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(desiredDeviceExtensions.size());
 		deviceCreateInfo.ppEnabledExtensionNames = desiredDeviceExtensions.data();
 
-		deviceCreateInfo.pNext = &dynamicRenderingFeautres;
+		deviceCreateInfo.pNext = &vulkan12Features;
 
 		VkResult result = vkCreateDevice(vulkanPhysicalDevice, &deviceCreateInfo, nullptr, &vulkanDevice);
 		VK_CHECK(result, "Failed to create logical device: {}");
@@ -826,158 +1007,43 @@ void Engine::initGraphics()
 		graphicsQueueFamilyIndex = graphicsQueueIdx.value();
 		presentQueueFamilyIndex = presentQueueIdx.value();
 		transferQueueFamilyIdx = transferQueueIdx.value();
-	}
 
-	/// CREATE SWAPCHAIN
-	createSwapChain();
+		gpuAllocator.Init(vulkanPhysicalDevice, vulkanDevice);
 
-	/// CREATE IMAGE VIEWS
-	createImageViews();
+		stagingRing.Init(vulkanPhysicalDevice, vulkanDevice, gpuAllocator);
 
-	/// CREATE GRAPHICS PIPELINE
-	{
-		auto readFile = [](const std::string& filename) -> std::vector<char>
-			{
-				std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		asyncUploader.Init(vulkanPhysicalDevice, vulkanDevice, gpuAllocator, vulkanTransferQueue, transferQueueFamilyIdx, graphicsQueueFamilyIndex);
 
-				if (!file.is_open())
-				{
-					throw std::runtime_error(std::format("Failed to open file {}", filename));
-				}
+		renderGraph.Init(vulkanDevice, gpuAllocator);
 
-				size_t fileSize = (size_t)file.tellg();
+		framePacer.Init(vulkanPhysicalDevice, vulkanDevice, graphicsQueueFamilyIndex, framePacingMode);
 
-				std::vector<char> buffer(fileSize);
+		pipelineManager.Init(vulkanPhysicalDevice, vulkanDevice, "Saved/PipelineCache.bin", PIPELINE_COMPILE_THREADS);
 
-				file.seekg(0);
-				file.read(buffer.data(), fileSize);
-				file.close();
+		if (bindlessSupported)
+		{
+			bindlessDescriptors.Init(vulkanPhysicalDevice, vulkanDevice, MAX_BINDLESS_TEXTURES, MAX_BINDLESS_STORAGE_BUFFERS);
+		}
+	}
 
-				return buffer;
-			};
+	/// CREATE SWAPCHAIN
+	createSwapChain();
 
-		auto createShaderModule = [device = vulkanDevice](const std::vector<char>& code) -> VkShaderModule
-			{
-				VkShaderModuleCreateInfo createInfo{};
-				createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-				createInfo.codeSize = code.size();
-				// Apparently vector will automatically 4 byte align our vector
-				createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-				VkShaderModule shaderModule;
-
-				VkResult result = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule);
-				VK_CHECK(result, "Failed to create shader module: {}")
-
-				return shaderModule;
-			};
-
-		VkShaderModule vertShaderModule = createShaderModule(readFile("Engine/Shaders/vert.spv"));
-		VkShaderModule fragShaderModule = createShaderModule(readFile("Engine/Shaders/frag.spv"));
-
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		// Entry point of shader
-		vertShaderStageInfo.pName = "main";
-		// pSpecializationInfo allows you to specify values for shader constants
-		// You can use a single shader module where its behavior can be configured at pipeline creation by specifying different values for the constants used in it.
-		// This is more efficient than configuring the shader using variables at render time, because the compiler can do optimizations like eliminating if statements that depend on these values.
-		vertShaderStageInfo.pSpecializationInfo = nullptr;
-
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
-		fragShaderStageInfo.pSpecializationInfo = nullptr;
-
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-		// Dynamic states allow you to change certain very specific parts of the piepline at runtime
-		// Most of the pipeline is fixed after creation
-		std::vector<VkDynamicState> dynamicStates =
-		{
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_SCISSOR
-		};
+	/// CREATE IMAGE VIEWS
+	createImageViews();
 
-		VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
-		dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-		dynamicStateInfo.pDynamicStates = dynamicStates.data();
-
-		VkVertexInputBindingDescription bindingDescription = Vertex::getBindingDescription();
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssemplyInfo{};
-		inputAssemplyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemplyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-		inputAssemplyInfo.primitiveRestartEnable = VK_FALSE;
-
-		VkPipelineViewportStateCreateInfo viewportStateInfo{};
-		viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportStateInfo.viewportCount = 1;
-		viewportStateInfo.scissorCount = 1;
-
-		VkPipelineRasterizationStateCreateInfo rasterizationInfo{};
-		rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		// If depthClampEnable is set to VK_TRUE, then fragments that are beyond the near and far planes are clamped to them as opposed to discarding them.
-		rasterizationInfo.depthClampEnable = VK_FALSE;
-		// If rasterizerDiscardEnable is set to VK_TRUE, then geometry never passes through the rasterizer stage.
-		rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationInfo.lineWidth = 1.0f;
-		rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		// The rasterizer can alter the depth values by adding a constant value or biasing them based on a fragment's slope
-		rasterizationInfo.depthBiasEnable = VK_FALSE;
-
-		// Combining the fragment shader results of multiple polygons that rasterize to the same pixel
-		// This mainly occurs along edges, which is also where the most noticeable aliasing artifacts occur
-		VkPipelineMultisampleStateCreateInfo multisamplingInfo{};
-		multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisamplingInfo.sampleShadingEnable = VK_FALSE;
-		multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisamplingInfo.minSampleShading = 1.0f;
-		multisamplingInfo.pSampleMask = nullptr;
-		multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
-		multisamplingInfo.alphaToOneEnable = VK_FALSE;
-
-		// Defines how colors are blended as they're added to the frame buffer
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		// Which color channels to write to
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		// If color blending is enabled then the equation for the blending is:
-		//	if (blendEnable) {
-		//		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) < colorBlendOp > (dstColorBlendFactor * oldColor.rgb);
-		//		finalColor.a = (srcAlphaBlendFactor * newColor.a) < alphaBlendOp > (dstAlphaBlendFactor * oldColor.a);
-		//	}
-		//	else {
-		//			finalColor = newColor;
-		//	}
-		//	finalColor = finalColor & colorWriteMask;
-
-		VkPipelineColorBlendStateCreateInfo colorBlendInfo{};
-		colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		// If true, allows blending using bitwise operations. Disables blending methods defined in each attachment structure
-		colorBlendInfo.logicOpEnable = VK_FALSE;
-		// There should be one attachment structure for each frame buffer
-		colorBlendInfo.attachmentCount = 1;
-		colorBlendInfo.pAttachments = &colorBlendAttachment;
+	/// WAIT FOR ASSETS
+	{
+		// Loading overlapped everything up to here, the thread pool is needed again from now on
+		assetLoader.Wait();
+	}
 
+	/// CREATE GRAPHICS PIPELINE
+	{
 		VkDescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		// Dynamic so one set serves every frame, the frame uniforms move through the ring by offset alone
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.descriptorCount = 1;
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -998,45 +1064,54 @@ void Engine::initGraphics()
 		VkResult descriptorSetResult = vkCreateDescriptorSetLayout(vulkanDevice, &layoutInfo, nullptr, &vulkanDescriptorSetLayout);
 		VK_CHECK(descriptorSetResult, "Failed to create descriptor set layout: {}");
 
+		// The per frame set, then the bindless tables at set 1 when they are used
+		const std::array<VkDescriptorSetLayout, 2> pipelineSetLayouts = {vulkanDescriptorSetLayout, bindlessDescriptors.GetSetLayout()};
+
 		// Used to specify shader uniform variables and push constants that can be changed at runtime
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &vulkanDescriptorSetLayout;
+		pipelineLayoutInfo.setLayoutCount = bindlessSupported ? 2 : 1;
+		pipelineLayoutInfo.pSetLayouts = pipelineSetLayouts.data();
 
 		VkResult pipelineLayoutResult = vkCreatePipelineLayout(vulkanDevice, &pipelineLayoutInfo, nullptr, &vulkanPipelineLayout);
 
 		VK_CHECK(pipelineLayoutResult, "Failed to create pipeline layout: {}");
 
-		VkPipelineRenderingCreateInfo pipelineRenderingInfo{};
-		pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-		pipelineRenderingInfo.colorAttachmentCount = 1;
-		pipelineRenderingInfo.pColorAttachmentFormats = &vulkanSwapchainSurfaceFormat.format;
+		spritePipelineDesc.vertexShader = pipelineManager.RegisterShader(EmbeddedShaders::SPRITE_VERT);
+		spritePipelineDesc.fragmentShader = bindlessSupported ? pipelineManager.RegisterShader(EmbeddedShaders::SPRITE_BINDLESS_FRAG) : pipelineManager.RegisterShader(EmbeddedShaders::SPRITE_FRAG);
+		spritePipelineDesc.specializationConstants = { {SPRITE_CONSTANT_VERTEX_COLOR_TINT, VK_FALSE} };
 
-		VkGraphicsPipelineCreateInfo graphicsPipelineInfo{};
-		graphicsPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		graphicsPipelineInfo.stageCount = 2;
-		graphicsPipelineInfo.pStages = shaderStages;
-
-		graphicsPipelineInfo.pDynamicState = &dynamicStateInfo;
-		graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
-		graphicsPipelineInfo.pInputAssemblyState = &inputAssemplyInfo;
-		graphicsPipelineInfo.pViewportState = &viewportStateInfo;
-		graphicsPipelineInfo.pRasterizationState = &rasterizationInfo;
-		graphicsPipelineInfo.pMultisampleState = &multisamplingInfo;
-		graphicsPipelineInfo.pDepthStencilState = nullptr;
-		graphicsPipelineInfo.pColorBlendState = &colorBlendInfo;
+		spritePipelineDesc.vertexBindings = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+		{
+			const std::array<VkVertexInputAttributeDescription, 3> vertexAttributes = Vertex::getAttributeDescriptions();
+			const std::array<VkVertexInputAttributeDescription, 3> instanceAttributes = InstanceData::getAttributeDescriptions();
+			spritePipelineDesc.vertexAttributes.assign(vertexAttributes.begin(), vertexAttributes.end());
+			spritePipelineDesc.vertexAttributes.insert(spritePipelineDesc.vertexAttributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+		}
 
-		graphicsPipelineInfo.layout = vulkanPipelineLayout;
+		spritePipelineDesc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+		spritePipelineDesc.polygonMode = VK_POLYGON_MODE_FILL;
+		spritePipelineDesc.cullMode = VK_CULL_MODE_BACK_BIT;
+		spritePipelineDesc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		spritePipelineDesc.samples = VK_SAMPLE_COUNT_1_BIT;
 
-		graphicsPipelineInfo.pNext = &pipelineRenderingInfo;
+		// Sprites overwrite whatever is below them
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.blendEnable = VK_FALSE;
 
-		VkResult graphicsPipelineResult = vkCreateGraphicsPipelines(vulkanDevice, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, nullptr, &vulkanGraphicsPipeline);
+		spritePipelineDesc.colorFormats = { vulkanSwapchainSurfaceFormat.format };
+		spritePipelineDesc.colorBlendStates = { colorBlendAttachment };
 
-		vkDestroyShaderModule(vulkanDevice, vertShaderModule, nullptr);
-		vkDestroyShaderModule(vulkanDevice, fragShaderModule, nullptr);
+		spritePipelineDesc.layout = vulkanPipelineLayout;
 
-		VK_CHECK(graphicsPipelineResult, "Failed to create graphics pipeline: {}");
+		// Everything known up front is compiled during startup on all threads, later variants compile in the background
+		const std::vector<PipelineID> prewarmedPipelines = pipelineManager.PrewarmGraphicsPipelines(std::span(&spritePipelineDesc, 1), threadPool);
+		spritePipeline = prewarmedPipelines[0];
+		if (spritePipeline == PipelineManager::INVALID_PIPELINE)
+		{
+			throw std::runtime_error("Failed to create the sprite pipeline");
+		}
 	}
 
 	/// CREATE COMMAND POOL
@@ -1049,13 +1124,17 @@ void Engine::initGraphics()
 		VkResult vertexPoolResult = vkCreateCommandPool(vulkanDevice, &graphicsPoolInfo, nullptr, &vulkanGraphicsCommandPool);
 		VK_CHECK(vertexPoolResult, "Failed to create graphics command pool : {}");
 
-		VkCommandPoolCreateInfo transferPoolInfo{};
-		transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		transferPoolInfo.queueFamilyIndex = transferQueueFamilyIdx;
+		VkCommandPoolCreateInfo recordingPoolInfo{};
+		recordingPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		recordingPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		recordingPoolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
 
-		VkResult transferPoolResult = vkCreateCommandPool(vulkanDevice, &transferPoolInfo, nullptr, &vulkanTransferCommandPool);
-		VK_CHECK(transferPoolResult, "Failed to create transfer command pool: {}");
+		recordingContexts.resize(MAX_FRAMES_IN_FLIGHT * threadPool.GetThreadCount());
+		for (RecordingContext& recordingContext : recordingContexts)
+		{
+			VkResult recordingPoolResult = vkCreateCommandPool(vulkanDevice, &recordingPoolInfo, nullptr, &recordingContext.commandPool);
+			VK_CHECK(recordingPoolResult, "Failed to create recording command pool: {}");
+		}
 	}
 
 	/// CREATE COMMAND BUFFERS
@@ -1077,6 +1156,7 @@ void Engine::initGraphics()
 		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		renderingFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		inFlightFrameNumbers.assign(MAX_FRAMES_IN_FLIGHT, 0);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1096,125 +1176,89 @@ void Engine::initGraphics()
 	{
 		VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
 
-		VkBuffer vertexStagingBuffer = VK_NULL_HANDLE;
-		VkDeviceMemory vertexStagingBufferMemory = VK_NULL_HANDLE;
-		createBuffer(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexStagingBuffer, vertexStagingBufferMemory);
-
-		void* vertexData;
-		vkMapMemory(vulkanDevice, vertexStagingBufferMemory, 0, vertexBufferSize, 0, &vertexData);
-		memcpy(vertexData, vertices.data(), static_cast<size_t>(vertexBufferSize));
-		vkUnmapMemory(vulkanDevice, vertexStagingBufferMemory);
-
-		createBuffer(sizeof(Vertex)* vertices.size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vulkanVertexBuffer, vulkanVertexBufferMemory);
+		createBuffer(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vulkanVertexBuffer, vulkanVertexBufferAllocation);
 
 		VkDeviceSize indexBufferSize = sizeof(uint16_t) * indices.size();
 
-		VkBuffer indexStagingBuffer = VK_NULL_HANDLE;
-		VkDeviceMemory indexStagingBufferMemory = VK_NULL_HANDLE;
-		createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexStagingBuffer, indexStagingBufferMemory);
+		createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vulkanIndexBuffer, vulkanIndexBufferAllocation);
 
-		void* indexdata;
-		vkMapMemory(vulkanDevice, indexStagingBufferMemory, 0, indexBufferSize, 0, &indexdata);
-		memcpy(indexdata, indices.data(), static_cast<size_t>(indexBufferSize));
-		vkUnmapMemory(vulkanDevice, indexStagingBufferMemory);
-
-		createBuffer(sizeof(Vertex)* vertices.size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vulkanIndexBuffer, vulkanIndexBufferMemory);
-
-		VkCommandBuffer transferCommandBuffer;
-
-		VkCommandBufferAllocateInfo transferCommandBufferInfo{};
-		transferCommandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		transferCommandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		transferCommandBufferInfo.commandPool = vulkanTransferCommandPool;
-		transferCommandBufferInfo.commandBufferCount = 1;
-
-		vkAllocateCommandBuffers(vulkanDevice, &transferCommandBufferInfo, &transferCommandBuffer);
-
-		VkCommandBufferBeginInfo commandBufferBeginInfo{};
-		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		VkResult beginCommandBufferResult = vkBeginCommandBuffer(transferCommandBuffer, &commandBufferBeginInfo);
-		VK_CHECK(beginCommandBufferResult, "Failed to begin vertex copy command buffer: {}");
-
-		VkBufferCopy vertexBufferCopy{};	
-		vertexBufferCopy.srcOffset = 0;
-		vertexBufferCopy.dstOffset = 0;
-		vertexBufferCopy.size = vertexBufferSize;
-
-		vkCmdCopyBuffer(transferCommandBuffer, vertexStagingBuffer, vulkanVertexBuffer, 1, &vertexBufferCopy);
-
-		VkBufferCopy indexBufferCopy{};
-		indexBufferCopy.srcOffset = 0;
-		indexBufferCopy.dstOffset = 0;
-		indexBufferCopy.size = indexBufferSize;
-
-		vkCmdCopyBuffer(transferCommandBuffer, indexStagingBuffer, vulkanIndexBuffer, 1, &indexBufferCopy);
-
-		VkResult endCommandBufferResult = vkEndCommandBuffer(transferCommandBuffer);
-		VK_CHECK(endCommandBufferResult, "Failed to end vertex copy command buffer: {}");
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &transferCommandBuffer;
-
-		VkFence transferFence;
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-
-		VK_CHECK(vkCreateFence(vulkanDevice, &fenceInfo, nullptr, &transferFence), "Failed to create transfer fence: {}");
-
-		VK_CHECK(vkQueueSubmit(vulkanTransferQueue, 1, &submitInfo, transferFence), "Failed to submit transfer queue: {}");
+		asyncUploader.EnqueueBufferUpload(vulkanVertexBuffer, 0, vertices.data(), vertexBufferSize);
+		asyncUploader.EnqueueBufferUpload(vulkanIndexBuffer, 0, indices.data(), indexBufferSize);
+	}
 
-		vkWaitForFences(vulkanDevice, 1, &transferFence, VK_TRUE, UINT64_MAX);
+	/// CREATE FRAME RING
+	{
+		const VkDeviceSize bytesPerFrame = sizeof(FrameUniforms) + sizeof(InstanceData) * MAX_INSTANCES + FRAME_RING_HEADROOM;
+		frameRing.Init(vulkanPhysicalDevice, vulkanDevice, gpuAllocator, bytesPerFrame, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 
-		vkDestroyFence(vulkanDevice, transferFence, nullptr);
-		vkFreeCommandBuffers(vulkanDevice, vulkanTransferCommandPool, 1, &transferCommandBuffer);
-		vkDestroyBuffer(vulkanDevice, vertexStagingBuffer, nullptr);
-		vkFreeMemory(vulkanDevice, vertexStagingBufferMemory, nullptr);
+		meshBatches.resize(meshes.size());
+	}
 
-		vkDestroyBuffer(vulkanDevice, indexStagingBuffer, nullptr);
-		vkFreeMemory(vulkanDevice, indexStagingBufferMemory, nullptr);
+	/// CREATE CULLING
+	for (const MeshRange& mesh : meshes)
+	{
+		float boundingRadius = 0.f;
+		for (uint32_t indexIdx = mesh.firstIndex; indexIdx < mesh.firstIndex + mesh.indexCount; indexIdx++)
+		{
+			boundingRadius = std::max(boundingRadius, glm::length(vertices[indices[indexIdx] + mesh.vertexOffset].pos));
+		}
+		meshBoundingRadii.push_back(boundingRadius);
 	}
 
-	/// CREATE UNIFORM BUFFERS
+	if (gpuCullingSupported)
 	{
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+		std::vector<GpuCullMesh> cullMeshes;
+		for (uint32_t meshIdx = 0; meshIdx < static_cast<uint32_t>(meshes.size()); meshIdx++)
+		{
+			cullMeshes.push_back({meshes[meshIdx].indexCount, meshes[meshIdx].firstIndex, meshes[meshIdx].vertexOffset, meshBoundingRadii[meshIdx]});
+		}
 
-		vulkanUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		vulkanUniformBufferMemory.resize(MAX_FRAMES_IN_FLIGHT);
-		vulkanUniformBufferMappedMemory.resize(MAX_FRAMES_IN_FLIGHT);
+		gpuCulling.Init(vulkanPhysicalDevice, vulkanDevice, gpuAllocator, pipelineManager, stagingRing, frameRing.GetBuffer(), sizeof(FrameUniforms), MAX_INSTANCES, MAX_FRAMES_IN_FLIGHT, cullMeshes);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		if (gpuCullingValidationFrames > 0)
 		{
-			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vulkanUniformBuffers[i], vulkanUniformBufferMemory[i]);
-
-			vkMapMemory(vulkanDevice, vulkanUniformBufferMemory[i], 0, bufferSize, 0, &vulkanUniformBufferMappedMemory[i]);
+			gpuCulling.EnableValidation();
 		}
 	}
 
 	/// LOAD TEXTURE INTO IMAGE BUFFER
 	{
-		int texWidth, texHeight, texChannels;
-		stbi_uc* pixels = stbi_load("Engine/Textures/SMPTE_Color_Bars.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-		VkDeviceSize imageSize = texWidth * texHeight * 4;
+		const TextureAsset& textureAsset = assetLoader.GetTexture(sceneTexture);
 
-		if (!pixels) {
-			throw std::runtime_error("Failed to load texture image!");
-		}
-
-		VkBuffer stagingBuffer{0};
-		VkDeviceMemory stagingBufferMemory{0};
+		const auto isSampleable = [this](const ETextureFormat format, const bool bSRGB)
+		{
+			return format == ETextureFormat::RGBA8 || (textureCompressionBCSupported && IsTextureFormatSupported(vulkanPhysicalDevice, GetTextureVkFormat(format, bSRGB)));
+		};
 
-		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		// Cooked mips are copied straight from the mapped file into staging memory. Without a cooked file the loader
+		// already decoded and compressed the image, block compression cuts it to a quarter or an eighth of the memory and
+		// bandwidth where the device samples it. Only a cooked texture the device cannot sample is decoded here.
+		TextureView texture;
+		TextureData decodedTexture;
+		if (textureAsset.IsCooked() && isSampleable(textureAsset.cooked.format, textureAsset.cooked.bSRGB))
+		{
+			texture = textureAsset.cooked;
+		}
+		else if (textureAsset.IsCooked())
+		{
+			std::cerr << std::format("Device cannot sample the cooked {} texture, decoding {}\n", GetTextureFormatName(textureAsset.cooked.format), textureAsset.sourcePath.string());
+			decodedTexture = DecodeTextureImage(textureAsset.sourcePath, textureAsset.bSRGB);
+			texture = ViewTexture(decodedTexture);
+		}
+		else if (isSampleable(textureAsset.compressed.format, textureAsset.compressed.bSRGB))
+		{
+			texture = ViewTexture(textureAsset.compressed);
+		}
+		else
+		{
+			texture = ViewTexture(textureAsset.decoded);
+		}
 
-		void* data;
-		vkMapMemory(vulkanDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(vulkanDevice, stagingBufferMemory);
+		const uint32_t texWidth = texture.mips[0].width;
+		const uint32_t texHeight = texture.mips[0].height;
 
-		stbi_image_free(pixels);
+		textureFormat = GetTextureVkFormat(texture.format, texture.bSRGB);
+		textureMipLevels = texture.GetMipCount();
 
 		VkImageCreateInfo imageCreateInfo{};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1222,143 +1266,41 @@ void Engine::initGraphics()
 		imageCreateInfo.extent.width = texWidth;
 		imageCreateInfo.extent.height = texHeight;
 		imageCreateInfo.extent.depth = 1;
-		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.mipLevels = textureMipLevels;
 		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		imageCreateInfo.format = textureFormat;
 		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
-		if (transferQueueFamilyIdx != graphicsQueueFamilyIndex)
-		{
-			uint32_t queueIndices[2] = { graphicsQueueFamilyIndex, transferQueueFamilyIdx };
-			imageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-			imageCreateInfo.queueFamilyIndexCount = 2;
-			imageCreateInfo.pQueueFamilyIndices = queueIndices;
-		}
-		else
-		{
-			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		}
-		
+		// Ownership moves from the transfer to the graphics queue with the upload
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCreateInfo.flags = 0;
 
 		VkResult imageResult = vkCreateImage(vulkanDevice, &imageCreateInfo, nullptr, &textureImage);
 		VK_CHECK(imageResult, "Failed to create image: {}");
 
-		VkMemoryRequirements memoryRequirements;
-		vkGetImageMemoryRequirements(vulkanDevice, textureImage, &memoryRequirements);
+		textureImageAllocation = gpuAllocator.AllocateForImage(textureImage, imageCreateInfo.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		VkPhysicalDeviceMemoryProperties memoryProperties{};
-		vkGetPhysicalDeviceMemoryProperties(vulkanPhysicalDevice, &memoryProperties);
+		VkImageSubresourceRange textureRange{};
+		textureRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		textureRange.baseMipLevel = 0;
+		textureRange.levelCount = textureMipLevels;
+		textureRange.baseArrayLayer = 0;
+		textureRange.layerCount = 1;
 
-		std::optional<uint32_t> memoryTypeIndex;
-		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
-		{
-			if ((memoryRequirements.memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-			{
-				memoryTypeIndex = i;
-			}
-		}
+		// Every mip in one upload, each region points at its mip in the packed data
+		const std::vector<VkBufferImageCopy> copyRegions = GetTextureCopyRegions(texture.mips);
 
-		if (memoryTypeIndex.has_value() == false)
-		{
-			throw std::runtime_error("Failed to find valid memory type");
-		}
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memoryRequirements.size;
-		allocInfo.memoryTypeIndex = memoryTypeIndex.value();
-
-		VkResult allocateResult = vkAllocateMemory(vulkanDevice, &allocInfo, nullptr, &textureImageMemory);
-		VK_CHECK(allocateResult, "Failed to allocate texture image memory: {}");
+		// Staged right away, the file can be unmapped once this returns
+		asyncUploader.EnqueueImageUpload(textureImage, textureRange, copyRegions, texture.data.data(), texture.data.size());
 
-		vkBindImageMemory(vulkanDevice, textureImage, textureImageMemory, 0);
-
-		VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
-		commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		commandBufferAllocateInfo.commandBufferCount = 1;
-		commandBufferAllocateInfo.commandPool = vulkanTransferCommandPool;
-
-		VkCommandBuffer commandBuffer;
-		
-		vkAllocateCommandBuffers(vulkanDevice, &commandBufferAllocateInfo, &commandBuffer);
+		// Everything the scene draws with goes out in one batch, the first frame waits for it on the GPU rather than here
+		requiredUploadValue = asyncUploader.Submit();
 
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-		VkImageMemoryBarrier transferBarrier{};
-		transferBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		transferBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		transferBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		transferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		transferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		transferBarrier.image = textureImage;
-		transferBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		transferBarrier.subresourceRange.baseMipLevel = 0;
-		transferBarrier.subresourceRange.levelCount = 1;
-		transferBarrier.subresourceRange.baseArrayLayer = 0;
-		transferBarrier.subresourceRange.layerCount = 1;
-
-		VkImageMemoryBarrier shaderReadBarrier = transferBarrier;
-		
-		transferBarrier.srcAccessMask = VK_ACCESS_NONE;
-		transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		shaderReadBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		shaderReadBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		shaderReadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		shaderReadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &transferBarrier);
-
-		VkBufferImageCopy copyRegion{};
-		copyRegion.bufferOffset = 0;
-		// Specifying 0 here indicates that the pixel values are simply tightly packed in the source buffer with no padding
-		copyRegion.bufferRowLength = 0;
-		copyRegion.bufferImageHeight = 0;
-
-		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.imageSubresource.mipLevel = 0;
-		copyRegion.imageSubresource.baseArrayLayer = 0;
-		copyRegion.imageSubresource.layerCount = 1;
-
-		copyRegion.imageOffset = {0, 0, 0};
-		copyRegion.imageExtent = {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1};
-		
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &shaderReadBarrier);
-
-		vkEndCommandBuffer(commandBuffer);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		VkFence loadTextureFence;
-
-		VkFenceCreateInfo fenceCreateInfo{};
-		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceCreateInfo.flags = 0;
-		
-		vkCreateFence(vulkanDevice, &fenceCreateInfo, nullptr, &loadTextureFence);
-		
-		vkQueueSubmit(vulkanTransferQueue, 1, &submitInfo, loadTextureFence);
-		vkWaitForFences(vulkanDevice, 1, &loadTextureFence, VK_TRUE, UINT64_MAX);
-		vkDestroyFence(vulkanDevice, loadTextureFence, nullptr);
-
-		vkFreeCommandBuffers(vulkanDevice, vulkanTransferCommandPool, 1, &commandBuffer);
-
-		vkDestroyBuffer(vulkanDevice, stagingBuffer, nullptr);
-		vkFreeMemory(vulkanDevice, stagingBufferMemory, nullptr);
+		// All of it is in staging memory now
+		assetLoader.Release();
 	}
 
 	/// CREATE TEXTURE IMAGE VIEW
@@ -1367,7 +1309,7 @@ void Engine::initGraphics()
 		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		imageViewCreateInfo.image = textureImage;
 		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		imageViewCreateInfo.format = textureFormat;
 
 		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -1375,7 +1317,7 @@ void Engine::initGraphics()
 		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 		
 		imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewCreateInfo.subresourceRange.levelCount = 1;
+		imageViewCreateInfo.subresourceRange.levelCount = textureMipLevels;
 		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
 		imageViewCreateInfo.subresourceRange.layerCount = 1;
 		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
@@ -1409,77 +1351,80 @@ void Engine::initGraphics()
 		samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerCreateInfo.mipLodBias = 0.f;
 		samplerCreateInfo.minLod = 0.f;
-		samplerCreateInfo.maxLod = 0.f;
+		// The whole chain, maxLod 0 would clamp sampling to the full size mip
+		samplerCreateInfo.maxLod = static_cast<float>(textureMipLevels);
 		
 		VkResult createSamplerResult = vkCreateSampler(vulkanDevice, &samplerCreateInfo, nullptr, &textureSampler);
 		VK_CHECK(createSamplerResult, "Failed to create texture sampler {}");
 	}
 
-	/// ALLOCATE AND BIND DESCRIPTOR SETS
+	/// ADD TEXTURES TO THE BINDLESS TABLE
+	if (bindlessSupported)
+	{
+		textureBindlessIdx = bindlessDescriptors.AddTexture(textureImageView, textureSampler);
+	}
+
+	/// ALLOCATE AND BIND DESCRIPTOR SET
 	{
 		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = 1;
 		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		poolSizes[1].descriptorCount = 1;
 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		poolInfo.maxSets = 1;
 		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
 		VkResult descriptorPoolResult = vkCreateDescriptorPool(vulkanDevice, &poolInfo, nullptr, &vulkanDescriptorPool);
 		VK_CHECK(descriptorPoolResult, "Failed to create descriptor pool: {}");
 
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts(MAX_FRAMES_IN_FLIGHT, vulkanDescriptorSetLayout);
 		VkDescriptorSetAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		allocInfo.descriptorPool = vulkanDescriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		allocInfo.pSetLayouts = descriptorSetLayouts.data();
-
-		vulkanDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-		VkResult descriptorSetResult = vkAllocateDescriptorSets(vulkanDevice, &allocInfo, vulkanDescriptorSets.data());
-		VK_CHECK(descriptorSetResult, "Failed to create descriptor sets: {}");
-
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = vulkanUniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
-
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageView = textureImageView;
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.sampler = textureSampler;
-
-			std::array<VkWriteDescriptorSet, 2> descriptorSetWrites{};
-			
-			descriptorSetWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorSetWrites[0].dstSet = vulkanDescriptorSets[i];
-			descriptorSetWrites[0].dstBinding = 0;
-			descriptorSetWrites[0].dstArrayElement = 0;
-			descriptorSetWrites[0].descriptorCount = 1;
-			descriptorSetWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorSetWrites[0].pBufferInfo = &bufferInfo;
-			descriptorSetWrites[0].pImageInfo = nullptr;
-			descriptorSetWrites[0].pTexelBufferView = nullptr;
-			
-			descriptorSetWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorSetWrites[1].dstSet = vulkanDescriptorSets[i];
-			descriptorSetWrites[1].dstBinding = 1;
-			descriptorSetWrites[1].dstArrayElement = 0;
-			descriptorSetWrites[1].descriptorCount = 1;
-			descriptorSetWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorSetWrites[1].pBufferInfo = nullptr;
-			descriptorSetWrites[1].pImageInfo = &imageInfo;
-			descriptorSetWrites[1].pTexelBufferView = nullptr;
-
-			vkUpdateDescriptorSets(vulkanDevice, 2, descriptorSetWrites.data(), 0, nullptr);
-		}
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &vulkanDescriptorSetLayout;
+
+		VkResult descriptorSetResult = vkAllocateDescriptorSets(vulkanDevice, &allocInfo, &vulkanDescriptorSet);
+		VK_CHECK(descriptorSetResult, "Failed to create descriptor set: {}");
+
+		// Offset 0, the dynamic offset given at bind time picks where in the ring the frame's uniforms are
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = frameRing.GetBuffer();
+		bufferInfo.offset = 0;
+		bufferInfo.range = sizeof(FrameUniforms);
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageView = textureImageView;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.sampler = textureSampler;
+
+		std::array<VkWriteDescriptorSet, 2> descriptorSetWrites{};
+
+		descriptorSetWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorSetWrites[0].dstSet = vulkanDescriptorSet;
+		descriptorSetWrites[0].dstBinding = 0;
+		descriptorSetWrites[0].dstArrayElement = 0;
+		descriptorSetWrites[0].descriptorCount = 1;
+		descriptorSetWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		descriptorSetWrites[0].pBufferInfo = &bufferInfo;
+		descriptorSetWrites[0].pImageInfo = nullptr;
+		descriptorSetWrites[0].pTexelBufferView = nullptr;
+
+		descriptorSetWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorSetWrites[1].dstSet = vulkanDescriptorSet;
+		descriptorSetWrites[1].dstBinding = 1;
+		descriptorSetWrites[1].dstArrayElement = 0;
+		descriptorSetWrites[1].descriptorCount = 1;
+		descriptorSetWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorSetWrites[1].pBufferInfo = nullptr;
+		descriptorSetWrites[1].pImageInfo = &imageInfo;
+		descriptorSetWrites[1].pTexelBufferView = nullptr;
+
+		vkUpdateDescriptorSets(vulkanDevice, 2, descriptorSetWrites.data(), 0, nullptr);
 	}
 }
 
@@ -1490,22 +1435,20 @@ void Engine::cleanupGraphics()
 	vkDestroyImageView(vulkanDevice, textureImageView, nullptr);
 	
 	vkDestroyImage(vulkanDevice, textureImage, nullptr);
-	vkFreeMemory(vulkanDevice, textureImageMemory, nullptr);
+	gpuAllocator.Free(textureImageAllocation);
 	
-	vkFreeDescriptorSets(vulkanDevice, vulkanDescriptorPool, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT), vulkanDescriptorSets.data());
+	vkFreeDescriptorSets(vulkanDevice, vulkanDescriptorPool, 1, &vulkanDescriptorSet);
 	vkDestroyDescriptorPool(vulkanDevice, vulkanDescriptorPool, nullptr);
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		vkDestroyBuffer(vulkanDevice, vulkanUniformBuffers[i], nullptr);
-		vkFreeMemory(vulkanDevice, vulkanUniformBufferMemory[i], nullptr);
-	}
+	gpuCulling.Shutdown();
+
+	frameRing.Shutdown();
 
 	vkDestroyBuffer(vulkanDevice, vulkanVertexBuffer, nullptr);
-	vkFreeMemory(vulkanDevice, vulkanVertexBufferMemory, nullptr);
+	gpuAllocator.Free(vulkanVertexBufferAllocation);
 
 	vkDestroyBuffer(vulkanDevice, vulkanIndexBuffer, nullptr);
-	vkFreeMemory(vulkanDevice, vulkanIndexBufferMemory, nullptr);
+	gpuAllocator.Free(vulkanIndexBufferAllocation);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
@@ -1521,14 +1464,26 @@ void Engine::cleanupGraphics()
 	vkFreeCommandBuffers(vulkanDevice, vulkanGraphicsCommandPool, MAX_FRAMES_IN_FLIGHT, vulkanGraphicsCommandBuffers.data());
 
 	vkDestroyCommandPool(vulkanDevice, vulkanGraphicsCommandPool, nullptr);
-	vkDestroyCommandPool(vulkanDevice, vulkanTransferCommandPool, nullptr);
 
-	vkDestroyPipeline(vulkanDevice, vulkanGraphicsPipeline, nullptr);
-	
+	// Frees the secondary command buffers along with the pools
+	for (RecordingContext& recordingContext : recordingContexts)
+	{
+		vkDestroyCommandPool(vulkanDevice, recordingContext.commandPool, nullptr);
+	}
+	recordingContexts.clear();
+
+	// Pipelines reference the layout, so they go first
+	pipelineManager.Shutdown();
+
 	vkDestroyPipelineLayout(vulkanDevice, vulkanPipelineLayout, nullptr);
 
 	vkDestroyDescriptorSetLayout(vulkanDevice, vulkanDescriptorSetLayout, nullptr);
 
+	if (bindlessSupported)
+	{
+		bindlessDescriptors.Shutdown();
+	}
+
 	for (VkImageView imageView : vulkanSwapchainImageViews)
 	{
 		vkDestroyImageView(vulkanDevice, imageView, nullptr);
@@ -1538,6 +1493,18 @@ void Engine::cleanupGraphics()
 	vkDestroySwapchainKHR(vulkanDevice, vulkanSwapchain, nullptr);
 	vulkanSwapchainImages.clear();
 
+	destroyRetiredSwapchains(UINT64_MAX);
+
+	framePacer.Shutdown();
+
+	renderGraph.Shutdown();
+
+	asyncUploader.Shutdown();
+
+	stagingRing.Shutdown();
+
+	gpuAllocator.Shutdown();
+
 	vkDestroyDevice(vulkanDevice, nullptr);
 
 	vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, nullptr);
@@ -1553,7 +1520,314 @@ void Engine::cleanupGraphics()
 	vkDestroyInstance(vulkanInstance, nullptr);
 }
 
-void Engine::createSwapChain()
+void Engine::extractRenderInstances(const std::array<glm::vec4, 6>& frustumPlanes)
+{
+	const std::span<const EntityID> renderables = scene.GetQueryEntities(renderableQuery);
+	assert(renderables.size() <= MAX_INSTANCES);
+
+	// Room for MAX_INSTANCES whatever the count, the GPU culling binds that much of the ring at instanceDataOffset
+	const FrameRingAllocation instanceAllocation = frameRing.Allocate(sizeof(InstanceData) * MAX_INSTANCES);
+	InstanceData* pInstances = static_cast<InstanceData*>(instanceAllocation.pMapped);
+	instanceDataOffset = instanceAllocation.offset;
+	renderInstanceCount = static_cast<uint32_t>(renderables.size());
+
+	const auto writeInstance = [this](InstanceData& instance, const EntityID id)
+	{
+		const Transform* transform = scene.GetReadComponent<Transform>(id);
+		const Sprite* sprite = scene.GetReadComponent<Sprite>(id);
+		instance.translationRotation = glm::vec4(transform->position, transform->rotation);
+		instance.scale = transform->scale;
+		instance.textureIdx = sprite->textureIdx;
+		instance.meshIdx = sprite->meshIdx;
+	};
+
+	if (gpuCullingSupported)
+	{
+		// The culling groups the instances by mesh, so they go in query order and each thread copies its own range
+		threadPool.ParallelFor(renderInstanceCount, INSTANCES_PER_EXTRACT_BATCH, [renderables, pInstances, &writeInstance](uint32_t begin, uint32_t end, uint32_t threadIdx)
+		{
+			for (uint32_t instanceIdx = begin; instanceIdx < end; instanceIdx++)
+			{
+				writeInstance(pInstances[instanceIdx], renderables[instanceIdx]);
+			}
+		});
+
+		if (gpuCullingValidationFrames > 0)
+		{
+			gpuCulling.CaptureValidationInputs(inFlightFrameIdx, std::as_bytes(std::span<const InstanceData>(pInstances, renderInstanceCount)), frustumPlanes);
+		}
+		return;
+	}
+
+	// Gathered into separate arrays per component so the culling tests several spheres per instruction
+	renderableBounds.Resize(static_cast<uint32_t>(renderables.size()));
+	threadPool.ParallelFor(static_cast<uint32_t>(renderables.size()), INSTANCES_PER_EXTRACT_BATCH, [this, renderables](uint32_t begin, uint32_t end, uint32_t threadIdx)
+	{
+		for (uint32_t renderableIdx = begin; renderableIdx < end; renderableIdx++)
+		{
+			const Transform* transform = scene.GetReadComponent<Transform>(renderables[renderableIdx]);
+			const Sprite* sprite = scene.GetReadComponent<Sprite>(renderables[renderableIdx]);
+			renderableBounds.centerX[renderableIdx] = transform->position.x;
+			renderableBounds.centerY[renderableIdx] = transform->position.y;
+			renderableBounds.centerZ[renderableIdx] = transform->position.z;
+			// Rotation is only about Z, so the sphere around the unscaled mesh just grows with the larger scale
+			renderableBounds.radius[renderableIdx] = meshBoundingRadii[sprite->meshIdx] * std::max(std::abs(transform->scale.x), std::abs(transform->scale.y));
+		}
+	});
+
+	const std::span<const uint32_t> visibleRenderables = frustumCuller.Cull(threadPool, renderableBounds, frustumPlanes, cpuCullingBatchSize);
+	renderInstanceCount = static_cast<uint32_t>(visibleRenderables.size());
+
+	// Counting sort by mesh so the instances of each mesh are contiguous and can be drawn with a single call
+	for (MeshBatch& batch : meshBatches)
+	{
+		batch.instanceCount = 0;
+	}
+
+	for (const uint32_t renderableIdx : visibleRenderables)
+	{
+		const uint32_t meshIdx = scene.GetReadComponent<Sprite>(renderables[renderableIdx])->meshIdx;
+		assert(meshIdx < meshBatches.size());
+		meshBatches[meshIdx].instanceCount++;
+	}
+
+	uint32_t firstInstance = 0;
+	for (MeshBatch& batch : meshBatches)
+	{
+		batch.firstInstance = firstInstance;
+		firstInstance += batch.instanceCount;
+		// Reused as the write cursor below and restored once every instance is placed
+		batch.instanceCount = 0;
+	}
+
+	for (const uint32_t renderableIdx : visibleRenderables)
+	{
+		const EntityID id = renderables[renderableIdx];
+		MeshBatch& batch = meshBatches[scene.GetReadComponent<Sprite>(id)->meshIdx];
+		writeInstance(pInstances[batch.firstInstance + batch.instanceCount++], id);
+	}
+}
+
+void Engine::recordSpritePass(VkCommandBuffer commandBuffer, VkImageView targetView)
+{
+	VkClearValue clearValue = { {{0.f, 0.f, 0.f, 1.f}} };
+
+	VkRenderingAttachmentInfo renderingAttachmentInfo{};
+	renderingAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	renderingAttachmentInfo.imageView = targetView;
+	renderingAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	renderingAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	renderingAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	renderingAttachmentInfo.clearValue = clearValue;
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.renderArea.offset = { 0, 0 };
+	renderingInfo.renderArea.extent = vulkanSwapchainSurfaceExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &renderingAttachmentInfo;
+
+	// Still compiling after a swapchain format change, the target is only cleared until it is ready
+	const VkPipeline pipeline = pipelineManager.GetPipeline(spritePipeline);
+
+	if (gpuCullingSupported)
+	{
+		// The GPU wrote the draws, a handful of indirect draw calls is nothing to split over threads
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			recordDrawState(commandBuffer, pipeline);
+			gpuCulling.RecordDraws(commandBuffer, inFlightFrameIdx);
+		}
+
+		vkCmdEndRendering(commandBuffer);
+		return;
+	}
+
+	const uint32_t numDraws = pipeline != VK_NULL_HANDLE ? static_cast<uint32_t>(drawCommands.size()) : 0;
+	const uint32_t numRecordingThreads = std::min(threadPool.GetThreadCount(), numDraws / MIN_DRAWS_PER_RECORDING_THREAD);
+
+	if (numRecordingThreads > 1)
+	{
+		// The render pass instance may then only contain vkCmdExecuteCommands
+		renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+		const uint32_t drawsPerBatch = (numDraws + numRecordingThreads - 1) / numRecordingThreads;
+		recordedSecondaryCommandBuffers.assign((numDraws + drawsPerBatch - 1) / drawsPerBatch, VK_NULL_HANDLE);
+
+		threadPool.ParallelFor(numDraws, drawsPerBatch, [this, drawsPerBatch, pipeline](uint32_t begin, uint32_t end, uint32_t threadIdx)
+		{
+			VkCommandBuffer secondaryCommandBuffer = getSecondaryCommandBuffer(threadIdx);
+
+			VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+			inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+			inheritanceRenderingInfo.colorAttachmentCount = 1;
+			inheritanceRenderingInfo.pColorAttachmentFormats = &vulkanSwapchainSurfaceFormat.format;
+			inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+			VkCommandBufferInheritanceInfo inheritanceInfo{};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.pNext = &inheritanceRenderingInfo;
+
+			VkCommandBufferBeginInfo secondaryBeginInfo{};
+			secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+			VkResult secondaryBeginResult = vkBeginCommandBuffer(secondaryCommandBuffer, &secondaryBeginInfo);
+			VK_CHECK(secondaryBeginResult, "Failed to begin recording secondary command buffer: {}");
+
+			recordDrawState(secondaryCommandBuffer, pipeline);
+			recordDraws(secondaryCommandBuffer, begin, end);
+
+			VkResult secondaryEndResult = vkEndCommandBuffer(secondaryCommandBuffer);
+			VK_CHECK(secondaryEndResult, "Failed to construct secondary command buffer: {}");
+
+			recordedSecondaryCommandBuffers[begin / drawsPerBatch] = secondaryCommandBuffer;
+		});
+
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(recordedSecondaryCommandBuffers.size()), recordedSecondaryCommandBuffers.data());
+	}
+	else
+	{
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+		if (numDraws > 0)
+		{
+			recordDrawState(commandBuffer, pipeline);
+			recordDraws(commandBuffer, 0, numDraws);
+		}
+	}
+
+	vkCmdEndRendering(commandBuffer);
+}
+
+void Engine::recordDrawState(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(vulkanSwapchainSurfaceExtent.width);
+	viewport.height = static_cast<float>(vulkanSwapchainSurfaceExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = vulkanSwapchainSurfaceExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// The culled instances where the GPU culls, else this frame's instances straight from the ring
+	VkBuffer vertexBuffers[] = { vulkanVertexBuffer, gpuCullingSupported ? gpuCulling.GetInstanceBuffer(inFlightFrameIdx) : frameRing.GetBuffer() };
+	VkDeviceSize offsets[] = { 0, gpuCullingSupported ? 0 : instanceDataOffset };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+
+	vkCmdBindIndexBuffer(commandBuffer, vulkanIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 1, &vulkanDescriptorSet, 1, &frameUniformsOffset);
+
+	// The same set for every frame and draw, instances pick their texture from it
+	if (bindlessSupported)
+	{
+		bindlessDescriptors.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 1);
+	}
+}
+
+void Engine::recordDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)
+{
+	for (uint32_t drawIdx = begin; drawIdx < end; drawIdx++)
+	{
+		const DrawCommand& draw = drawCommands[drawIdx];
+		const MeshRange& mesh = meshes[draw.meshIdx];
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, draw.instanceCount, mesh.firstIndex, mesh.vertexOffset, draw.firstInstance);
+	}
+}
+
+VkCommandBuffer Engine::getSecondaryCommandBuffer(uint32_t threadIdx)
+{
+	RecordingContext& recordingContext = recordingContexts[inFlightFrameIdx * threadPool.GetThreadCount() + threadIdx];
+
+	if (recordingContext.numUsedCommandBuffers == recordingContext.secondaryCommandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo commandBufferInfo{};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.commandPool = recordingContext.commandPool;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		commandBufferInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkResult result = vkAllocateCommandBuffers(vulkanDevice, &commandBufferInfo, &commandBuffer);
+		VK_CHECK(result, "Failed to create secondary command buffer: {}");
+
+		recordingContext.secondaryCommandBuffers.push_back(commandBuffer);
+	}
+
+	return recordingContext.secondaryCommandBuffers[recordingContext.numUsedCommandBuffers++];
+}
+
+void Engine::recreateSwapChain()
+{
+	// A minimized window has no extent to create a swapchain with, there is nothing to draw until it is restored
+	int width = 0, height = 0;
+	SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
+	while (width == 0 || height == 0) {
+		SDL_GetWindowSizeInPixels(sdlWindow, &width, &height);
+		SDL_Event event;
+		SDL_WaitEvent(&event);
+		processEvent(event);
+	}
+
+	// Frames already submitted still render to and present the old images, so they are kept until those frames retire.
+	// Presents are not covered by fences, waiting for the first frame on the new swapchain instead of the last one on
+	// the old gives the presentation engine a frame's worth of time to let go of them
+	RetiredSwapchain& retiredSwapchain = retiredSwapchains.emplace_back();
+	retiredSwapchain.swapchain = vulkanSwapchain;
+	retiredSwapchain.imageViews = std::move(vulkanSwapchainImageViews);
+	retiredSwapchain.frameNumber = frameNumber;
+
+	vulkanSwapchain = VK_NULL_HANDLE;
+	vulkanSwapchainImageViews.clear();
+	vulkanSwapchainImages.clear();
+
+	const VkFormat previousFormat = vulkanSwapchainSurfaceFormat.format;
+
+	createSwapChain(retiredSwapchain.swapchain);
+	createImageViews();
+
+	// Moving the window to a display with another format needs a sprite pipeline for the new format. Compiling it here
+	// would stall the resize, sprites are skipped for the few frames it takes in the background instead
+	if (vulkanSwapchainSurfaceFormat.format != previousFormat)
+	{
+		spritePipelineDesc.colorFormats = { vulkanSwapchainSurfaceFormat.format };
+		spritePipeline = pipelineManager.RequestGraphicsPipeline(spritePipelineDesc);
+	}
+}
+
+void Engine::destroyRetiredSwapchains(uint64_t completedFrameNumber)
+{
+	while (!retiredSwapchains.empty() && retiredSwapchains.front().frameNumber <= completedFrameNumber)
+	{
+		RetiredSwapchain& retiredSwapchain = retiredSwapchains.front();
+
+		for (VkImageView imageView : retiredSwapchain.imageViews)
+		{
+			vkDestroyImageView(vulkanDevice, imageView, nullptr);
+		}
+
+		vkDestroySwapchainKHR(vulkanDevice, retiredSwapchain.swapchain, nullptr);
+
+		retiredSwapchains.pop_front();
+	}
+}
+
+void Engine::createSwapChain(VkSwapchainKHR oldSwapchain)
 {
 	assert(vulkanPhysicalDevice != VK_NULL_HANDLE);
 	assert(vulkanSurface != VK_NULL_HANDLE);
@@ -1590,15 +1864,7 @@ void Engine::createSwapChain()
 
 	// TODO: Rank other formats if we can't find the one we want
 
-	VkPresentModeKHR selectedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-	for (const VkPresentModeKHR& presentMode : presentModes)
-	{
-		if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-		{
-			selectedPresentMode = presentMode;
-			break;
-		}
-	}
+	const VkPresentModeKHR selectedPresentMode = framePacer.ChoosePresentMode(presentModes);
 
 	VkExtent2D surfaceExtent{};
 
@@ -1622,7 +1888,7 @@ void Engine::createSwapChain()
 
 	// Simply sticking to this minimum means that we may sometimes have to wait on the driver to complete
 	// internal operations before we can acquire another image to render to.
-	uint32_t imageCount = surfaceCapabilities.minImageCount + 1;
+	uint32_t imageCount = framePacer.ChooseSwapchainImageCount(surfaceCapabilities.minImageCount);
 
 	if (surfaceCapabilities.maxImageCount > 0 && imageCount > surfaceCapabilities.maxImageCount)
 	{
@@ -1642,7 +1908,8 @@ void Engine::createSwapChain()
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.presentMode = selectedPresentMode;
 	swapChainCreateInfo.clipped = VK_TRUE;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Lets the driver hand resources over and keeps presents to the old swapchain valid until they are done
+	swapChainCreateInfo.oldSwapchain = oldSwapchain;
 
 	if (graphicsQueueFamilyIndex != presentQueueFamilyIndex)
 	{
@@ -1701,62 +1968,23 @@ void Engine::createImageViews()
 	}
 }
 
-void Engine::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void Engine::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& bufferAllocation)
 {
 	assert(buffer == VK_NULL_HANDLE);
-	assert(bufferMemory == VK_NULL_HANDLE);
+	assert(!bufferAllocation.IsValid());
 
 	assert(vulkanDevice != VK_NULL_HANDLE);
-	assert(vulkanPhysicalDevice != VK_NULL_HANDLE);
 
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
 
-	if (transferQueueFamilyIdx != graphicsQueueFamilyIndex)
-	{
-		uint32_t queueIndices[2] = { graphicsQueueFamilyIndex, transferQueueFamilyIdx };
-		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-		bufferInfo.pQueueFamilyIndices = queueIndices;
-	}
-	else
-	{
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	}
-
+	// Resources the transfer queue uploads to change owner with the upload instead of being shared
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	VkResult bufferResult = vkCreateBuffer(vulkanDevice, &bufferInfo, nullptr, &buffer);
 	VK_CHECK(bufferResult, "Failed to create buffer: {}");
 
-	VkMemoryRequirements memoryRequirements{};
-	vkGetBufferMemoryRequirements(vulkanDevice, buffer, &memoryRequirements);
-
-	VkPhysicalDeviceMemoryProperties memoryProperties{};
-	vkGetPhysicalDeviceMemoryProperties(vulkanPhysicalDevice, &memoryProperties);
-
-	std::optional<uint32_t> memoryTypeIndex;
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
-	{
-		if ((memoryRequirements.memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
-		{
-			memoryTypeIndex = i;
-		}
-	}
-
-	if (memoryTypeIndex.has_value() == false)
-	{
-		throw std::runtime_error("Failed to find valid memory type");
-	}
-
-	VkMemoryAllocateInfo allocateInfo{};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = memoryTypeIndex.value();
-
-	VkResult allocateResult = vkAllocateMemory(vulkanDevice, &allocateInfo, nullptr, &bufferMemory);
-	VK_CHECK(allocateResult, "Failed to allocate buffer memory: {}");
-
-	VkResult bindResult = vkBindBufferMemory(vulkanDevice, buffer, bufferMemory, 0);
-	VK_CHECK(bindResult, "Failed to bind buffer memory: {}");
+	bufferAllocation = gpuAllocator.AllocateForBuffer(buffer, properties);
 }
@@ -0,0 +1,257 @@
+#include "FramePacing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <vector>
+
+namespace
+{
+	struct FramePacingConfig
+	{
+		const char* name;
+		uint32_t framesInFlight;
+		bool bWaitBeforeSampling;
+		// In order of preference, FIFO is always supported and ends every list
+		std::array<VkPresentModeKHR, 3> presentModes;
+		// Swapchain images beyond the frames in flight, so acquire does not become the thing the CPU waits on
+		uint32_t extraSwapchainImages;
+	};
+
+	constexpr std::array<FramePacingConfig, static_cast<size_t>(EFramePacingMode::Count)> FRAME_PACING_CONFIGS =
+	{{
+		{"Throughput", 3, false, {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR}, 1},
+		// Mailbox replaces a queued image instead of waiting behind it, so a finished frame never ages in the queue
+		{"LowLatency", 1, true, {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR}, 1},
+		{"VsyncOff", 2, false, {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR}, 1},
+	}};
+
+	const FramePacingConfig& GetConfig(const EFramePacingMode mode)
+	{
+		assert(mode < EFramePacingMode::Count);
+		return FRAME_PACING_CONFIGS[static_cast<size_t>(mode)];
+	}
+
+	float ToMilliseconds(const FramePacer::Clock::duration duration)
+	{
+		return std::chrono::duration<float, std::milli>(duration).count();
+	}
+
+	// A wait shorter than this means the fence was already signalled rather than signalled while we waited
+	constexpr std::chrono::microseconds BLOCKED_WAIT_THRESHOLD(100);
+}
+
+const char* GetFramePacingModeName(const EFramePacingMode mode)
+{
+	return GetConfig(mode).name;
+}
+
+bool ParseFramePacingMode(const std::string_view name, EFramePacingMode& outMode)
+{
+	for (uint32_t modeIdx = 0; modeIdx < static_cast<uint32_t>(EFramePacingMode::Count); modeIdx++)
+	{
+		const std::string_view modeName = FRAME_PACING_CONFIGS[modeIdx].name;
+		const bool bMatches = std::equal(name.begin(), name.end(), modeName.begin(), modeName.end(), [](char a, char b)
+		{
+			return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+		});
+
+		if (bMatches)
+		{
+			outMode = static_cast<EFramePacingMode>(modeIdx);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FramePacer::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, const uint32_t queueFamilyIdx, const EFramePacingMode mode)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mMode = mode;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	assert(queueFamilyIdx < queueFamilyCount);
+	const uint32_t timestampValidBits = queueFamilies[queueFamilyIdx].timestampValidBits;
+	if (timestampValidBits == 0)
+	{
+		// GPU time is reported as 0 and latency estimated from CPU times alone
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	mTimestampPeriod = properties.limits.timestampPeriod;
+	mTimestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+	VkResult result = vkCreateQueryPool(mDevice, &queryPoolInfo, nullptr, &mTimestampQueryPool);
+	VK_CHECK(result, "Failed to create timestamp query pool: {}");
+}
+
+void FramePacer::Shutdown()
+{
+	if (mTimestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(mDevice, mTimestampQueryPool, nullptr);
+		mTimestampQueryPool = VK_NULL_HANDLE;
+	}
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+void FramePacer::SetMode(const EFramePacingMode mode)
+{
+	mMode = mode;
+}
+
+uint32_t FramePacer::GetFramesInFlight() const
+{
+	return GetConfig(mMode).framesInFlight;
+}
+
+bool FramePacer::ShouldWaitBeforeSampling() const
+{
+	return GetConfig(mMode).bWaitBeforeSampling;
+}
+
+VkPresentModeKHR FramePacer::ChoosePresentMode(const std::span<const VkPresentModeKHR> availablePresentModes) const
+{
+	for (const VkPresentModeKHR presentMode : GetConfig(mMode).presentModes)
+	{
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end())
+		{
+			return presentMode;
+		}
+	}
+
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t FramePacer::ChooseSwapchainImageCount(const uint32_t surfaceMinImageCount) const
+{
+	const FramePacingConfig& config = GetConfig(mMode);
+	return std::max(surfaceMinImageCount + 1, config.framesInFlight + config.extraSwapchainImages);
+}
+
+void FramePacer::OnFrameSlotReady(const uint32_t frameSlot, const Clock::time_point waitStart, const Clock::time_point waitEnd)
+{
+	assert(frameSlot < MAX_FRAMES_IN_FLIGHT);
+
+	FrameSlot& slot = mFrameSlots[frameSlot];
+
+	// The frame that used the slot last is done, everything about it is known now
+	if (slot.bSubmitted)
+	{
+		FrameTimings timings;
+		timings.cpuWaitMs = slot.cpuWaitMs;
+		timings.cpuFrameMs = slot.cpuFrameMs;
+
+		if (slot.bTimestampsWritten)
+		{
+			uint64_t timestamps[2] = {0, 0};
+			VkResult result = vkGetQueryPoolResults(mDevice, mTimestampQueryPool, frameSlot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_SUCCESS)
+			{
+				const uint64_t ticks = ((timestamps[1] & mTimestampMask) - (timestamps[0] & mTimestampMask)) & mTimestampMask;
+				timings.gpuMs = static_cast<float>(ticks) * mTimestampPeriod / 1e6f;
+			}
+			else if (result != VK_NOT_READY)
+			{
+				VK_CHECK(result, "Failed to read frame timestamps: {}");
+			}
+		}
+
+		if (waitEnd - waitStart >= BLOCKED_WAIT_THRESHOLD)
+		{
+			// The fence signalled while we were waiting on it, so the GPU finished about now
+			timings.inputToPresentMs = ToMilliseconds(waitEnd - slot.inputSampleTime);
+		}
+		else
+		{
+			// Finished some time ago, assume the GPU picked the frame up as soon as it was submitted
+			timings.inputToPresentMs = ToMilliseconds(slot.submitTime - slot.inputSampleTime) + timings.gpuMs;
+		}
+
+		mLatestTimings = timings;
+
+		mAccumulatedTimings.cpuWaitMs += timings.cpuWaitMs;
+		mAccumulatedTimings.cpuFrameMs += timings.cpuFrameMs;
+		mAccumulatedTimings.gpuMs += timings.gpuMs;
+		mAccumulatedTimings.inputToPresentMs += timings.inputToPresentMs;
+		mAccumulatedFrameCount++;
+	}
+
+	slot.bSubmitted = false;
+	slot.bTimestampsWritten = false;
+	slot.cpuWaitMs = ToMilliseconds(waitEnd - waitStart);
+	slot.cpuFrameMs = mHasPreviousFrameStart ? ToMilliseconds(waitStart - mPreviousFrameStart) : 0.f;
+
+	mPreviousFrameStart = waitStart;
+	mHasPreviousFrameStart = true;
+}
+
+void FramePacer::OnInputSampled()
+{
+	mPendingInputSampleTime = Clock::now();
+}
+
+void FramePacer::WriteBeginTimestamp(const VkCommandBuffer commandBuffer, const uint32_t frameSlot)
+{
+	if (mTimestampQueryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, mTimestampQueryPool, frameSlot * 2, 2);
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, mTimestampQueryPool, frameSlot * 2);
+}
+
+void FramePacer::WriteEndTimestamp(const VkCommandBuffer commandBuffer, const uint32_t frameSlot)
+{
+	if (mTimestampQueryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, mTimestampQueryPool, frameSlot * 2 + 1);
+	mFrameSlots[frameSlot].bTimestampsWritten = true;
+}
+
+void FramePacer::OnSubmitted(const uint32_t frameSlot)
+{
+	FrameSlot& slot = mFrameSlots[frameSlot];
+	slot.inputSampleTime = mPendingInputSampleTime;
+	slot.submitTime = Clock::now();
+	slot.bSubmitted = true;
+}
+
+bool FramePacer::ConsumeAverageTimings(FrameTimings& outTimings, uint32_t& outFrameCount)
+{
+	outFrameCount = mAccumulatedFrameCount;
+	if (mAccumulatedFrameCount == 0)
+	{
+		return false;
+	}
+
+	const float scale = 1.f / static_cast<float>(mAccumulatedFrameCount);
+	outTimings.cpuWaitMs = mAccumulatedTimings.cpuWaitMs * scale;
+	outTimings.cpuFrameMs = mAccumulatedTimings.cpuFrameMs * scale;
+	outTimings.gpuMs = mAccumulatedTimings.gpuMs * scale;
+	outTimings.inputToPresentMs = mAccumulatedTimings.inputToPresentMs * scale;
+
+	mAccumulatedTimings = {};
+	mAccumulatedFrameCount = 0;
+	return true;
+}
@@ -0,0 +1,97 @@
+#include "FrameRing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+	VkDeviceSize AlignUp(const VkDeviceSize value, const VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+void FrameRing::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, DeviceMemoryAllocator& allocator, const VkDeviceSize bytesPerFrame, const uint32_t numFrames, const VkBufferUsageFlags usage)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+	assert(numFrames > 0);
+
+	mDevice = device;
+	mAllocator = &allocator;
+	mNumFrames = numFrames;
+
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	// Both limits are powers of two, 16 keeps vec4 instance attributes and std140 blocks aligned on any device
+	mAlignment = std::max<VkDeviceSize>({ deviceProperties.limits.minUniformBufferOffsetAlignment, deviceProperties.limits.minStorageBufferOffsetAlignment, 16 });
+	mBytesPerFrame = AlignUp(bytesPerFrame, mAlignment);
+
+	const VkDeviceSize capacity = mBytesPerFrame * numFrames;
+	if (capacity > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::runtime_error("Frame ring does not fit 32 bit dynamic offsets");
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = capacity;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult bufferResult = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &mBuffer);
+	VK_CHECK(bufferResult, "Failed to create frame ring buffer: {}");
+
+	// Written once by the CPU and read once by the GPU, so host visible memory beats a staging copy
+	mAllocation = mAllocator->AllocateForBuffer(mBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	assert(mAllocation.pMapped != nullptr);
+
+	BeginFrame(0);
+}
+
+void FrameRing::Shutdown()
+{
+	if (mDevice == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyBuffer(mDevice, mBuffer, nullptr);
+	mAllocator->Free(mAllocation);
+
+	mBuffer = VK_NULL_HANDLE;
+	mDevice = VK_NULL_HANDLE;
+}
+
+void FrameRing::BeginFrame(const uint32_t frameSlot)
+{
+	assert(frameSlot < mNumFrames);
+
+	mFrameBegin = mBytesPerFrame * frameSlot;
+	mFrameCursor.store(0, std::memory_order_relaxed);
+}
+
+FrameRingAllocation FrameRing::Allocate(const VkDeviceSize size)
+{
+	// Never empty, so the offset of even a zero sized allocation lies inside the buffer
+	const VkDeviceSize alignedSize = AlignUp(std::max<VkDeviceSize>(size, 1), mAlignment);
+
+	const VkDeviceSize frameOffset = mFrameCursor.fetch_add(alignedSize, std::memory_order_relaxed);
+	if (frameOffset + alignedSize > mBytesPerFrame)
+	{
+		throw std::runtime_error("Frame ring is out of space for this frame");
+	}
+
+	const VkDeviceSize offset = mFrameBegin + frameOffset;
+
+	FrameRingAllocation allocation;
+	allocation.pMapped = static_cast<uint8_t*>(mAllocation.pMapped) + offset;
+	allocation.offset = static_cast<uint32_t>(offset);
+	return allocation;
+}
+
+VkDeviceSize FrameRing::GetFrameUsage() const
+{
+	return std::min(mFrameCursor.load(std::memory_order_relaxed), mBytesPerFrame);
+}
@@ -0,0 +1,519 @@
+#include "GpuAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	VkDeviceSize AlignUp(const VkDeviceSize value, const VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool IsOutOfMemory(const VkResult result)
+	{
+		return result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+}
+
+void DeviceMemoryAllocator::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, const VkDeviceSize preferredBlockSize)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mPreferredBlockSize = preferredBlockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mMemoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	mNonCoherentAtomSize = std::max<VkDeviceSize>(deviceProperties.limits.nonCoherentAtomSize, 1);
+}
+
+void DeviceMemoryAllocator::Shutdown()
+{
+	std::lock_guard lock(mMutex);
+
+	assert(mDedicatedAllocationCount == 0);
+
+	for (uint32_t blockIdx = 0; blockIdx < mBlocks.size(); ++blockIdx)
+	{
+		if (mBlocks[blockIdx].memory != VK_NULL_HANDLE)
+		{
+			assert(mBlocks[blockIdx].allocationCount == 0);
+			ReleaseBlock(blockIdx);
+		}
+	}
+	mBlocks.clear();
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+GpuAllocation DeviceMemoryAllocator::AllocateForBuffer(const VkBuffer buffer, const VkMemoryPropertyFlags properties)
+{
+	VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+
+	vkGetBufferMemoryRequirements2(mDevice, &requirementsInfo, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = buffer;
+
+	const bool bDedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+	GpuAllocation allocation;
+	{
+		std::lock_guard lock(mMutex);
+		allocation = AllocateLocked(requirements.memoryRequirements, properties, EGpuResourceKind::Linear, bDedicated, &dedicatedInfo);
+	}
+
+	VkResult bindResult = vkBindBufferMemory(mDevice, buffer, allocation.memory, allocation.offset);
+	VK_CHECK(bindResult, "Failed to bind buffer memory: {}");
+
+	return allocation;
+}
+
+GpuAllocation DeviceMemoryAllocator::AllocateForImage(const VkImage image, const VkImageTiling tiling, const VkMemoryPropertyFlags properties)
+{
+	VkImageMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+
+	vkGetImageMemoryRequirements2(mDevice, &requirementsInfo, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.image = image;
+
+	const bool bDedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	const EGpuResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? EGpuResourceKind::Optimal : EGpuResourceKind::Linear;
+
+	GpuAllocation allocation;
+	{
+		std::lock_guard lock(mMutex);
+		allocation = AllocateLocked(requirements.memoryRequirements, properties, kind, bDedicated, &dedicatedInfo);
+	}
+
+	VkResult bindResult = vkBindImageMemory(mDevice, image, allocation.memory, allocation.offset);
+	VK_CHECK(bindResult, "Failed to bind image memory: {}");
+
+	return allocation;
+}
+
+GpuAllocation DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, const VkMemoryPropertyFlags properties, const EGpuResourceKind kind, const bool bDedicated)
+{
+	std::lock_guard lock(mMutex);
+	return AllocateLocked(requirements, properties, kind, bDedicated, nullptr);
+}
+
+GpuAllocation DeviceMemoryAllocator::AllocateLocked(const VkMemoryRequirements& requirements, const VkMemoryPropertyFlags properties, const EGpuResourceKind kind, const bool bDedicated, const VkMemoryDedicatedAllocateInfo* pDedicatedInfo)
+{
+	assert(mDevice != VK_NULL_HANDLE);
+
+	uint32_t typeBits = requirements.memoryTypeBits;
+	for (uint32_t memoryTypeIdx = FindMemoryType(typeBits, properties); memoryTypeIdx != UINT32_MAX; memoryTypeIdx = FindMemoryType(typeBits, properties))
+	{
+		GpuAllocation allocation;
+
+		// Anything bigger than half a block would waste most of a fresh block, so it is not worth sharing
+		if (bDedicated || requirements.size > GetBlockSize(memoryTypeIdx) / 2)
+		{
+			if (AllocateDedicated(memoryTypeIdx, requirements.size, pDedicatedInfo, allocation))
+			{
+				allocation.alignment = requirements.alignment;
+				return allocation;
+			}
+		}
+		else
+		{
+			const VkDeviceSize alignment = std::max(requirements.alignment, GetMinAlignment(memoryTypeIdx));
+
+			for (uint32_t blockIdx = 0; blockIdx < mBlocks.size(); ++blockIdx)
+			{
+				const MemoryBlock& block = mBlocks[blockIdx];
+				if (block.memory != VK_NULL_HANDLE && block.memoryTypeIdx == memoryTypeIdx && block.kind == kind && SubAllocate(blockIdx, requirements.size, alignment, allocation))
+				{
+					return allocation;
+				}
+			}
+
+			const uint32_t blockIdx = CreateBlock(memoryTypeIdx, kind);
+			if (blockIdx != UINT32_MAX && SubAllocate(blockIdx, requirements.size, alignment, allocation))
+			{
+				return allocation;
+			}
+		}
+
+		// This heap is exhausted, try the next memory type that satisfies the request
+		typeBits &= ~(1u << memoryTypeIdx);
+	}
+
+	throw std::runtime_error("Failed to find valid memory type");
+}
+
+bool DeviceMemoryAllocator::SubAllocate(const uint32_t blockIdx, const VkDeviceSize size, const VkDeviceSize alignment, GpuAllocation& outAllocation)
+{
+	MemoryBlock& block = mBlocks[blockIdx];
+
+	size_t bestRangeIdx = block.freeRanges.size();
+	VkDeviceSize bestRangeSize = 0;
+	for (size_t rangeIdx = 0; rangeIdx < block.freeRanges.size(); ++rangeIdx)
+	{
+		const FreeRange& range = block.freeRanges[rangeIdx];
+		const VkDeviceSize alignedOffset = AlignUp(range.offset, alignment);
+		if (alignedOffset + size <= range.offset + range.size && (bestRangeIdx == block.freeRanges.size() || range.size < bestRangeSize))
+		{
+			bestRangeIdx = rangeIdx;
+			bestRangeSize = range.size;
+		}
+	}
+
+	if (bestRangeIdx == block.freeRanges.size())
+	{
+		return false;
+	}
+
+	const FreeRange range = block.freeRanges[bestRangeIdx];
+	const VkDeviceSize alignedOffset = AlignUp(range.offset, alignment);
+
+	// Whatever is left in front of and behind the allocation stays free
+	const FreeRange front{range.offset, alignedOffset - range.offset};
+	const FreeRange back{alignedOffset + size, range.offset + range.size - alignedOffset - size};
+
+	auto it = block.freeRanges.erase(block.freeRanges.begin() + static_cast<std::ptrdiff_t>(bestRangeIdx));
+	if (back.size > 0)
+	{
+		it = block.freeRanges.insert(it, back);
+	}
+	if (front.size > 0)
+	{
+		block.freeRanges.insert(it, front);
+	}
+
+	block.usedBytes += size;
+	block.allocationCount++;
+
+	outAllocation.memory = block.memory;
+	outAllocation.offset = alignedOffset;
+	outAllocation.size = size;
+	outAllocation.alignment = alignment;
+	outAllocation.pMapped = block.pMapped != nullptr ? block.pMapped + alignedOffset : nullptr;
+	outAllocation.memoryTypeIdx = block.memoryTypeIdx;
+	outAllocation.kind = block.kind;
+	outAllocation.blockIdx = blockIdx;
+
+	return true;
+}
+
+bool DeviceMemoryAllocator::AllocateDedicated(const uint32_t memoryTypeIdx, const VkDeviceSize size, const VkMemoryDedicatedAllocateInfo* pDedicatedInfo, GpuAllocation& outAllocation)
+{
+	VkMemoryAllocateInfo allocateInfo{};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryTypeIdx;
+	allocateInfo.pNext = pDedicatedInfo;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult allocateResult = vkAllocateMemory(mDevice, &allocateInfo, nullptr, &memory);
+	if (IsOutOfMemory(allocateResult))
+	{
+		return false;
+	}
+	VK_CHECK(allocateResult, "Failed to allocate dedicated memory: {}");
+
+	void* pMapped = nullptr;
+	if (mMemoryProperties.memoryTypes[memoryTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		VkResult mapResult = vkMapMemory(mDevice, memory, 0, VK_WHOLE_SIZE, 0, &pMapped);
+		VK_CHECK(mapResult, "Failed to map dedicated memory: {}");
+	}
+
+	mDedicatedAllocationCount++;
+	mDedicatedBytes += size;
+
+	outAllocation.memory = memory;
+	outAllocation.offset = 0;
+	outAllocation.size = size;
+	outAllocation.pMapped = pMapped;
+	outAllocation.memoryTypeIdx = memoryTypeIdx;
+	outAllocation.blockIdx = DEDICATED_BLOCK;
+
+	return true;
+}
+
+uint32_t DeviceMemoryAllocator::CreateBlock(const uint32_t memoryTypeIdx, const EGpuResourceKind kind)
+{
+	const VkDeviceSize blockSize = GetBlockSize(memoryTypeIdx);
+
+	VkMemoryAllocateInfo allocateInfo{};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = blockSize;
+	allocateInfo.memoryTypeIndex = memoryTypeIdx;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult allocateResult = vkAllocateMemory(mDevice, &allocateInfo, nullptr, &memory);
+	if (IsOutOfMemory(allocateResult))
+	{
+		return UINT32_MAX;
+	}
+	VK_CHECK(allocateResult, "Failed to allocate memory block: {}");
+
+	void* pMapped = nullptr;
+	if (mMemoryProperties.memoryTypes[memoryTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		VkResult mapResult = vkMapMemory(mDevice, memory, 0, VK_WHOLE_SIZE, 0, &pMapped);
+		VK_CHECK(mapResult, "Failed to map memory block: {}");
+	}
+
+	// Reuse the slot of a released block before growing
+	uint32_t blockIdx = 0;
+	while (blockIdx < mBlocks.size() && mBlocks[blockIdx].memory != VK_NULL_HANDLE)
+	{
+		++blockIdx;
+	}
+	if (blockIdx == mBlocks.size())
+	{
+		mBlocks.emplace_back();
+	}
+
+	MemoryBlock& block = mBlocks[blockIdx];
+	block.memory = memory;
+	block.size = blockSize;
+	block.usedBytes = 0;
+	block.allocationCount = 0;
+	block.memoryTypeIdx = memoryTypeIdx;
+	block.kind = kind;
+	block.pMapped = static_cast<uint8_t*>(pMapped);
+	block.freeRanges.assign(1, FreeRange{0, blockSize});
+
+	return blockIdx;
+}
+
+void DeviceMemoryAllocator::Free(GpuAllocation& allocation)
+{
+	std::lock_guard lock(mMutex);
+	FreeLocked(allocation);
+}
+
+void DeviceMemoryAllocator::FreeLocked(GpuAllocation& allocation)
+{
+	if (!allocation.IsValid())
+	{
+		return;
+	}
+
+	if (allocation.blockIdx == DEDICATED_BLOCK)
+	{
+		// Freeing implicitly unmaps
+		vkFreeMemory(mDevice, allocation.memory, nullptr);
+
+		mDedicatedAllocationCount--;
+		mDedicatedBytes -= allocation.size;
+
+		allocation = GpuAllocation{};
+		return;
+	}
+
+	MemoryBlock& block = mBlocks[allocation.blockIdx];
+	assert(block.memory == allocation.memory);
+
+	const FreeRange freed{allocation.offset, allocation.size};
+	auto it = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), freed, [](const FreeRange& lhs, const FreeRange& rhs)
+	{
+		return lhs.offset < rhs.offset;
+	});
+	it = block.freeRanges.insert(it, freed);
+
+	// Coalesce with the neighbours so the free list only ever holds maximal ranges
+	if (std::next(it) != block.freeRanges.end() && it->offset + it->size == std::next(it)->offset)
+	{
+		it->size += std::next(it)->size;
+		block.freeRanges.erase(std::next(it));
+	}
+	if (it != block.freeRanges.begin() && std::prev(it)->offset + std::prev(it)->size == it->offset)
+	{
+		std::prev(it)->size += it->size;
+		block.freeRanges.erase(it);
+	}
+
+	block.usedBytes -= allocation.size;
+	block.allocationCount--;
+
+	if (block.allocationCount == 0)
+	{
+		// Keep one empty block per memory type and kind around so a free/allocate pattern does not thrash vkAllocateMemory
+		const bool bHasSibling = std::any_of(mBlocks.begin(), mBlocks.end(), [&block](const MemoryBlock& other)
+		{
+			return &other != &block && other.memory != VK_NULL_HANDLE && other.memoryTypeIdx == block.memoryTypeIdx && other.kind == block.kind;
+		});
+
+		if (bHasSibling)
+		{
+			ReleaseBlock(allocation.blockIdx);
+		}
+	}
+
+	allocation = GpuAllocation{};
+}
+
+void DeviceMemoryAllocator::ReleaseBlock(const uint32_t blockIdx)
+{
+	MemoryBlock& block = mBlocks[blockIdx];
+	assert(block.allocationCount == 0);
+
+	vkFreeMemory(mDevice, block.memory, nullptr);
+	block = MemoryBlock{};
+}
+
+uint32_t DeviceMemoryAllocator::Defragment(const std::span<GpuAllocation*> allocations, const DefragmentMoveFn& moveFn)
+{
+	std::lock_guard lock(mMutex);
+
+	// Drain the emptiest blocks first, they are the ones that can be released afterwards
+	std::vector<GpuAllocation*> candidates;
+	candidates.reserve(allocations.size());
+	for (GpuAllocation* allocation : allocations)
+	{
+		if (allocation->IsValid() && allocation->blockIdx != DEDICATED_BLOCK)
+		{
+			candidates.push_back(allocation);
+		}
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(), [this](const GpuAllocation* lhs, const GpuAllocation* rhs)
+	{
+		return mBlocks[lhs->blockIdx].usedBytes < mBlocks[rhs->blockIdx].usedBytes;
+	});
+
+	uint32_t numMoved = 0;
+	for (GpuAllocation* allocation : candidates)
+	{
+		const uint32_t sourceBlockIdx = allocation->blockIdx;
+
+		GpuAllocation newAllocation;
+		bool bFoundSpace = false;
+		for (uint32_t blockIdx = 0; blockIdx < mBlocks.size() && !bFoundSpace; ++blockIdx)
+		{
+			const MemoryBlock& block = mBlocks[blockIdx];
+			if (blockIdx == sourceBlockIdx || block.memory == VK_NULL_HANDLE || block.memoryTypeIdx != allocation->memoryTypeIdx || block.kind != allocation->kind)
+			{
+				continue;
+			}
+
+			// Only ever move towards fuller blocks, otherwise two half empty blocks would trade allocations forever
+			if (block.usedBytes < mBlocks[sourceBlockIdx].usedBytes)
+			{
+				continue;
+			}
+
+			bFoundSpace = SubAllocate(blockIdx, allocation->size, allocation->alignment, newAllocation);
+		}
+
+		if (!bFoundSpace)
+		{
+			continue;
+		}
+
+		if (moveFn(*allocation, newAllocation))
+		{
+			FreeLocked(*allocation);
+			*allocation = newAllocation;
+			numMoved++;
+		}
+		else
+		{
+			FreeLocked(newAllocation);
+		}
+	}
+
+	// Anything left empty is dead weight after a defragmentation pass, even the last block of its kind
+	for (uint32_t blockIdx = 0; blockIdx < mBlocks.size(); ++blockIdx)
+	{
+		if (mBlocks[blockIdx].memory != VK_NULL_HANDLE && mBlocks[blockIdx].allocationCount == 0)
+		{
+			ReleaseBlock(blockIdx);
+		}
+	}
+
+	return numMoved;
+}
+
+DeviceMemoryAllocator::Statistics DeviceMemoryAllocator::GetStatistics() const
+{
+	std::lock_guard lock(mMutex);
+
+	Statistics statistics;
+	statistics.dedicatedAllocationCount = mDedicatedAllocationCount;
+	statistics.allocationCount = mDedicatedAllocationCount;
+	statistics.reservedBytes = mDedicatedBytes;
+	statistics.usedBytes = mDedicatedBytes;
+
+	for (const MemoryBlock& block : mBlocks)
+	{
+		if (block.memory == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+
+		statistics.blockCount++;
+		statistics.allocationCount += block.allocationCount;
+		statistics.reservedBytes += block.size;
+		statistics.usedBytes += block.usedBytes;
+
+		for (const FreeRange& range : block.freeRanges)
+		{
+			statistics.largestFreeRange = std::max(statistics.largestFreeRange, range.size);
+		}
+	}
+
+	return statistics;
+}
+
+uint32_t DeviceMemoryAllocator::FindMemoryType(const uint32_t typeBits, const VkMemoryPropertyFlags properties) const
+{
+	// Memory types are ordered by preference within a heap, so the first match is the best one
+	for (uint32_t i = 0; i < mMemoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeBits & (1u << i)) && (mMemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+VkDeviceSize DeviceMemoryAllocator::GetBlockSize(const uint32_t memoryTypeIdx) const
+{
+	// Small heaps such as the 256MB host visible BAR window must not be swallowed by a handful of blocks
+	const VkDeviceSize heapSize = mMemoryProperties.memoryHeaps[mMemoryProperties.memoryTypes[memoryTypeIdx].heapIndex].size;
+	return std::min(mPreferredBlockSize, heapSize / 8);
+}
+
+VkDeviceSize DeviceMemoryAllocator::GetMinAlignment(const uint32_t memoryTypeIdx) const
+{
+	// Non coherent memory is flushed in nonCoherentAtomSize units, so neighbouring allocations must not share one
+	const VkMemoryPropertyFlags flags = mMemoryProperties.memoryTypes[memoryTypeIdx].propertyFlags;
+	if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		return mNonCoherentAtomSize;
+	}
+
+	return 1;
+}
@@ -0,0 +1,537 @@
+#include "GpuCulling.h"
+#include "EmbeddedShaders.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	// Instance in cull.comp, as the validation reads it back
+	struct CullInstance
+	{
+		glm::vec4 translationRotation;
+		glm::vec2 scale;
+		uint32_t textureIdx;
+		uint32_t meshIdx;
+	};
+	static_assert(sizeof(CullInstance) == GpuCulling::INSTANCE_STRIDE, "CullInstance no longer matches Instance in cull.comp");
+
+	// Spheres the validation's reference culling hands a thread at a time
+	constexpr uint32_t VALIDATION_CULL_BATCH_SIZE = 32768;
+
+	/**
+	 * @return Whether the GPU and the CPU could round the sphere to different sides of a plane
+	 */
+	bool IsOnFrustumBoundary(const glm::vec3& center, const float radius, const std::array<glm::vec4, 6>& planes)
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w + radius;
+			const float tolerance = 1e-5f * (1.f + std::abs(plane.w) + std::abs(center.x) + std::abs(center.y) + std::abs(center.z) + radius);
+			if (std::abs(distance) <= tolerance)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+bool GpuCulling::IsSupported(const VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndex)
+{
+	VkPhysicalDeviceFeatures features{};
+	vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// The culled instances of every mesh but the first start past instance 0
+	return features.drawIndirectFirstInstance == VK_TRUE &&
+		queueFamilyIndex < queueFamilyCount &&
+		(queueFamilies[queueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+}
+
+void GpuCulling::EnableFeatures(const VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures& features, VkPhysicalDeviceVulkan12Features& vulkan12Features)
+{
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+	features.drawIndirectFirstInstance = VK_TRUE;
+	features.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+	vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+}
+
+void GpuCulling::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, DeviceMemoryAllocator& allocator, PipelineManager& pipelineManager, StagingRing& stagingRing,
+	const VkBuffer frameRingBuffer, const VkDeviceSize frameUniformsSize, const uint32_t maxInstances, const uint32_t numFrames, const std::span<const GpuCullMesh> meshes)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+	assert(!meshes.empty());
+	assert(numFrames > 0);
+
+	mDevice = device;
+	mAllocator = &allocator;
+	mMaxInstances = maxInstances;
+	mMeshCount = static_cast<uint32_t>(meshes.size());
+	mMeshes.assign(meshes.begin(), meshes.end());
+	mFrameSlots.resize(numFrames);
+
+	// EnableFeatures turned on whatever the device has
+	{
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+		mHasDrawIndirectCount = vulkan12Features.drawIndirectCount == VK_TRUE;
+		mHasMultiDrawIndirect = features.features.multiDrawIndirect == VK_TRUE;
+	}
+
+	/// BUFFERS
+	const uint32_t maxGroups = (maxInstances + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+	mCounterBufferSize = sizeof(uint32_t) * (mMeshCount + static_cast<VkDeviceSize>(maxGroups) * mMeshCount);
+	mDrawBufferSize = DRAW_COMMANDS_OFFSET + sizeof(VkDrawIndexedIndirectCommand) * mMeshCount;
+	const VkDeviceSize instanceBufferSize = static_cast<VkDeviceSize>(INSTANCE_STRIDE) * maxInstances;
+
+	CreateBuffer(meshes.size_bytes(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mMeshBuffer, mMeshAllocation);
+	for (FrameSlot& slot : mFrameSlots)
+	{
+		// The draw and culled instance buffers can be copied out for validation
+		CreateBuffer(mCounterBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.counterBuffer, slot.counterAllocation);
+		CreateBuffer(mDrawBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.drawBuffer, slot.drawAllocation);
+		CreateBuffer(instanceBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.instanceBuffer, slot.instanceAllocation);
+	}
+
+	stagingRing.EnqueueBufferCopy(mMeshBuffer, 0, meshes.data(), meshes.size_bytes());
+
+	/// DESCRIPTOR SET
+	{
+		std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+		const std::array<VkDescriptorType, 6> bindingTypes =
+		{
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, // Frame uniforms
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, // Source instances
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Meshes
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Counters
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Draws
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER // Culled instances
+		};
+		for (uint32_t bindingIdx = 0; bindingIdx < bindings.size(); bindingIdx++)
+		{
+			bindings[bindingIdx].binding = bindingIdx;
+			bindings[bindingIdx].descriptorType = bindingTypes[bindingIdx];
+			bindings[bindingIdx].descriptorCount = 1;
+			bindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		VkResult layoutResult = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mSetLayout);
+		VK_CHECK(layoutResult, "Failed to create culling descriptor set layout: {}");
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &mSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		VkResult pipelineLayoutResult = vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout);
+		VK_CHECK(pipelineLayoutResult, "Failed to create culling pipeline layout: {}");
+
+		const uint32_t numSets = static_cast<uint32_t>(mFrameSlots.size());
+		const std::array<VkDescriptorPoolSize, 3> poolSizes =
+		{{
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, numSets},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, numSets},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * numSets}
+		}};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = numSets;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		VkResult poolResult = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool);
+		VK_CHECK(poolResult, "Failed to create culling descriptor pool: {}");
+
+		for (FrameSlot& slot : mFrameSlots)
+		{
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = mDescriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &mSetLayout;
+
+			VkResult setResult = vkAllocateDescriptorSets(mDevice, &allocInfo, &slot.descriptorSet);
+			VK_CHECK(setResult, "Failed to allocate culling descriptor set: {}");
+
+			// Both ring bindings start at 0, the dynamic offsets given at bind time move them to this frame's data
+			const std::array<VkDescriptorBufferInfo, 6> bufferInfos =
+			{{
+				{frameRingBuffer, 0, frameUniformsSize},
+				{frameRingBuffer, 0, instanceBufferSize},
+				{mMeshBuffer, 0, VK_WHOLE_SIZE},
+				{slot.counterBuffer, 0, VK_WHOLE_SIZE},
+				{slot.drawBuffer, 0, VK_WHOLE_SIZE},
+				{slot.instanceBuffer, 0, VK_WHOLE_SIZE}
+			}};
+
+			std::array<VkWriteDescriptorSet, 6> writes{};
+			for (uint32_t bindingIdx = 0; bindingIdx < writes.size(); bindingIdx++)
+			{
+				writes[bindingIdx].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[bindingIdx].dstSet = slot.descriptorSet;
+				writes[bindingIdx].dstBinding = bindingIdx;
+				writes[bindingIdx].descriptorCount = 1;
+				writes[bindingIdx].descriptorType = bindingTypes[bindingIdx];
+				writes[bindingIdx].pBufferInfo = &bufferInfos[bindingIdx];
+			}
+			vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	/// PIPELINES
+	{
+		ComputePipelineDesc pipelineDesc;
+		pipelineDesc.computeShader = pipelineManager.RegisterShader(EmbeddedShaders::CULL_COMP);
+		pipelineDesc.layout = mPipelineLayout;
+
+		for (uint32_t phase = 0; phase < static_cast<uint32_t>(ECullPhase::Count); phase++)
+		{
+			pipelineDesc.specializationConstants = { {CULL_CONSTANT_PHASE, phase} };
+			mPipelines[phase] = pipelineManager.CreateComputePipeline(pipelineDesc);
+		}
+	}
+}
+
+void GpuCulling::Shutdown()
+{
+	if (mDevice == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
+	vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mDevice, mSetLayout, nullptr);
+
+	vkDestroyBuffer(mDevice, mMeshBuffer, nullptr);
+	mAllocator->Free(mMeshAllocation);
+	mMeshBuffer = VK_NULL_HANDLE;
+
+	for (FrameSlot& slot : mFrameSlots)
+	{
+		vkDestroyBuffer(mDevice, slot.counterBuffer, nullptr);
+		mAllocator->Free(slot.counterAllocation);
+
+		vkDestroyBuffer(mDevice, slot.drawBuffer, nullptr);
+		mAllocator->Free(slot.drawAllocation);
+
+		vkDestroyBuffer(mDevice, slot.instanceBuffer, nullptr);
+		mAllocator->Free(slot.instanceAllocation);
+
+		if (slot.readbackBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(mDevice, slot.readbackBuffer, nullptr);
+			mAllocator->Free(slot.readbackAllocation);
+		}
+	}
+	mFrameSlots.clear();
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+GpuCulling::Outputs GpuCulling::AddPasses(RenderGraph& renderGraph, const uint32_t frameSlot, const uint32_t frameUniformsOffset, const uint32_t sourceInstancesOffset, const uint32_t instanceCount)
+{
+	assert(instanceCount <= mMaxInstances);
+	assert(frameSlot < mFrameSlots.size());
+
+	FrameSlot& slot = mFrameSlots[frameSlot];
+	const FrameInputs inputs{frameUniformsOffset, sourceInstancesOffset, instanceCount};
+	const uint32_t groupCount = (instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+
+	// Left as the slot's last frame used them, that frame has finished so the barriers only cover memory visibility
+	const RenderGraphResource counters = renderGraph.ImportBuffer(slot.counterBuffer, ERenderGraphAccess::ComputeShaderStorageRead);
+	Outputs outputs;
+	outputs.draws = renderGraph.ImportBuffer(slot.drawBuffer, ERenderGraphAccess::IndirectBufferRead);
+	outputs.instances = renderGraph.ImportBuffer(slot.instanceBuffer, ERenderGraphAccess::VertexBufferRead);
+
+	const RenderGraphPass clearPass = renderGraph.AddPass("CullClear", [this, &slot](VkCommandBuffer commandBuffer)
+	{
+		vkCmdFillBuffer(commandBuffer, slot.counterBuffer, 0, mCounterBufferSize, 0);
+	});
+	renderGraph.UseResource(clearPass, counters, ERenderGraphAccess::TransferWrite);
+
+	const RenderGraphPass countPass = renderGraph.AddPass("CullCount", [this, &slot, inputs, groupCount](VkCommandBuffer commandBuffer)
+	{
+		RecordDispatch(commandBuffer, ECullPhase::CountVisible, slot, inputs, groupCount);
+	});
+	renderGraph.UseResource(countPass, counters, ERenderGraphAccess::ComputeShaderStorageWrite);
+
+	const RenderGraphPass buildPass = renderGraph.AddPass("CullBuildDraws", [this, &slot, inputs](VkCommandBuffer commandBuffer)
+	{
+		RecordDispatch(commandBuffer, ECullPhase::BuildDraws, slot, inputs, 1);
+	});
+	renderGraph.UseResource(buildPass, counters, ERenderGraphAccess::ComputeShaderStorageWrite);
+	renderGraph.UseResource(buildPass, outputs.draws, ERenderGraphAccess::ComputeShaderStorageWrite);
+
+	const RenderGraphPass scatterPass = renderGraph.AddPass("CullScatter", [this, &slot, inputs, groupCount](VkCommandBuffer commandBuffer)
+	{
+		RecordDispatch(commandBuffer, ECullPhase::ScatterVisible, slot, inputs, groupCount);
+	});
+	renderGraph.UseResource(scatterPass, counters, ERenderGraphAccess::ComputeShaderStorageRead);
+	renderGraph.UseResource(scatterPass, outputs.instances, ERenderGraphAccess::ComputeShaderStorageWrite);
+
+	if (slot.readbackBuffer != VK_NULL_HANDLE)
+	{
+		assert(slot.validationInstanceCount == instanceCount && "CaptureValidationInputs was not called for this frame");
+		slot.bValidationPending = true;
+
+		const RenderGraphPass readbackPass = renderGraph.AddPass("CullReadback", [this, &slot, instanceCount](VkCommandBuffer commandBuffer)
+		{
+			const std::array<VkBufferCopy, 2> regions =
+			{{
+				{0, 0, mDrawBufferSize},
+				{0, mDrawBufferSize, static_cast<VkDeviceSize>(INSTANCE_STRIDE) * std::max(instanceCount, 1u)}
+			}};
+			vkCmdCopyBuffer(commandBuffer, slot.drawBuffer, slot.readbackBuffer, 1, &regions[0]);
+			vkCmdCopyBuffer(commandBuffer, slot.instanceBuffer, slot.readbackBuffer, 1, &regions[1]);
+
+			// The fence does not make the copies visible to the host by itself
+			VkMemoryBarrier hostBarrier{};
+			hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+		}, true);
+		renderGraph.UseResource(readbackPass, outputs.draws, ERenderGraphAccess::TransferRead);
+		renderGraph.UseResource(readbackPass, outputs.instances, ERenderGraphAccess::TransferRead);
+	}
+
+	return outputs;
+}
+
+void GpuCulling::RecordDraws(const VkCommandBuffer commandBuffer, const uint32_t frameSlot) const
+{
+	constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	const VkBuffer drawBuffer = mFrameSlots[frameSlot].drawBuffer;
+
+	if (mHasDrawIndirectCount)
+	{
+		vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, DRAW_COMMANDS_OFFSET, drawBuffer, 0, mMeshCount, stride);
+	}
+	else if (mHasMultiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, DRAW_COMMANDS_OFFSET, mMeshCount, stride);
+	}
+	else
+	{
+		for (uint32_t drawIdx = 0; drawIdx < mMeshCount; drawIdx++)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, DRAW_COMMANDS_OFFSET + drawIdx * stride, 1, stride);
+		}
+	}
+}
+
+void GpuCulling::EnableValidation()
+{
+	assert(mDevice != VK_NULL_HANDLE);
+
+	const VkDeviceSize readbackSize = mDrawBufferSize + static_cast<VkDeviceSize>(INSTANCE_STRIDE) * mMaxInstances;
+	for (FrameSlot& slot : mFrameSlots)
+	{
+		assert(slot.readbackBuffer == VK_NULL_HANDLE);
+		CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot.readbackBuffer, slot.readbackAllocation);
+		assert(slot.readbackAllocation.pMapped != nullptr);
+	}
+}
+
+void GpuCulling::CaptureValidationInputs(const uint32_t frameSlot, const std::span<const std::byte> sourceInstances, const std::array<glm::vec4, 6>& planes)
+{
+	assert(frameSlot < mFrameSlots.size());
+	assert(sourceInstances.size() % INSTANCE_STRIDE == 0);
+
+	FrameSlot& slot = mFrameSlots[frameSlot];
+	assert(slot.readbackBuffer != VK_NULL_HANDLE && "EnableValidation first");
+
+	slot.validationInstances.assign(sourceInstances.begin(), sourceInstances.end());
+	slot.validationPlanes = planes;
+	slot.validationInstanceCount = static_cast<uint32_t>(sourceInstances.size() / INSTANCE_STRIDE);
+}
+
+bool GpuCulling::ValidateFrame(const uint32_t frameSlot, ThreadPool& threadPool)
+{
+	assert(frameSlot < mFrameSlots.size());
+
+	FrameSlot& slot = mFrameSlots[frameSlot];
+	if (!slot.bValidationPending)
+	{
+		return false;
+	}
+	slot.bValidationPending = false;
+
+	const uint32_t instanceCount = slot.validationInstanceCount;
+	const CullInstance* pSource = reinterpret_cast<const CullInstance*>(slot.validationInstances.data());
+
+	// The reference, the same sphere test the CPU path of the engine uses
+	mValidationBounds.Resize(instanceCount);
+	for (uint32_t instanceIdx = 0; instanceIdx < instanceCount; instanceIdx++)
+	{
+		const CullInstance& instance = pSource[instanceIdx];
+		mValidationBounds.centerX[instanceIdx] = instance.translationRotation.x;
+		mValidationBounds.centerY[instanceIdx] = instance.translationRotation.y;
+		mValidationBounds.centerZ[instanceIdx] = instance.translationRotation.z;
+		mValidationBounds.radius[instanceIdx] = mMeshes[instance.meshIdx].boundingRadius * std::max(std::abs(instance.scale.x), std::abs(instance.scale.y));
+	}
+	const std::span<const uint32_t> cpuVisible = mValidationCuller.Cull(threadPool, mValidationBounds, slot.validationPlanes, VALIDATION_CULL_BATCH_SIZE);
+
+	// Per mesh, in source order, every instance the GPU may have kept and whether it must have
+	enum class EExpected : uint8_t { Culled, Visible, Either };
+	std::vector<EExpected> expected(instanceCount, EExpected::Culled);
+	for (const uint32_t instanceIdx : cpuVisible)
+	{
+		expected[instanceIdx] = EExpected::Visible;
+	}
+
+	std::vector<std::vector<uint32_t>> meshCandidates(mMeshCount);
+	for (uint32_t instanceIdx = 0; instanceIdx < instanceCount; instanceIdx++)
+	{
+		const glm::vec3 center(mValidationBounds.centerX[instanceIdx], mValidationBounds.centerY[instanceIdx], mValidationBounds.centerZ[instanceIdx]);
+		if (IsOnFrustumBoundary(center, mValidationBounds.radius[instanceIdx], slot.validationPlanes))
+		{
+			expected[instanceIdx] = EExpected::Either;
+		}
+		if (expected[instanceIdx] != EExpected::Culled)
+		{
+			meshCandidates[pSource[instanceIdx].meshIdx].push_back(instanceIdx);
+		}
+	}
+
+	const std::byte* pReadback = static_cast<const std::byte*>(slot.readbackAllocation.pMapped);
+	uint32_t drawCount = 0;
+	std::memcpy(&drawCount, pReadback, sizeof(drawCount));
+	const VkDrawIndexedIndirectCommand* pDraws = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(pReadback + DRAW_COMMANDS_OFFSET);
+	const CullInstance* pCulled = reinterpret_cast<const CullInstance*>(pReadback + mDrawBufferSize);
+
+	const auto fail = [frameSlot](const std::string& difference)
+	{
+		throw std::runtime_error(std::format("GPU culling of frame slot {} differs from FrustumCuller: {}", frameSlot, difference));
+	};
+
+	if (drawCount > mMeshCount)
+	{
+		fail(std::format("{} draws for {} meshes", drawCount, mMeshCount));
+	}
+
+	uint32_t drawIdx = 0;
+	uint32_t nextFirstInstance = 0;
+	for (uint32_t meshIdx = 0; meshIdx < mMeshCount; meshIdx++)
+	{
+		const GpuCullMesh& mesh = mMeshes[meshIdx];
+
+		// Meshes without visible instances have no draw, so the next draw is this mesh's if its index range matches
+		uint32_t gpuCount = 0;
+		if (drawIdx < drawCount && pDraws[drawIdx].indexCount == mesh.indexCount && pDraws[drawIdx].firstIndex == mesh.firstIndex && pDraws[drawIdx].vertexOffset == mesh.vertexOffset)
+		{
+			const VkDrawIndexedIndirectCommand& draw = pDraws[drawIdx];
+			if (draw.firstInstance != nextFirstInstance || draw.instanceCount == 0)
+			{
+				fail(std::format("draw {} of mesh {} covers instances {} to {}, expected them to start at {}", drawIdx, meshIdx, draw.firstInstance, draw.firstInstance + draw.instanceCount, nextFirstInstance));
+			}
+			gpuCount = draw.instanceCount;
+			drawIdx++;
+		}
+
+		// Both keep the source order, so walk them side by side, only boundary instances may be missing on the GPU
+		uint32_t gpuIdx = 0;
+		for (const uint32_t instanceIdx : meshCandidates[meshIdx])
+		{
+			if (gpuIdx < gpuCount && std::memcmp(&pCulled[nextFirstInstance + gpuIdx], &pSource[instanceIdx], sizeof(CullInstance)) == 0)
+			{
+				gpuIdx++;
+			}
+			else if (expected[instanceIdx] == EExpected::Visible)
+			{
+				fail(std::format("instance {} of mesh {} is visible but not where the GPU put culled instance {}", instanceIdx, meshIdx, nextFirstInstance + gpuIdx));
+			}
+		}
+		if (gpuIdx != gpuCount)
+		{
+			fail(std::format("the GPU kept {} instances of mesh {} that FrustumCuller culls", gpuCount - gpuIdx, meshIdx));
+		}
+
+		nextFirstInstance += gpuCount;
+	}
+
+	if (drawIdx != drawCount)
+	{
+		fail(std::format("draw {} matches no mesh", drawIdx));
+	}
+
+	// Without vkCmdDrawIndexedIndirectCount every command is drawn, so the unused ones have to be empty
+	for (uint32_t unusedIdx = drawCount; unusedIdx < mMeshCount; unusedIdx++)
+	{
+		if (pDraws[unusedIdx].indexCount != 0 || pDraws[unusedIdx].instanceCount != 0)
+		{
+			fail(std::format("unused draw {} is not empty", unusedIdx));
+		}
+	}
+
+	return true;
+}
+
+void GpuCulling::CreateBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const VkMemoryPropertyFlags properties, VkBuffer& outBuffer, GpuAllocation& outAllocation)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult bufferResult = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &outBuffer);
+	VK_CHECK(bufferResult, "Failed to create culling buffer: {}");
+
+	outAllocation = mAllocator->AllocateForBuffer(outBuffer, properties);
+}
+
+void GpuCulling::RecordDispatch(const VkCommandBuffer commandBuffer, const ECullPhase phase, const FrameSlot& slot, const FrameInputs& inputs, const uint32_t groupCount) const
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelines[static_cast<uint32_t>(phase)]);
+
+	// In binding order
+	const std::array<uint32_t, 2> dynamicOffsets = { inputs.frameUniformsOffset, inputs.sourceInstancesOffset };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelineLayout, 0, 1, &slot.descriptorSet, static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+	const PushConstants pushConstants{inputs.instanceCount, mMeshCount};
+	vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+	if (groupCount > 0)
+	{
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
+}
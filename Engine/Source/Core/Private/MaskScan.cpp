@@ -0,0 +1,85 @@
+#include "MaskScan.h"
+#include "CpuFeatures.h"
+
+#include <bit>
+
+namespace
+{
+	uint32_t ScanComponentMasksScalar(const PackedComponentMask* masks, const uint32_t begin, const uint32_t end, const PackedComponentMask requiredMask, const PackedComponentMask excludedMask, uint32_t* outIndices)
+	{
+		uint32_t count = 0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			// Branchless so the loop does not stall on unpredictable matches
+			outIndices[count] = i;
+			count += ((masks[i] & requiredMask) == requiredMask) & ((masks[i] & excludedMask) == 0);
+		}
+		return count;
+	}
+
+#ifdef FIREFLY_SIMD_X64
+	const bool bAvx2Supported = IsAvx2Supported();
+
+	// SSE2 is part of the x64 baseline so this needs no runtime check
+	uint32_t ScanComponentMasksSSE2(const PackedComponentMask* masks, uint32_t begin, const uint32_t end, const PackedComponentMask requiredMask, const PackedComponentMask excludedMask, uint32_t* outIndices)
+	{
+		const __m128i required = _mm_set1_epi32(static_cast<int>(requiredMask));
+		const __m128i excluded = _mm_set1_epi32(static_cast<int>(excludedMask));
+		const __m128i zero = _mm_setzero_si128();
+
+		uint32_t count = 0;
+		for (; begin + 4 <= end; begin += 4)
+		{
+			const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + begin));
+			const __m128i hasRequired = _mm_cmpeq_epi32(_mm_and_si128(mask, required), required);
+			const __m128i hasNoExcluded = _mm_cmpeq_epi32(_mm_and_si128(mask, excluded), zero);
+
+			uint32_t matchBits = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(hasRequired, hasNoExcluded))));
+			while (matchBits != 0)
+			{
+				outIndices[count++] = begin + std::countr_zero(matchBits);
+				matchBits &= matchBits - 1;
+			}
+		}
+
+		return count + ScanComponentMasksScalar(masks, begin, end, requiredMask, excludedMask, outIndices + count);
+	}
+
+	FIREFLY_TARGET_AVX2 uint32_t ScanComponentMasksAVX2(const PackedComponentMask* masks, uint32_t begin, const uint32_t end, const PackedComponentMask requiredMask, const PackedComponentMask excludedMask, uint32_t* outIndices)
+	{
+		const __m256i required = _mm256_set1_epi32(static_cast<int>(requiredMask));
+		const __m256i excluded = _mm256_set1_epi32(static_cast<int>(excludedMask));
+		const __m256i zero = _mm256_setzero_si256();
+
+		uint32_t count = 0;
+		for (; begin + 8 <= end; begin += 8)
+		{
+			const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks + begin));
+			const __m256i hasRequired = _mm256_cmpeq_epi32(_mm256_and_si256(mask, required), required);
+			const __m256i hasNoExcluded = _mm256_cmpeq_epi32(_mm256_and_si256(mask, excluded), zero);
+
+			uint32_t matchBits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(hasRequired, hasNoExcluded))));
+			while (matchBits != 0)
+			{
+				outIndices[count++] = begin + std::countr_zero(matchBits);
+				matchBits &= matchBits - 1;
+			}
+		}
+
+		return count + ScanComponentMasksSSE2(masks, begin, end, requiredMask, excludedMask, outIndices + count);
+	}
+#endif
+}
+
+uint32_t ScanComponentMasks(const PackedComponentMask* masks, const uint32_t begin, const uint32_t end, const PackedComponentMask requiredMask, const PackedComponentMask excludedMask, uint32_t* outIndices)
+{
+#ifdef FIREFLY_SIMD_X64
+	if (bAvx2Supported)
+	{
+		return ScanComponentMasksAVX2(masks, begin, end, requiredMask, excludedMask, outIndices);
+	}
+	return ScanComponentMasksSSE2(masks, begin, end, requiredMask, excludedMask, outIndices);
+#else
+	return ScanComponentMasksScalar(masks, begin, end, requiredMask, excludedMask, outIndices);
+#endif
+}
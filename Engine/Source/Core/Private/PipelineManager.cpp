@@ -0,0 +1,726 @@
+#include "PipelineManager.h"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+	constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+	uint64_t HashBytes(uint64_t hash, const void* pData, const size_t size)
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		for (size_t byteIdx = 0; byteIdx < size; byteIdx++)
+		{
+			hash = (hash ^ pBytes[byteIdx]) * FNV_PRIME;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	uint64_t HashValue(const uint64_t hash, const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return HashBytes(hash, &value, sizeof(T));
+	}
+
+	// Only for Vulkan structs made of 32 bit fields, which have no padding to hash or compare
+	template<typename T>
+	uint64_t HashArray(uint64_t hash, const std::vector<T>& values)
+	{
+		static_assert(sizeof(T) % sizeof(uint32_t) == 0 && alignof(T) == alignof(uint32_t));
+		hash = HashValue(hash, values.size());
+		return HashBytes(hash, values.data(), values.size() * sizeof(T));
+	}
+
+	template<typename T>
+	bool ArraysEqual(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+}
+
+bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc& other) const
+{
+	return vertexShader == other.vertexShader &&
+		fragmentShader == other.fragmentShader &&
+		ArraysEqual(specializationConstants, other.specializationConstants) &&
+		ArraysEqual(vertexBindings, other.vertexBindings) &&
+		ArraysEqual(vertexAttributes, other.vertexAttributes) &&
+		topology == other.topology &&
+		polygonMode == other.polygonMode &&
+		cullMode == other.cullMode &&
+		frontFace == other.frontFace &&
+		samples == other.samples &&
+		bDepthTest == other.bDepthTest &&
+		bDepthWrite == other.bDepthWrite &&
+		depthCompareOp == other.depthCompareOp &&
+		ArraysEqual(colorFormats, other.colorFormats) &&
+		ArraysEqual(colorBlendStates, other.colorBlendStates) &&
+		depthFormat == other.depthFormat &&
+		layout == other.layout;
+}
+
+uint64_t HashGraphicsPipelineDesc(const GraphicsPipelineDesc& desc)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	hash = HashValue(hash, desc.vertexShader);
+	hash = HashValue(hash, desc.fragmentShader);
+	hash = HashArray(hash, desc.specializationConstants);
+	hash = HashArray(hash, desc.vertexBindings);
+	hash = HashArray(hash, desc.vertexAttributes);
+	hash = HashValue(hash, desc.topology);
+	hash = HashValue(hash, desc.polygonMode);
+	hash = HashValue(hash, desc.cullMode);
+	hash = HashValue(hash, desc.frontFace);
+	hash = HashValue(hash, desc.samples);
+	hash = HashValue(hash, desc.bDepthTest);
+	hash = HashValue(hash, desc.bDepthWrite);
+	hash = HashValue(hash, desc.depthCompareOp);
+	hash = HashArray(hash, desc.colorFormats);
+	hash = HashArray(hash, desc.colorBlendStates);
+	hash = HashValue(hash, desc.depthFormat);
+	hash = HashValue(hash, desc.layout);
+	return hash;
+}
+
+bool ComputePipelineDesc::operator==(const ComputePipelineDesc& other) const
+{
+	return computeShader == other.computeShader &&
+		ArraysEqual(specializationConstants, other.specializationConstants) &&
+		layout == other.layout;
+}
+
+void PipelineManager::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, const std::filesystem::path& cachePath, const uint32_t numCompileThreads)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mCachePath = cachePath;
+	vkGetPhysicalDeviceProperties(physicalDevice, &mDeviceProperties);
+
+	const std::vector<uint8_t> cacheData = LoadCacheFile();
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = cacheData.size();
+	cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	VkResult result = vkCreatePipelineCache(mDevice, &cacheInfo, nullptr, &mPipelineCache);
+	if (result != VK_SUCCESS && !cacheData.empty())
+	{
+		// The driver may still refuse a blob that passed our checks, starting empty is always allowed
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(mDevice, &cacheInfo, nullptr, &mPipelineCache);
+	}
+	else
+	{
+		mStatistics.loadedCacheBytes = cacheData.size();
+	}
+	VK_CHECK(result, "Failed to create pipeline cache: {}");
+
+	mStopping = false;
+	for (uint32_t threadIdx = 0; threadIdx < numCompileThreads; threadIdx++)
+	{
+		mCompileThreads.emplace_back(&PipelineManager::CompileThreadMain, this);
+	}
+}
+
+void PipelineManager::Shutdown()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mStopping = true;
+		mCompileQueue.clear();
+	}
+	mCompileQueued.notify_all();
+
+	// A thread in the middle of a compile finishes it first
+	for (std::thread& compileThread : mCompileThreads)
+	{
+		compileThread.join();
+	}
+	mCompileThreads.clear();
+
+	SaveCache();
+
+	std::lock_guard lock(mMutex);
+
+	for (Pipeline& pipeline : mPipelines)
+	{
+		vkDestroyPipeline(mDevice, pipeline.pipeline, nullptr);
+	}
+	mPipelines.clear();
+	mPipelinesByHash.clear();
+
+	for (ComputePipeline& computePipeline : mComputePipelines)
+	{
+		vkDestroyPipeline(mDevice, computePipeline.pipeline, nullptr);
+	}
+	mComputePipelines.clear();
+
+	for (Shader& shader : mShaders)
+	{
+		vkDestroyShaderModule(mDevice, shader.module, nullptr);
+	}
+	mShaders.clear();
+	mShadersByHash.clear();
+
+	vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
+	mPipelineCache = VK_NULL_HANDLE;
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+void PipelineManager::SaveCache()
+{
+	size_t dataSize = 0;
+	VkResult sizeResult = vkGetPipelineCacheData(mDevice, mPipelineCache, &dataSize, nullptr);
+	VK_CHECK(sizeResult, "Failed to query pipeline cache size: {}");
+
+	std::vector<uint8_t> data(dataSize);
+	VkResult dataResult = vkGetPipelineCacheData(mDevice, mPipelineCache, &dataSize, data.data());
+	VK_CHECK(dataResult, "Failed to read pipeline cache: {}");
+	data.resize(dataSize);
+
+	CacheFileHeader header{};
+	header.magic = CACHE_FILE_MAGIC;
+	header.version = CACHE_FILE_VERSION;
+	header.vendorID = mDeviceProperties.vendorID;
+	header.deviceID = mDeviceProperties.deviceID;
+	header.driverVersion = mDeviceProperties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, mDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = HashBytes(FNV_OFFSET_BASIS, data.data(), data.size());
+
+	std::error_code error;
+	if (mCachePath.has_parent_path())
+	{
+		std::filesystem::create_directories(mCachePath.parent_path(), error);
+	}
+
+	// Written next to the real file and renamed over it, so a crash halfway never leaves a truncated cache behind
+	std::filesystem::path tempPath = mCachePath;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		if (!file)
+		{
+			std::cerr << "Failed to write pipeline cache " << tempPath << "\n";
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, mCachePath, error);
+	if (error)
+	{
+		std::cerr << "Failed to replace pipeline cache " << mCachePath << ": " << error.message() << "\n";
+	}
+}
+
+ShaderID PipelineManager::RegisterShader(const std::span<const uint32_t> code)
+{
+	assert(!code.empty());
+
+	const uint64_t codeHash = HashBytes(FNV_OFFSET_BASIS, code.data(), code.size_bytes());
+
+	std::lock_guard lock(mMutex);
+
+	std::vector<ShaderID>& candidates = mShadersByHash[codeHash];
+	for (ShaderID shaderIdx : candidates)
+	{
+		const std::vector<uint32_t>& existingCode = mShaders[shaderIdx].code;
+		if (existingCode.size() == code.size() && std::memcmp(existingCode.data(), code.data(), code.size_bytes()) == 0)
+		{
+			return shaderIdx;
+		}
+	}
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size_bytes();
+	createInfo.pCode = code.data();
+
+	Shader& shader = mShaders.emplace_back();
+	shader.codeHash = codeHash;
+	shader.code.assign(code.begin(), code.end());
+
+	VkResult result = vkCreateShaderModule(mDevice, &createInfo, nullptr, &shader.module);
+	if (result != VK_SUCCESS)
+	{
+		mShaders.pop_back();
+		VK_CHECK(result, "Failed to create shader module: {}");
+	}
+
+	const ShaderID shaderIdx = static_cast<ShaderID>(mShaders.size() - 1);
+	candidates.push_back(shaderIdx);
+	mStatistics.shaderCount++;
+	return shaderIdx;
+}
+
+PipelineID PipelineManager::RegisterGraphicsPipeline(const GraphicsPipelineDesc& desc)
+{
+	const uint64_t hash = HashGraphicsPipelineDesc(desc);
+
+	std::unique_lock lock(mMutex);
+
+	PipelineID pipelineIdx = FindPipeline(desc, hash);
+	if (pipelineIdx == INVALID_PIPELINE)
+	{
+		Pipeline& entry = mPipelines.emplace_back();
+		entry.desc = desc;
+		entry.hash = hash;
+		entry.state = EPipelineState::Compiling;
+
+		pipelineIdx = static_cast<PipelineID>(mPipelines.size() - 1);
+		mPipelinesByHash[hash].push_back(pipelineIdx);
+		mStatistics.pipelineCount++;
+	}
+	else
+	{
+		mStatistics.deduplicatedCount++;
+
+		Pipeline& entry = mPipelines[pipelineIdx];
+		if (entry.state == EPipelineState::Queued)
+		{
+			// Still waiting for a background thread, do it ourselves rather than wait behind the rest of the queue
+			entry.state = EPipelineState::Compiling;
+		}
+		else
+		{
+			mCompileFinished.wait(lock, [&entry]() { return entry.state != EPipelineState::Compiling; });
+
+			if (entry.state == EPipelineState::Failed)
+			{
+				throw std::runtime_error("Failed to create graphics pipeline, an earlier attempt failed");
+			}
+			return pipelineIdx;
+		}
+	}
+
+	if (!CompilePipeline(pipelineIdx, lock, false))
+	{
+		throw std::runtime_error("Failed to create graphics pipeline");
+	}
+	return pipelineIdx;
+}
+
+PipelineID PipelineManager::RequestGraphicsPipeline(const GraphicsPipelineDesc& desc, const PipelineID fallback)
+{
+	const uint64_t hash = HashGraphicsPipelineDesc(desc);
+
+	std::lock_guard lock(mMutex);
+
+	assert(fallback == INVALID_PIPELINE || fallback < mPipelines.size());
+
+	PipelineID pipelineIdx = FindPipeline(desc, hash);
+	if (pipelineIdx != INVALID_PIPELINE)
+	{
+		mStatistics.deduplicatedCount++;
+
+		// Every fallback accepts the same draws, so an earlier one is kept and a missing one is taken from this request,
+		// unless that would close a loop such as two variants toggled back and forth falling back to each other
+		Pipeline& entry = mPipelines[pipelineIdx];
+		if (entry.fallback == INVALID_PIPELINE && fallback != INVALID_PIPELINE && !FallsBackTo(fallback, pipelineIdx))
+		{
+			entry.fallback = fallback;
+		}
+		return pipelineIdx;
+	}
+
+	Pipeline& entry = mPipelines.emplace_back();
+	entry.desc = desc;
+	entry.hash = hash;
+	entry.state = EPipelineState::Queued;
+	entry.fallback = fallback;
+
+	pipelineIdx = static_cast<PipelineID>(mPipelines.size() - 1);
+	mPipelinesByHash[hash].push_back(pipelineIdx);
+	mStatistics.pipelineCount++;
+
+	mCompileQueue.push_back(pipelineIdx);
+	mCompileQueued.notify_one();
+	return pipelineIdx;
+}
+
+std::vector<PipelineID> PipelineManager::PrewarmGraphicsPipelines(const std::span<const GraphicsPipelineDesc> descs, ThreadPool& threadPool)
+{
+	std::vector<PipelineID> pipelines(descs.size(), INVALID_PIPELINE);
+
+	// One pipeline per batch, compile times differ too much between pipelines for larger batches to balance
+	threadPool.ParallelFor(static_cast<uint32_t>(descs.size()), 1, [this, descs, &pipelines](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t descIdx = begin; descIdx < end; descIdx++)
+		{
+			// Nothing catches on the pool's threads, so a failed pipeline must not leave the lambda and stop the others
+			try
+			{
+				pipelines[descIdx] = RegisterGraphicsPipeline(descs[descIdx]);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << std::format("Failed to prewarm pipeline {}: {}\n", descIdx, e.what());
+			}
+		}
+	});
+
+	return pipelines;
+}
+
+VkPipeline PipelineManager::CreateComputePipeline(const ComputePipelineDesc& desc)
+{
+	// Held while compiling, compute pipelines are created during startup where nothing else waits on the lock
+	std::lock_guard lock(mMutex);
+
+	for (const ComputePipeline& computePipeline : mComputePipelines)
+	{
+		if (computePipeline.desc == desc)
+		{
+			mStatistics.deduplicatedCount++;
+			return computePipeline.pipeline;
+		}
+	}
+
+	std::vector<VkSpecializationMapEntry> specializationEntries(desc.specializationConstants.size());
+	for (size_t constantIdx = 0; constantIdx < desc.specializationConstants.size(); constantIdx++)
+	{
+		specializationEntries[constantIdx].constantID = desc.specializationConstants[constantIdx].constantID;
+		specializationEntries[constantIdx].offset = static_cast<uint32_t>(constantIdx * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value));
+		specializationEntries[constantIdx].size = sizeof(uint32_t);
+	}
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = desc.specializationConstants.size() * sizeof(SpecializationConstant);
+	specializationInfo.pData = desc.specializationConstants.data();
+
+	assert(desc.computeShader < mShaders.size());
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = mShaders[desc.computeShader].module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = specializationEntries.empty() ? nullptr : &specializationInfo;
+	pipelineInfo.layout = desc.layout;
+
+	const auto compileStart = std::chrono::high_resolution_clock::now();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateComputePipelines(mDevice, mPipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+	VK_CHECK(result, "Failed to create compute pipeline: {}");
+
+	mStatistics.compileMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count();
+	mStatistics.pipelineCount++;
+
+	mComputePipelines.push_back({desc, pipeline});
+	return pipeline;
+}
+
+bool PipelineManager::IsPipelineReady(const PipelineID pipeline) const
+{
+	std::lock_guard lock(mMutex);
+	assert(pipeline < mPipelines.size());
+	return mPipelines[pipeline].state == EPipelineState::Ready;
+}
+
+bool PipelineManager::FallsBackTo(const PipelineID pipeline, const PipelineID target) const
+{
+	for (PipelineID pipelineIdx = pipeline; pipelineIdx != INVALID_PIPELINE; pipelineIdx = mPipelines[pipelineIdx].fallback)
+	{
+		if (pipelineIdx == target)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+VkPipeline PipelineManager::GetPipeline(const PipelineID pipeline) const
+{
+	std::lock_guard lock(mMutex);
+
+	// Fallbacks may have fallbacks of their own, follow them to the first one that is ready
+	PipelineID pipelineIdx = pipeline;
+	while (pipelineIdx != INVALID_PIPELINE)
+	{
+		assert(pipelineIdx < mPipelines.size());
+		const Pipeline& entry = mPipelines[pipelineIdx];
+		if (entry.state == EPipelineState::Ready)
+		{
+			return entry.pipeline;
+		}
+		pipelineIdx = entry.fallback;
+	}
+
+	return VK_NULL_HANDLE;
+}
+
+PipelineManager::Statistics PipelineManager::GetStatistics() const
+{
+	std::lock_guard lock(mMutex);
+	return mStatistics;
+}
+
+std::vector<uint8_t> PipelineManager::LoadCacheFile() const
+{
+	std::ifstream file(mCachePath, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return {};
+	}
+
+	const size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(CacheFileHeader))
+	{
+		return {};
+	}
+	file.seekg(0);
+
+	CacheFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	const bool bSameDevice =
+		header.magic == CACHE_FILE_MAGIC &&
+		header.version == CACHE_FILE_VERSION &&
+		header.vendorID == mDeviceProperties.vendorID &&
+		header.deviceID == mDeviceProperties.deviceID &&
+		header.driverVersion == mDeviceProperties.driverVersion &&
+		std::memcmp(header.pipelineCacheUUID, mDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+	if (!bSameDevice || header.dataSize != fileSize - sizeof(CacheFileHeader))
+	{
+		return {};
+	}
+
+	std::vector<uint8_t> data(header.dataSize);
+	file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+	// Drivers do not all validate the blob themselves, a corrupted one must never reach them
+	if (!file || HashBytes(FNV_OFFSET_BASIS, data.data(), data.size()) != header.dataHash)
+	{
+		return {};
+	}
+
+	return data;
+}
+
+VkPipeline PipelineManager::CreateGraphicsPipeline(const GraphicsPipelineDesc& desc)
+{
+	assert(desc.colorFormats.size() == desc.colorBlendStates.size());
+
+	std::vector<VkSpecializationMapEntry> specializationEntries(desc.specializationConstants.size());
+	for (size_t constantIdx = 0; constantIdx < desc.specializationConstants.size(); constantIdx++)
+	{
+		specializationEntries[constantIdx].constantID = desc.specializationConstants[constantIdx].constantID;
+		specializationEntries[constantIdx].offset = static_cast<uint32_t>(constantIdx * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value));
+		specializationEntries[constantIdx].size = sizeof(uint32_t);
+	}
+
+	// The values are read straight out of the constants
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = desc.specializationConstants.size() * sizeof(SpecializationConstant);
+	specializationInfo.pData = desc.specializationConstants.data();
+
+	const VkSpecializationInfo* pSpecializationInfo = specializationEntries.empty() ? nullptr : &specializationInfo;
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+	uint32_t stageCount = 0;
+	{
+		std::lock_guard lock(mMutex);
+
+		assert(desc.vertexShader < mShaders.size());
+		VkPipelineShaderStageCreateInfo& vertexStage = shaderStages[stageCount++];
+		vertexStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		vertexStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		vertexStage.module = mShaders[desc.vertexShader].module;
+		vertexStage.pName = "main";
+		vertexStage.pSpecializationInfo = pSpecializationInfo;
+
+		if (desc.fragmentShader != UINT32_MAX)
+		{
+			assert(desc.fragmentShader < mShaders.size());
+			VkPipelineShaderStageCreateInfo& fragmentStage = shaderStages[stageCount++];
+			fragmentStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			fragmentStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			fragmentStage.module = mShaders[desc.fragmentShader].module;
+			fragmentStage.pName = "main";
+			fragmentStage.pSpecializationInfo = pSpecializationInfo;
+		}
+	}
+
+	const std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.topology = desc.topology;
+	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewportStateInfo{};
+	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateInfo.viewportCount = 1;
+	viewportStateInfo.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizationInfo{};
+	rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizationInfo.depthClampEnable = VK_FALSE;
+	rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
+	rasterizationInfo.polygonMode = desc.polygonMode;
+	rasterizationInfo.lineWidth = 1.0f;
+	rasterizationInfo.cullMode = desc.cullMode;
+	rasterizationInfo.frontFace = desc.frontFace;
+	rasterizationInfo.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisamplingInfo{};
+	multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisamplingInfo.sampleShadingEnable = VK_FALSE;
+	multisamplingInfo.rasterizationSamples = desc.samples;
+	multisamplingInfo.minSampleShading = 1.0f;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
+	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilInfo.depthTestEnable = desc.bDepthTest ? VK_TRUE : VK_FALSE;
+	depthStencilInfo.depthWriteEnable = desc.bDepthWrite ? VK_TRUE : VK_FALSE;
+	depthStencilInfo.depthCompareOp = desc.depthCompareOp;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendInfo{};
+	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendInfo.logicOpEnable = VK_FALSE;
+	colorBlendInfo.attachmentCount = static_cast<uint32_t>(desc.colorBlendStates.size());
+	colorBlendInfo.pAttachments = desc.colorBlendStates.data();
+
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = static_cast<uint32_t>(desc.colorFormats.size());
+	renderingInfo.pColorAttachmentFormats = desc.colorFormats.data();
+	renderingInfo.depthAttachmentFormat = desc.depthFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = stageCount;
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pDynamicState = &dynamicStateInfo;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+	pipelineInfo.pViewportState = &viewportStateInfo;
+	pipelineInfo.pRasterizationState = &rasterizationInfo;
+	pipelineInfo.pMultisampleState = &multisamplingInfo;
+	pipelineInfo.pDepthStencilState = desc.depthFormat != VK_FORMAT_UNDEFINED ? &depthStencilInfo : nullptr;
+	pipelineInfo.pColorBlendState = &colorBlendInfo;
+	pipelineInfo.layout = desc.layout;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+	VK_CHECK(result, "Failed to create graphics pipeline: {}");
+	return pipeline;
+}
+
+PipelineID PipelineManager::FindPipeline(const GraphicsPipelineDesc& desc, const uint64_t hash) const
+{
+	auto found = mPipelinesByHash.find(hash);
+	if (found != mPipelinesByHash.end())
+	{
+		for (PipelineID pipelineIdx : found->second)
+		{
+			if (mPipelines[pipelineIdx].desc == desc)
+			{
+				return pipelineIdx;
+			}
+		}
+	}
+	return INVALID_PIPELINE;
+}
+
+bool PipelineManager::CompilePipeline(const PipelineID pipeline, std::unique_lock<std::mutex>& lock, const bool bBackground)
+{
+	Pipeline& entry = mPipelines[pipeline];
+	assert(entry.state == EPipelineState::Compiling);
+
+	// Compiling is the slow part and the cache is internally synchronized, so other threads keep registering meanwhile
+	lock.unlock();
+
+	VkPipeline compiled = VK_NULL_HANDLE;
+	const auto compileStart = std::chrono::high_resolution_clock::now();
+	try
+	{
+		compiled = CreateGraphicsPipeline(entry.desc);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+	}
+	const auto compileEnd = std::chrono::high_resolution_clock::now();
+
+	lock.lock();
+
+	mStatistics.compileMilliseconds += std::chrono::duration<double, std::milli>(compileEnd - compileStart).count();
+
+	entry.pipeline = compiled;
+	if (compiled != VK_NULL_HANDLE)
+	{
+		entry.state = EPipelineState::Ready;
+		mStatistics.backgroundCompiledCount += bBackground ? 1 : 0;
+	}
+	else
+	{
+		entry.state = EPipelineState::Failed;
+		mStatistics.failedCount++;
+	}
+
+	mCompileFinished.notify_all();
+	return compiled != VK_NULL_HANDLE;
+}
+
+void PipelineManager::CompileThreadMain()
+{
+	std::unique_lock lock(mMutex);
+
+	while (true)
+	{
+		mCompileQueued.wait(lock, [this]() { return mStopping || !mCompileQueue.empty(); });
+		if (mStopping)
+		{
+			return;
+		}
+
+		const PipelineID pipelineIdx = mCompileQueue.front();
+		mCompileQueue.pop_front();
+
+		Pipeline& entry = mPipelines[pipelineIdx];
+		if (entry.state != EPipelineState::Queued)
+		{
+			continue;
+		}
+
+		entry.state = EPipelineState::Compiling;
+		CompilePipeline(pipelineIdx, lock, true);
+	}
+}
@@ -0,0 +1,747 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace
+{
+	// Only these need to be made available, read bits in a source access mask do nothing
+	constexpr VkAccessFlags2 WRITE_ACCESS_MASK =
+		VK_ACCESS_2_SHADER_WRITE_BIT |
+		VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+		VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_TRANSFER_WRITE_BIT |
+		VK_ACCESS_2_HOST_WRITE_BIT |
+		VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+	VkImageCreateInfo MakeImageCreateInfo(const RenderGraphImageDesc& desc, const VkImageUsageFlags usage)
+	{
+		VkImageCreateInfo imageCreateInfo{};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = desc.format;
+		imageCreateInfo.extent = {desc.extent.width, desc.extent.height, 1};
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = desc.samples;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = usage;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return imageCreateInfo;
+	}
+
+	bool operator==(const RenderGraphImageDesc& a, const RenderGraphImageDesc& b)
+	{
+		return a.format == b.format && a.extent.width == b.extent.width && a.extent.height == b.extent.height && a.aspectMask == b.aspectMask && a.samples == b.samples;
+	}
+}
+
+const RenderGraph::AccessInfo& RenderGraph::GetAccessInfo(const ERenderGraphAccess access)
+{
+	static const std::array<AccessInfo, static_cast<size_t>(ERenderGraphAccess::Count)> accessInfos =
+	{{
+		// None
+		{VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// SwapchainAcquire
+		{VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// ColorAttachmentWrite
+		{VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true},
+		// DepthAttachmentWrite
+		{VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true},
+		// DepthAttachmentRead
+		{VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, false},
+		// VertexShaderSampledRead
+		{VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false},
+		// FragmentShaderSampledRead
+		{VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false},
+		// ComputeShaderSampledRead
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false},
+		// ComputeShaderStorageRead
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false},
+		// ComputeShaderStorageWrite
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true},
+		// TransferRead
+		{VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false},
+		// TransferWrite
+		{VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true},
+		// VertexBufferRead
+		{VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// IndexBufferRead
+		{VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// IndirectBufferRead
+		{VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// UniformRead
+		{VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false},
+		// Present, the semaphore signalled after the submission takes care of the rest
+		{VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, false},
+	}};
+
+	assert(access < ERenderGraphAccess::Count);
+	return accessInfos[static_cast<size_t>(access)];
+}
+
+void RenderGraph::Init(const VkDevice device, DeviceMemoryAllocator& allocator)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mAllocator = &allocator;
+}
+
+void RenderGraph::Shutdown()
+{
+	for (PhysicalImage& physicalImage : mPhysicalImages)
+	{
+		vkDestroyImageView(mDevice, physicalImage.view, nullptr);
+		vkDestroyImage(mDevice, physicalImage.image, nullptr);
+	}
+	mPhysicalImages.clear();
+
+	for (MemorySlot& slot : mMemorySlots)
+	{
+		if (slot.allocation.IsValid())
+		{
+			mAllocator->Free(slot.allocation);
+		}
+	}
+	mMemorySlots.clear();
+
+	// Nothing is in flight any more
+	BeginFrame(UINT64_MAX, UINT64_MAX);
+
+	mResources.clear();
+	mPasses.clear();
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+void RenderGraph::BeginFrame(const uint64_t frameNumber, const uint64_t completedFrameNumber)
+{
+	mFrameNumber = frameNumber;
+
+	std::erase_if(mGarbage, [this, completedFrameNumber](Garbage& garbage)
+	{
+		if (garbage.frameNumber > completedFrameNumber)
+		{
+			return false;
+		}
+
+		for (VkImageView view : garbage.views)
+		{
+			vkDestroyImageView(mDevice, view, nullptr);
+		}
+		for (VkImage image : garbage.images)
+		{
+			vkDestroyImage(mDevice, image, nullptr);
+		}
+		for (GpuAllocation& allocation : garbage.allocations)
+		{
+			mAllocator->Free(allocation);
+		}
+		return true;
+	});
+
+	mResources.clear();
+	mPasses.clear();
+	mImageBarriers.clear();
+	mCompiled = false;
+}
+
+RenderGraphResource RenderGraph::ImportImage(const VkImage image, const VkImageView view, const VkImageSubresourceRange& range, const ERenderGraphAccess initialAccess, const ERenderGraphAccess finalAccess)
+{
+	const AccessInfo& initialInfo = GetAccessInfo(initialAccess);
+
+	Resource& resource = mResources.emplace_back();
+	resource.bImported = true;
+	resource.bImage = true;
+	resource.image = image;
+	resource.view = view;
+	resource.range = range;
+	resource.finalAccess = finalAccess;
+
+	resource.state.layout = initialInfo.layout;
+	if (initialInfo.bWrite)
+	{
+		resource.state.writeStages = initialInfo.stageMask;
+		resource.state.writeAccess = initialInfo.accessMask & WRITE_ACCESS_MASK;
+	}
+	else
+	{
+		resource.state.readStages = initialInfo.stageMask;
+	}
+
+	return static_cast<RenderGraphResource>(mResources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(const VkBuffer buffer, const ERenderGraphAccess initialAccess)
+{
+	const AccessInfo& initialInfo = GetAccessInfo(initialAccess);
+
+	Resource& resource = mResources.emplace_back();
+	resource.bImported = true;
+	resource.bImage = false;
+	resource.buffer = buffer;
+
+	if (initialInfo.bWrite)
+	{
+		resource.state.writeStages = initialInfo.stageMask;
+		resource.state.writeAccess = initialInfo.accessMask & WRITE_ACCESS_MASK;
+	}
+	else
+	{
+		resource.state.readStages = initialInfo.stageMask;
+	}
+
+	return static_cast<RenderGraphResource>(mResources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateImage(const RenderGraphImageDesc& desc)
+{
+	assert(desc.format != VK_FORMAT_UNDEFINED);
+	assert(desc.extent.width > 0 && desc.extent.height > 0);
+
+	Resource& resource = mResources.emplace_back();
+	resource.bImported = false;
+	resource.bImage = true;
+	resource.desc = desc;
+	resource.range.aspectMask = desc.aspectMask;
+	resource.range.baseMipLevel = 0;
+	resource.range.levelCount = 1;
+	resource.range.baseArrayLayer = 0;
+	resource.range.layerCount = 1;
+
+	return static_cast<RenderGraphResource>(mResources.size() - 1);
+}
+
+RenderGraphPass RenderGraph::AddPass(const char* name, ExecuteFn execute, const bool bHasSideEffects)
+{
+	assert(!mCompiled);
+
+	Pass& pass = mPasses.emplace_back();
+	pass.name = name;
+	pass.execute = std::move(execute);
+	pass.bHasSideEffects = bHasSideEffects;
+
+	return static_cast<RenderGraphPass>(mPasses.size() - 1);
+}
+
+void RenderGraph::UseResource(const RenderGraphPass pass, const RenderGraphResource resource, const ERenderGraphAccess access)
+{
+	assert(pass < mPasses.size());
+	assert(resource < mResources.size());
+	assert(access != ERenderGraphAccess::None);
+
+	std::vector<PassAccess>& accesses = mPasses[pass].accesses;
+
+	// Barriers in one batch are unordered, so an image can only be transitioned once per pass
+	assert(!mResources[resource].bImage || std::none_of(accesses.begin(), accesses.end(), [resource](const PassAccess& passAccess) { return passAccess.resource == resource; }));
+
+	accesses.push_back({resource, access});
+}
+
+void RenderGraph::Compile()
+{
+	assert(!mCompiled);
+
+	CullPasses();
+
+	for (uint32_t passIdx = 0; passIdx < mPasses.size(); passIdx++)
+	{
+		if (mPasses[passIdx].bCulled)
+		{
+			continue;
+		}
+
+		for (const PassAccess& passAccess : mPasses[passIdx].accesses)
+		{
+			Resource& resource = mResources[passAccess.resource];
+			resource.firstPass = std::min(resource.firstPass, passIdx);
+			resource.lastPass = std::max(resource.lastPass, passIdx);
+			resource.usage |= GetAccessInfo(passAccess.access).usage;
+		}
+	}
+
+	AssignMemorySlots();
+
+	CreatePhysicalImages();
+
+	BuildBarriers();
+
+	mCompiled = true;
+}
+
+void RenderGraph::Execute(const VkCommandBuffer commandBuffer)
+{
+	assert(mCompiled);
+
+	for (const Pass& pass : mPasses)
+	{
+		if (pass.bCulled)
+		{
+			continue;
+		}
+
+		const bool bMemoryBarrier = pass.memoryBarrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE || pass.memoryBarrier.dstStageMask != VK_PIPELINE_STAGE_2_NONE;
+		if (pass.imageBarrierCount > 0 || bMemoryBarrier)
+		{
+			VkDependencyInfo dependencyInfo{};
+			dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+			dependencyInfo.memoryBarrierCount = bMemoryBarrier ? 1 : 0;
+			dependencyInfo.pMemoryBarriers = &pass.memoryBarrier;
+			dependencyInfo.imageMemoryBarrierCount = pass.imageBarrierCount;
+			dependencyInfo.pImageMemoryBarriers = mImageBarriers.data() + pass.firstImageBarrier;
+
+			vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+		}
+
+		if (pass.execute)
+		{
+			pass.execute(commandBuffer);
+		}
+	}
+
+	const uint32_t finalImageBarrierCount = static_cast<uint32_t>(mImageBarriers.size()) - mFirstFinalImageBarrier;
+	if (finalImageBarrierCount > 0)
+	{
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.imageMemoryBarrierCount = finalImageBarrierCount;
+		dependencyInfo.pImageMemoryBarriers = mImageBarriers.data() + mFirstFinalImageBarrier;
+
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+}
+
+VkImage RenderGraph::GetImage(const RenderGraphResource resource) const
+{
+	assert(resource < mResources.size());
+	return mResources[resource].image;
+}
+
+VkImageView RenderGraph::GetImageView(const RenderGraphResource resource) const
+{
+	assert(resource < mResources.size());
+	return mResources[resource].view;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk backwards so every consumer is decided before its producers
+	std::vector<bool> bResourceNeeded(mResources.size(), false);
+
+	mStatistics.passCount = static_cast<uint32_t>(mPasses.size());
+	mStatistics.culledPassCount = 0;
+
+	for (size_t passIdx = mPasses.size(); passIdx-- > 0;)
+	{
+		Pass& pass = mPasses[passIdx];
+
+		bool bAlive = pass.bHasSideEffects;
+		for (const PassAccess& passAccess : pass.accesses)
+		{
+			// Imported resources are seen outside the graph, so writing one always counts
+			if (GetAccessInfo(passAccess.access).bWrite && (mResources[passAccess.resource].bImported || bResourceNeeded[passAccess.resource]))
+			{
+				bAlive = true;
+				break;
+			}
+		}
+
+		pass.bCulled = !bAlive;
+		if (!bAlive)
+		{
+			mStatistics.culledPassCount++;
+			continue;
+		}
+
+		for (const PassAccess& passAccess : pass.accesses)
+		{
+			// Writes keep earlier writers alive too, attachments are loaded and storage may only be partly overwritten
+			bResourceNeeded[passAccess.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::AssignMemorySlots()
+{
+	std::vector<RenderGraphResource> transients;
+	for (RenderGraphResource resourceIdx = 0; resourceIdx < mResources.size(); resourceIdx++)
+	{
+		Resource& resource = mResources[resourceIdx];
+		if (resource.bImported || resource.firstPass == UINT32_MAX)
+		{
+			continue;
+		}
+
+		const VkImageCreateInfo imageCreateInfo = MakeImageCreateInfo(resource.desc, resource.usage);
+
+		VkDeviceImageMemoryRequirements requirementsInfo{};
+		requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+		requirementsInfo.pCreateInfo = &imageCreateInfo;
+
+		VkMemoryRequirements2 requirements{};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		vkGetDeviceImageMemoryRequirements(mDevice, &requirementsInfo, &requirements);
+
+		resource.memoryRequirements = requirements.memoryRequirements;
+		transients.push_back(resourceIdx);
+	}
+
+	std::sort(transients.begin(), transients.end(), [this](RenderGraphResource a, RenderGraphResource b) { return mResources[a].firstPass < mResources[b].firstPass; });
+
+	for (MemorySlot& slot : mMemorySlots)
+	{
+		slot.bAssigned = false;
+		slot.requiredSize = 0;
+		slot.requiredAlignment = 1;
+		slot.requiredTypeBits = 0;
+	}
+
+	mStatistics.transientImageCount = static_cast<uint32_t>(transients.size());
+	mStatistics.unaliasedTransientMemoryBytes = 0;
+
+	for (RenderGraphResource resourceIdx : transients)
+	{
+		Resource& resource = mResources[resourceIdx];
+		const VkMemoryRequirements& requirements = resource.memoryRequirements;
+
+		mStatistics.unaliasedTransientMemoryBytes += requirements.size;
+
+		// Best fit among slots whose occupants are all done before this image is first used, growing the biggest if none fit
+		uint32_t bestSlotIdx = UINT32_MAX;
+		for (uint32_t slotIdx = 0; slotIdx < mMemorySlots.size(); slotIdx++)
+		{
+			const MemorySlot& slot = mMemorySlots[slotIdx];
+			const bool bFree = !slot.bAssigned || slot.lastPass < resource.firstPass;
+			const uint32_t typeBits = slot.bAssigned ? slot.requiredTypeBits : requirements.memoryTypeBits;
+			if (!bFree || (typeBits & requirements.memoryTypeBits) == 0)
+			{
+				continue;
+			}
+
+			if (bestSlotIdx == UINT32_MAX)
+			{
+				bestSlotIdx = slotIdx;
+				continue;
+			}
+
+			// Compare against what the slot will have to hold anyway, or its current memory when unassigned so it can be kept
+			auto capacity = [](const MemorySlot& candidate) { return candidate.bAssigned ? candidate.requiredSize : candidate.allocation.size; };
+			const VkDeviceSize bestCapacity = capacity(mMemorySlots[bestSlotIdx]);
+			const VkDeviceSize slotCapacity = capacity(slot);
+			const bool bBestFits = bestCapacity >= requirements.size;
+			const bool bSlotFits = slotCapacity >= requirements.size;
+			if ((bSlotFits && (!bBestFits || slotCapacity < bestCapacity)) || (!bSlotFits && !bBestFits && slotCapacity > bestCapacity))
+			{
+				bestSlotIdx = slotIdx;
+			}
+		}
+
+		if (bestSlotIdx == UINT32_MAX)
+		{
+			bestSlotIdx = static_cast<uint32_t>(mMemorySlots.size());
+			mMemorySlots.emplace_back();
+		}
+
+		MemorySlot& slot = mMemorySlots[bestSlotIdx];
+		slot.requiredTypeBits = slot.bAssigned ? (slot.requiredTypeBits & requirements.memoryTypeBits) : requirements.memoryTypeBits;
+		slot.requiredSize = std::max(slot.requiredSize, requirements.size);
+		slot.requiredAlignment = std::max(slot.requiredAlignment, requirements.alignment);
+		slot.lastPass = resource.lastPass;
+		slot.bAssigned = true;
+
+		resource.slotIdx = bestSlotIdx;
+	}
+
+	mStatistics.transientMemoryBytes = 0;
+
+	for (MemorySlot& slot : mMemorySlots)
+	{
+		if (!slot.bAssigned)
+		{
+			// Nothing needs it this frame, hand the memory back rather than keep it around on the off chance
+			RetireSlotAllocation(slot);
+			continue;
+		}
+
+		const bool bFits = slot.allocation.IsValid() &&
+			slot.allocation.size >= slot.requiredSize &&
+			slot.allocation.offset % slot.requiredAlignment == 0 &&
+			(slot.requiredTypeBits & (1u << slot.allocation.memoryTypeIdx)) != 0;
+
+		if (!bFits)
+		{
+			RetireSlotAllocation(slot);
+
+			VkMemoryRequirements slotRequirements{};
+			slotRequirements.size = slot.requiredSize;
+			slotRequirements.alignment = slot.requiredAlignment;
+			slotRequirements.memoryTypeBits = slot.requiredTypeBits;
+
+			slot.allocation = mAllocator->Allocate(slotRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, EGpuResourceKind::Optimal);
+			if (!slot.allocation.IsValid())
+			{
+				throw std::runtime_error("Failed to allocate render graph transient memory");
+			}
+		}
+
+		mStatistics.transientMemoryBytes += slot.allocation.size;
+	}
+}
+
+void RenderGraph::CreatePhysicalImages()
+{
+	for (PhysicalImage& physicalImage : mPhysicalImages)
+	{
+		physicalImage.bUsedThisFrame = false;
+	}
+
+	for (Resource& resource : mResources)
+	{
+		if (resource.bImported || resource.slotIdx == UINT32_MAX)
+		{
+			continue;
+		}
+
+		const MemorySlot& slot = mMemorySlots[resource.slotIdx];
+
+		auto found = std::find_if(mPhysicalImages.begin(), mPhysicalImages.end(), [&resource, &slot](const PhysicalImage& physicalImage)
+		{
+			return !physicalImage.bUsedThisFrame &&
+				physicalImage.desc == resource.desc &&
+				physicalImage.usage == resource.usage &&
+				physicalImage.slotIdx == resource.slotIdx &&
+				physicalImage.slotGeneration == slot.generation;
+		});
+
+		if (found == mPhysicalImages.end())
+		{
+			PhysicalImage physicalImage{};
+			physicalImage.desc = resource.desc;
+			physicalImage.usage = resource.usage;
+			physicalImage.slotIdx = resource.slotIdx;
+			physicalImage.slotGeneration = slot.generation;
+
+			const VkImageCreateInfo imageCreateInfo = MakeImageCreateInfo(resource.desc, resource.usage);
+			VkResult imageResult = vkCreateImage(mDevice, &imageCreateInfo, nullptr, &physicalImage.image);
+			VK_CHECK(imageResult, "Failed to create render graph image: {}");
+
+			VkResult bindResult = vkBindImageMemory(mDevice, physicalImage.image, slot.allocation.memory, slot.allocation.offset);
+			VK_CHECK(bindResult, "Failed to bind render graph image memory: {}");
+
+			VkImageViewCreateInfo viewCreateInfo{};
+			viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCreateInfo.image = physicalImage.image;
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCreateInfo.format = resource.desc.format;
+			viewCreateInfo.subresourceRange = resource.range;
+
+			VkResult viewResult = vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &physicalImage.view);
+			VK_CHECK(viewResult, "Failed to create render graph image view: {}");
+
+			mPhysicalImages.push_back(physicalImage);
+			found = mPhysicalImages.end() - 1;
+		}
+
+		found->bUsedThisFrame = true;
+		resource.image = found->image;
+		resource.view = found->view;
+	}
+
+	// Images the graph no longer declares may still be read by frames in flight
+	std::erase_if(mPhysicalImages, [this](const PhysicalImage& physicalImage)
+	{
+		if (physicalImage.bUsedThisFrame)
+		{
+			return false;
+		}
+
+		Garbage& garbage = GetCurrentGarbage();
+		garbage.images.push_back(physicalImage.image);
+		garbage.views.push_back(physicalImage.view);
+		return true;
+	});
+}
+
+void RenderGraph::BuildBarriers()
+{
+	mImageBarriers.clear();
+	mStatistics.imageBarrierCount = 0;
+	mStatistics.memoryBarrierCount = 0;
+
+	for (Pass& pass : mPasses)
+	{
+		pass.firstImageBarrier = static_cast<uint32_t>(mImageBarriers.size());
+		pass.imageBarrierCount = 0;
+		pass.memoryBarrier = {};
+		pass.memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+		if (pass.bCulled)
+		{
+			continue;
+		}
+
+		for (const PassAccess& passAccess : pass.accesses)
+		{
+			Resource& resource = mResources[passAccess.resource];
+			const AccessInfo& accessInfo = GetAccessInfo(passAccess.access);
+
+			const uint32_t passIdx = static_cast<uint32_t>(&pass - mPasses.data());
+			const bool bTransient = !resource.bImported;
+
+			if (bTransient && passIdx == resource.firstPass)
+			{
+				// Take the memory over from whichever image had it last, this frame or an earlier one
+				MemorySlot& slot = mMemorySlots[resource.slotIdx];
+				resource.state = {};
+				resource.state.readStages = slot.stages;
+				resource.state.writeAccess = slot.writeAccess;
+				slot.stages = VK_PIPELINE_STAGE_2_NONE;
+				slot.writeAccess = VK_ACCESS_2_NONE;
+			}
+
+			VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+			VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+			VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			if (TransitionState(resource.state, accessInfo, resource.bImage, srcStages, srcAccess, oldLayout))
+			{
+				if (resource.bImage)
+				{
+					AddImageBarrier(resource, srcStages, srcAccess, oldLayout, accessInfo);
+					pass.imageBarrierCount++;
+				}
+				else
+				{
+					pass.memoryBarrier.srcStageMask |= srcStages;
+					pass.memoryBarrier.srcAccessMask |= srcAccess;
+					pass.memoryBarrier.dstStageMask |= accessInfo.stageMask;
+					pass.memoryBarrier.dstAccessMask |= accessInfo.accessMask;
+				}
+			}
+
+			if (bTransient)
+			{
+				MemorySlot& slot = mMemorySlots[resource.slotIdx];
+				slot.stages |= accessInfo.stageMask;
+				if (accessInfo.bWrite)
+				{
+					slot.writeAccess |= accessInfo.accessMask & WRITE_ACCESS_MASK;
+				}
+			}
+		}
+
+		mStatistics.imageBarrierCount += pass.imageBarrierCount;
+		if (pass.memoryBarrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE || pass.memoryBarrier.dstStageMask != VK_PIPELINE_STAGE_2_NONE)
+		{
+			mStatistics.memoryBarrierCount++;
+		}
+	}
+
+	mFirstFinalImageBarrier = static_cast<uint32_t>(mImageBarriers.size());
+
+	for (Resource& resource : mResources)
+	{
+		if (!resource.bImported || !resource.bImage || resource.finalAccess == ERenderGraphAccess::None)
+		{
+			continue;
+		}
+
+		const AccessInfo& accessInfo = GetAccessInfo(resource.finalAccess);
+
+		VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+		VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (TransitionState(resource.state, accessInfo, true, srcStages, srcAccess, oldLayout))
+		{
+			AddImageBarrier(resource, srcStages, srcAccess, oldLayout, accessInfo);
+			mStatistics.imageBarrierCount++;
+		}
+	}
+}
+
+bool RenderGraph::TransitionState(ResourceState& state, const AccessInfo& accessInfo, const bool bImage, VkPipelineStageFlags2& outSrcStages, VkAccessFlags2& outSrcAccess, VkImageLayout& outOldLayout)
+{
+	const bool bLayoutChange = bImage && state.layout != accessInfo.layout;
+
+	outOldLayout = state.layout;
+
+	if (accessInfo.bWrite || bLayoutChange)
+	{
+		// Writes and layout transitions wait for every earlier access, and flush earlier writes
+		outSrcStages = state.writeStages | state.readStages;
+		outSrcAccess = state.writeAccess;
+
+		const bool bNeedsBarrier = bLayoutChange || outSrcStages != VK_PIPELINE_STAGE_2_NONE;
+
+		// A transition is a write of its own that later reads in other stages have to wait for
+		state.layout = bImage ? accessInfo.layout : state.layout;
+		state.writeStages = accessInfo.stageMask;
+		state.writeAccess = accessInfo.bWrite ? (accessInfo.accessMask & WRITE_ACCESS_MASK) : VK_ACCESS_2_NONE;
+		state.readStages = accessInfo.bWrite ? VK_PIPELINE_STAGE_2_NONE : accessInfo.stageMask;
+		state.visibleStages = accessInfo.stageMask;
+		state.visibleAccess = accessInfo.accessMask;
+
+		return bNeedsBarrier;
+	}
+
+	// Read after read in the same layout needs nothing, read after write only when the write is not visible to it yet
+	bool bNeedsBarrier = false;
+	if (state.writeStages != VK_PIPELINE_STAGE_2_NONE && ((accessInfo.stageMask & ~state.visibleStages) != 0 || (accessInfo.accessMask & ~state.visibleAccess) != 0))
+	{
+		outSrcStages = state.writeStages;
+		outSrcAccess = state.writeAccess;
+		state.visibleStages |= accessInfo.stageMask;
+		state.visibleAccess |= accessInfo.accessMask;
+		bNeedsBarrier = true;
+	}
+
+	state.readStages |= accessInfo.stageMask;
+	return bNeedsBarrier;
+}
+
+void RenderGraph::AddImageBarrier(Resource& resource, const VkPipelineStageFlags2 srcStages, const VkAccessFlags2 srcAccess, const VkImageLayout oldLayout, const AccessInfo& accessInfo)
+{
+	VkImageMemoryBarrier2& barrier = mImageBarriers.emplace_back();
+	barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = srcStages;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = accessInfo.stageMask;
+	barrier.dstAccessMask = accessInfo.accessMask;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = accessInfo.layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = resource.image;
+	barrier.subresourceRange = resource.range;
+}
+
+void RenderGraph::RetireSlotAllocation(MemorySlot& slot)
+{
+	if (!slot.allocation.IsValid())
+	{
+		return;
+	}
+
+	GetCurrentGarbage().allocations.push_back(slot.allocation);
+	slot.allocation = {};
+	slot.generation++;
+
+	// Fresh memory has no history to wait for
+	slot.stages = VK_PIPELINE_STAGE_2_NONE;
+	slot.writeAccess = VK_ACCESS_2_NONE;
+}
+
+RenderGraph::Garbage& RenderGraph::GetCurrentGarbage()
+{
+	if (mGarbage.empty() || mGarbage.back().frameNumber != mFrameNumber)
+	{
+		mGarbage.emplace_back().frameNumber = mFrameNumber;
+	}
+	return mGarbage.back();
+}
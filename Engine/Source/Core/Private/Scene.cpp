@@ -2,43 +2,134 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <bit>
 #include <format>
 
 uint32_t componentCounter = 0;
+uint32_t eventTypeCounter = 0;
+
+Scene::Scene()
+    : mEntityIds(MAX_ENTITIES, CreateEntityId(INVALID_ENTITY_INDEX, 0))
+    , mEntityMasks(MAX_ENTITIES, 0)
+{
+}
 
 EntityID Scene::CreateEntity()
 {
-    assert(!mFreeEntities.empty() || mEntities.size() < MAX_ENTITIES);
-    if (!mFreeEntities.empty())
-    {
-        EntityIndex freeIndex = mFreeEntities.back();
-        mFreeEntities.pop_back();
-        return mEntities[freeIndex].id = CreateEntityId(freeIndex, GetEntityVersion(mEntities[freeIndex].id));
-    }
-    
-    mEntities.push_back({CreateEntityId(static_cast<EntityIndex>(mEntities.size()), 0), ComponentMask()});
-    return mEntities.back().id;
+    const EntityID id = mEntityAllocator.Allocate();
+    assert(IsEntityValid(id));
+
+    return mEntityIds[GetEntityIndex(id)] = id;
 }
 
 void Scene::DestroyEntity(EntityID id)
 {
-    if (mEntities[GetEntityIndex(id)].id != id)
+    const EntityIndex entityIdx = GetEntityIndex(id);
+
+    if (mEntityIds[entityIdx] != id)
     {
         return;
     }
     
-    for (ComponentPool* pPool : mComponentPools)
+    // Only visit the pools the mask says hold a component for this entity
+    for (PackedComponentMask mask = mEntityMasks[entityIdx]; mask != 0; mask &= mask - 1)
     {
-        if (pPool)
-        {
-            pPool->FreeComponent(id);
-        }
+        mComponentPools[std::countr_zero(mask)]->FreeComponent(id);
     }
     
-    mEntities[GetEntityIndex(id)].id = CreateEntityId(static_cast<EntityIndex>(-1), GetEntityVersion(id) + 1);
-    mEntities[GetEntityIndex(id)].mask.reset();
+    mQueries.Update(id, mEntityMasks[entityIdx], 0);
+
+    mEntityIds[entityIdx] = CreateEntityId(INVALID_ENTITY_INDEX, GetEntityVersion(id) + 1);
+    mEntityMasks[entityIdx] = 0;
     
-    mFreeEntities.push_back(GetEntityIndex(id));
+    mEntityAllocator.Free(id);
+}
+
+void Scene::DestroyEntities(const ComponentMask requiredMask, const ComponentMask excludedMask)
+{
+    ForEachMatchingBatch(requiredMask, excludedMask, [this](const std::span<const EntityID> ids)
+    {
+        for (const EntityID id : ids)
+        {
+            DestroyEntity(id);
+        }
+    });
+}
+
+QueryID Scene::RegisterQuery(const ComponentMask requiredMask, const ComponentMask excludedMask)
+{
+    const QueryID queryId = mQueries.Register(PackComponentMask(requiredMask), PackComponentMask(excludedMask));
+
+    ForEachMatchingBatch(requiredMask, excludedMask, [this, queryId](const std::span<const EntityID> ids)
+    {
+        for (const EntityID id : ids)
+        {
+            mQueries.AddInitialMatch(queryId, id);
+        }
+    });
+
+    return queryId;
+}
+
+void Scene::SwapComponentBuffers()
+{
+    for (ComponentPool* pool : mDoubleBufferedPools)
+    {
+        pool->SwapBuffers();
+    }
+}
+
+PrefabID Scene::RegisterPrefab(Prefab prefab)
+{
+    mPrefabs.push_back(std::move(prefab));
+    return static_cast<PrefabID>(mPrefabs.size() - 1);
+}
+
+void Scene::InstantiatePrefab(const PrefabID prefabId, const std::span<EntityID> outIds)
+{
+    assert(prefabId < mPrefabs.size());
+    const Prefab& prefab = mPrefabs[prefabId];
+
+    for (EntityID& id : outIds)
+    {
+        id = mEntityAllocator.Allocate();
+        assert(IsEntityValid(id));
+
+        mEntityIds[GetEntityIndex(id)] = id;
+        mEntityMasks[GetEntityIndex(id)] = PackComponentMask(prefab.mMask);
+
+        mQueries.Update(id, 0, PackComponentMask(prefab.mMask));
+    }
+
+    for (const Prefab::ComponentTemplate& component : prefab.mComponents)
+    {
+        ComponentPool* pool = GetOrCreatePool(component.componentId, component.componentSize);
+
+        uint32_t numStamped = 0;
+        while (numStamped < outIds.size())
+        {
+            numStamped += pool->StampComponents(outIds.data() + numStamped, static_cast<uint32_t>(outIds.size()) - numStamped, component.stamp.data());
+        }
+    }
+}
+
+Scene::ComponentPool* Scene::GetOrCreatePool(const uint32_t componentId, const size_t componentSize)
+{
+    if(mComponentPools.size() <= componentId)
+    {
+        mComponentPools.resize(componentId + 1, nullptr);
+    }
+
+    if(mComponentPools[componentId] == nullptr)
+    {
+        mComponentPools[componentId] = new ComponentPool(componentSize);
+    }
+
+    assert(mComponentPools[componentId]->componentSize == componentSize);
+
+    return mComponentPools[componentId];
 }
 
 Scene::ComponentPoolChunk::ComponentPoolChunk(ComponentPoolChunk&& Other) noexcept
@@ -50,6 +141,9 @@ Scene::ComponentPoolChunk::ComponentPoolChunk(ComponentPoolChunk&& Other) noexce
     delete[] pData;
     pData = Other.pData;
     Other.pData = nullptr;
+    delete[] pBackData;
+    pBackData = Other.pBackData;
+    Other.pBackData = nullptr;
 }
 
 Scene::ComponentPoolChunk& Scene::ComponentPoolChunk::operator=(ComponentPoolChunk&& Other) noexcept
@@ -61,15 +155,22 @@ Scene::ComponentPoolChunk& Scene::ComponentPoolChunk::operator=(ComponentPoolChu
     delete[] pData;
     pData = Other.pData;
     Other.pData = nullptr;
+    delete[] pBackData;
+    pBackData = Other.pBackData;
+    Other.pBackData = nullptr;
     return *this;
 }
 
-Scene::ComponentPoolChunk::ComponentPoolChunk(size_t inComponentSize)
+Scene::ComponentPoolChunk::ComponentPoolChunk(size_t inComponentSize, bool bDoubleBuffered)
 {
     componentSize = inComponentSize;
     freeComponents.set();
-    // This EntityID at the end will store the sparse array id
+    // Components are packed at the front and followed by one EntityID per slot storing the owning entity
     pData = new uint8_t[(componentSize + sizeof(EntityID)) * NUM_COMPONENTS_PER_CHUNK];
+    if (bDoubleBuffered)
+    {
+        pBackData = new uint8_t[componentSize * NUM_COMPONENTS_PER_CHUNK];
+    }
 }
 
 Scene::ComponentPoolChunk::~ComponentPoolChunk()
@@ -77,6 +178,8 @@ Scene::ComponentPoolChunk::~ComponentPoolChunk()
     componentSize = 0;
     delete[] pData;
     pData = nullptr;
+    delete[] pBackData;
+    pBackData = nullptr;
 }
 
 uint32_t Scene::ComponentPoolChunk::AllocateComponent(const EntityID id)
@@ -90,10 +193,29 @@ uint32_t Scene::ComponentPoolChunk::AllocateComponent(const EntityID id)
         firstFreeIndex++;
     }
     freeComponents.reset(firstFreeIndex);
-    EntityID* idPtr = reinterpret_cast<EntityID*>(pData + firstFreeIndex * (componentSize + sizeof(EntityID)) + componentSize);
-    *idPtr = id; 
+    GetEntityIds()[firstFreeIndex] = id;
     return firstFreeIndex;
-    return 0;
+}
+
+uint32_t Scene::ComponentPoolChunk::AllocateComponentRun(const EntityID* ids, const uint32_t maxCount, uint32_t& outFirstIndex)
+{
+    assert(freeComponents.any());
+    assert(IsValid());
+
+    static_assert(NUM_COMPONENTS_PER_CHUNK == 64, "Free slot scan assumes the bitset fits in a single word");
+    const uint64_t freeBits = freeComponents.to_ullong();
+
+    outFirstIndex = std::countr_zero(freeBits);
+    const uint32_t runLength = std::min<uint32_t>(std::countr_one(freeBits >> outFirstIndex), maxCount);
+
+    EntityID* entityIds = GetEntityIds();
+    for (uint32_t i = 0; i < runLength; ++i)
+    {
+        freeComponents.reset(outFirstIndex + i);
+        entityIds[outFirstIndex + i] = ids[i];
+    }
+
+    return runLength;
 }
 
 void Scene::ComponentPoolChunk::FreeComponent(const uint32_t index)
@@ -105,20 +227,20 @@ void Scene::ComponentPoolChunk::FreeComponent(const uint32_t index)
     freeComponents.set(index);
 }
 
-void* Scene::ComponentPoolChunk::GetComponent(const uint32_t index) const
+void* Scene::ComponentPoolChunk::GetComponent(const uint32_t index, const uint32_t bufferIdx) const
 {
     assert(index < NUM_COMPONENTS_PER_CHUNK);
     assert(!freeComponents.test(index));
     assert(IsValid());
+    assert(bufferIdx == 0 || pBackData != nullptr);
 
-    return pData + index * (componentSize + sizeof(EntityID));
+    return (bufferIdx == 0 ? pData : pBackData) + index * componentSize;
 }
 
 EntityID Scene::ComponentPoolChunk::GetEntityId(const uint32_t idx) const
 {
     assert(!freeComponents.test(idx));
-    const EntityID* pId = reinterpret_cast<EntityID*>(pData + idx * (componentSize + sizeof(EntityID)) + componentSize);
-    return *pId;
+    return GetEntityIds()[idx];
 }
 
 Scene::ComponentPool::ComponentPool(size_t inComponentSize)
@@ -138,7 +260,7 @@ void* Scene::ComponentPool::GetOrCreateComponent(const EntityID id)
         {
             if(!chunks[chunkIdx].IsValid())
             {
-                chunks[chunkIdx] = ComponentPoolChunk(componentSize);
+                chunks[chunkIdx] = ComponentPoolChunk(componentSize, bDoubleBuffered);
             }
 
             if(chunks[chunkIdx].IsValid() && !chunks[chunkIdx].IsFull())
@@ -146,7 +268,14 @@ void* Scene::ComponentPool::GetOrCreateComponent(const EntityID id)
                 const uint32_t innerIdx = chunks[chunkIdx].AllocateComponent(id);
                 // 0 is our null value so we store the actual idx + 1
                 sparseMap[entityIdx] = innerIdx + chunkIdx * NUM_COMPONENTS_PER_CHUNK + 1;
-                return chunks[chunkIdx].GetComponent(innerIdx);
+                if (bDoubleBuffered)
+                {
+                    // Readers may see this component before the next swap, so don't leave the current copy uninitialized
+                    std::memset(chunks[chunkIdx].GetComponent(innerIdx, 1), 0, componentSize);
+                    std::memset(chunks[chunkIdx].GetComponent(innerIdx, 0), 0, componentSize);
+                }
+                // The caller initializes the new component, so it is written like any other
+                return GetWriteComponent(id);
             }
         }
 
@@ -155,10 +284,10 @@ void* Scene::ComponentPool::GetOrCreateComponent(const EntityID id)
         {
             if(!chunks[chunkIdx].IsValid())
             {
-                new(&chunks[chunkIdx]) ComponentPoolChunk(componentSize);
+                new(&chunks[chunkIdx]) ComponentPoolChunk(componentSize, bDoubleBuffered);
                 const uint32_t innerIdx = chunks[chunkIdx].AllocateComponent(id);
                 sparseMap[entityIdx] = innerIdx + chunkIdx * NUM_COMPONENTS_PER_CHUNK + 1;
-                return chunks[chunkIdx].GetComponent(innerIdx);
+                return GetWriteComponent(id);
             }
         }
 
@@ -171,12 +300,122 @@ void* Scene::ComponentPool::GetOrCreateComponent(const EntityID id)
         const uint32_t chunkIdx = (sparseMap[entityIdx] - 1) / NUM_COMPONENTS_PER_CHUNK;
         const uint32_t innerIdx = (sparseMap[entityIdx] - 1) % NUM_COMPONENTS_PER_CHUNK;
 
-        assert(chunks[chunkIdx].GetEntityId(innerIdx) == id);
-        
-        return chunks[chunkIdx].GetComponent(innerIdx);
+        return GetWriteComponent(id);
+    }
+}
+
+void* Scene::ComponentPool::GetComponent(const EntityID id) const
+{
+    const EntityIndex entityIdx = GetEntityIndex(id);
+
+    assert(entityIdx < MAX_ENTITIES);
+
+    if (sparseMap[entityIdx] == 0)
+    {
+        return nullptr;
+    }
+
+    const uint32_t chunkIdx = (sparseMap[entityIdx] - 1) / NUM_COMPONENTS_PER_CHUNK;
+    const uint32_t innerIdx = (sparseMap[entityIdx] - 1) % NUM_COMPONENTS_PER_CHUNK;
+
+    assert(chunks[chunkIdx].GetEntityId(innerIdx) == id);
+
+    return chunks[chunkIdx].GetComponent(innerIdx, bDoubleBuffered ? writeBufferIdx ^ 1 : 0);
+}
+
+void* Scene::ComponentPool::GetWriteComponent(const EntityID id)
+{
+    const EntityIndex entityIdx = GetEntityIndex(id);
+
+    assert(entityIdx < MAX_ENTITIES);
+
+    if (sparseMap[entityIdx] == 0)
+    {
+        return nullptr;
+    }
+
+    const uint32_t chunkIdx = (sparseMap[entityIdx] - 1) / NUM_COMPONENTS_PER_CHUNK;
+    const uint32_t innerIdx = (sparseMap[entityIdx] - 1) % NUM_COMPONENTS_PER_CHUNK;
+
+    assert(chunks[chunkIdx].GetEntityId(innerIdx) == id);
+
+    if (bDoubleBuffered)
+    {
+        writtenChunks.Mark(chunkIdx);
+    }
+    return chunks[chunkIdx].GetComponent(innerIdx, writeBufferIdx);
+}
+
+void Scene::ComponentPool::EnableDoubleBuffering()
+{
+    assert(!bDoubleBuffered);
+    bDoubleBuffered = true;
+
+    for (ComponentPoolChunk& chunk : chunks)
+    {
+        if (chunk.IsValid())
+        {
+            chunk.pBackData = new uint8_t[componentSize * NUM_COMPONENTS_PER_CHUNK];
+            std::memcpy(chunk.pBackData, chunk.pData, componentSize * NUM_COMPONENTS_PER_CHUNK);
+        }
     }
 }
 
+void Scene::ComponentPool::SwapBuffers()
+{
+    writeBufferIdx ^= 1;
+
+    // Chunks nobody wrote still hold the same values in both copies, the written ones get this frame's values carried over
+    writtenChunks.ConsumeMarked([this](const uint32_t chunkIdx)
+    {
+        ComponentPoolChunk& chunk = chunks[chunkIdx];
+        if (chunk.IsValid())
+        {
+            uint8_t* pWrite = writeBufferIdx == 0 ? chunk.pData : chunk.pBackData;
+            const uint8_t* pRead = writeBufferIdx == 0 ? chunk.pBackData : chunk.pData;
+            std::memcpy(pWrite, pRead, componentSize * NUM_COMPONENTS_PER_CHUNK);
+        }
+    });
+}
+
+uint32_t Scene::ComponentPool::StampComponents(const EntityID* ids, const uint32_t count, const uint8_t* stamp)
+{
+    for(uint32_t chunkIdx = 0; chunkIdx < NUM_CHUNKS_PER_POOL; ++chunkIdx)
+    {
+        if(!chunks[chunkIdx].IsValid())
+        {
+            chunks[chunkIdx] = ComponentPoolChunk(componentSize, bDoubleBuffered);
+        }
+
+        if(chunks[chunkIdx].IsFull())
+        {
+            continue;
+        }
+
+        uint32_t firstIdx = 0;
+        const uint32_t runLength = chunks[chunkIdx].AllocateComponentRun(ids, count, firstIdx);
+
+        // The stamp holds a full chunk worth of values so the whole run is covered by one copy
+        std::memcpy(chunks[chunkIdx].GetComponent(firstIdx), stamp, runLength * componentSize);
+        if (bDoubleBuffered)
+        {
+            std::memcpy(chunks[chunkIdx].GetComponent(firstIdx, 1), stamp, runLength * componentSize);
+        }
+
+        for (uint32_t i = 0; i < runLength; ++i)
+        {
+            assert(sparseMap[GetEntityIndex(ids[i])] == 0);
+            sparseMap[GetEntityIndex(ids[i])] = firstIdx + i + chunkIdx * NUM_COMPONENTS_PER_CHUNK + 1;
+        }
+
+        return runLength;
+    }
+
+    // We ran out of chunk space?
+    assert(false);
+    return count;
+}
+
 void Scene::ComponentPool::FreeComponent(const EntityID id)
 {
     const EntityIndex entityIdx = GetEntityIndex(id);
@@ -209,12 +448,17 @@ void Scene::ComponentPool::FreeComponent(const EntityID id)
             if(chunks[i].IsValid())
             {
                 chunks[chunkIdx] = std::move(chunks[i]);
+                if (bDoubleBuffered)
+                {
+                    // The moved chunk may have been written this frame, carrying it forward again is harmless
+                    writtenChunks.Mark(chunkIdx);
+                }
                 // Update the sparse map to point to the correct chunk
                 for(uint32_t j = 0; j < NUM_COMPONENTS_PER_CHUNK; ++j)
                 {
                     if(!chunks[chunkIdx].freeComponents.test(j))
                     {
-                        sparseMap[chunks[chunkIdx].GetEntityId(j)] = chunkIdx * NUM_COMPONENTS_PER_CHUNK + j;
+                        sparseMap[GetEntityIndex(chunks[chunkIdx].GetEntityId(j))] = chunkIdx * NUM_COMPONENTS_PER_CHUNK + j + 1;
                     }
                 }
                 break;
@@ -254,8 +498,10 @@ void Scene::ComponentPool::DebugPrintState() const
 void Scene::DebugPrintState() const
 {
     std::cout << "Entities: \n";
-    for (auto [id, mask] : mEntities)
+    for (uint32_t entityIdx = 0; entityIdx < mEntityAllocator.GetHighWaterMark(); ++entityIdx)
     {
+        const EntityID id = mEntityIds[entityIdx];
+        const ComponentMask mask(mEntityMasks[entityIdx]);
         std::cout << "\t" << GetEntityIndex(id) << ", " << GetEntityVersion(id) << "\n";
         std::cout << "\t\t";
         for (uint32_t j = 0; j < mask.size(); ++j)
@@ -265,12 +511,6 @@ void Scene::DebugPrintState() const
         std::cout << "\n";
     }
 
-    std::cout << "Free Entities: \n";
-    for (EntityIndex entityIdx : mFreeEntities)
-    {
-        std::cout << "\t" << entityIdx << "\n";
-    }
-
     for (uint32_t i = 0; i < mComponentPools.size(); ++i)
     {
         if (mComponentPools[i])
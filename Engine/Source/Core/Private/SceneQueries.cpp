@@ -0,0 +1,54 @@
+#include "SceneQueries.h"
+
+#include <cassert>
+
+QueryID SceneQueries::Register(const PackedComponentMask requiredMask, const PackedComponentMask excludedMask)
+{
+	// An empty required mask would match freshly created entities, which CreateEntity does not report so it can stay lock free
+	assert(requiredMask != 0);
+
+	CachedQuery& query = mQueries.emplace_back();
+	query.requiredMask = requiredMask;
+	query.excludedMask = excludedMask;
+	query.denseIndices.resize(MAX_ENTITIES, 0);
+
+	return static_cast<QueryID>(mQueries.size() - 1);
+}
+
+void SceneQueries::AddInitialMatch(const QueryID queryId, const EntityID id)
+{
+	CachedQuery& query = mQueries[queryId];
+	assert(query.denseIndices[GetEntityIndex(id)] == 0);
+
+	query.entities.push_back(id);
+	query.denseIndices[GetEntityIndex(id)] = static_cast<uint32_t>(query.entities.size());
+}
+
+void SceneQueries::Update(const EntityID id, const PackedComponentMask oldMask, const PackedComponentMask newMask)
+{
+	const EntityIndex entityIdx = GetEntityIndex(id);
+
+	for (CachedQuery& query : mQueries)
+	{
+		const bool bMatched = query.Matches(oldMask);
+		const bool bMatches = query.Matches(newMask);
+
+		if (bMatches && !bMatched)
+		{
+			query.entities.push_back(id);
+			query.denseIndices[entityIdx] = static_cast<uint32_t>(query.entities.size());
+		}
+		else if (bMatched && !bMatches)
+		{
+			// Swap the last match into the hole so the list stays dense
+			const uint32_t denseIdx = query.denseIndices[entityIdx] - 1;
+			const EntityID lastId = query.entities.back();
+
+			query.entities[denseIdx] = lastId;
+			query.denseIndices[GetEntityIndex(lastId)] = denseIdx + 1;
+
+			query.entities.pop_back();
+			query.denseIndices[entityIdx] = 0;
+		}
+	}
+}
@@ -0,0 +1,279 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+void StagingRing::Init(const VkPhysicalDevice physicalDevice, const VkDevice device, DeviceMemoryAllocator& allocator, const VkDeviceSize capacity)
+{
+	assert(mDevice == VK_NULL_HANDLE);
+
+	mDevice = device;
+	mAllocator = &allocator;
+	mCapacity = capacity;
+
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	// 16 keeps every offset valid for block compressed image copies as well
+	mCopyAlignment = std::max<VkDeviceSize>(deviceProperties.limits.optimalBufferCopyOffsetAlignment, 16);
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = capacity;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult bufferResult = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &mRingBuffer);
+	VK_CHECK(bufferResult, "Failed to create staging ring buffer: {}");
+
+	mRingAllocation = mAllocator->AllocateForBuffer(mRingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	assert(mRingAllocation.pMapped != nullptr);
+}
+
+void StagingRing::Shutdown()
+{
+	for (FrameRetirement& retirement : mRetirements)
+	{
+		mTemporaryBuffers.insert(mTemporaryBuffers.end(), retirement.temporaryBuffers.begin(), retirement.temporaryBuffers.end());
+	}
+	mRetirements.clear();
+
+	for (TemporaryBuffer& temporaryBuffer : mTemporaryBuffers)
+	{
+		vkDestroyBuffer(mDevice, temporaryBuffer.buffer, nullptr);
+		mAllocator->Free(temporaryBuffer.allocation);
+	}
+	mTemporaryBuffers.clear();
+
+	vkDestroyBuffer(mDevice, mRingBuffer, nullptr);
+	mAllocator->Free(mRingAllocation);
+	mRingBuffer = VK_NULL_HANDLE;
+
+	mPendingBufferCopies.clear();
+	mPendingImageCopies.clear();
+	mPendingImageRegions.clear();
+
+	mDevice = VK_NULL_HANDLE;
+}
+
+void StagingRing::BeginFrame(const uint64_t completedFrameNumber)
+{
+	while (!mRetirements.empty() && mRetirements.front().frameNumber <= completedFrameNumber)
+	{
+		FrameRetirement& retirement = mRetirements.front();
+
+		mRingTail = retirement.ringHead;
+
+		for (TemporaryBuffer& temporaryBuffer : retirement.temporaryBuffers)
+		{
+			vkDestroyBuffer(mDevice, temporaryBuffer.buffer, nullptr);
+			mAllocator->Free(temporaryBuffer.allocation);
+		}
+
+		mRetirements.pop_front();
+	}
+}
+
+void StagingRing::EnqueueBufferCopy(const VkBuffer dstBuffer, const VkDeviceSize dstOffset, const void* pData, const VkDeviceSize size)
+{
+	const StagedRange staged = Stage(pData, size);
+
+	PendingBufferCopy& copy = mPendingBufferCopies.emplace_back();
+	copy.srcBuffer = staged.buffer;
+	copy.dstBuffer = dstBuffer;
+	copy.region.srcOffset = staged.offset;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+}
+
+void StagingRing::EnqueueImageCopy(const VkImage dstImage, const VkImageSubresourceRange& range, const std::span<const VkBufferImageCopy> regions, const void* pData, const VkDeviceSize size)
+{
+	const StagedRange staged = Stage(pData, size);
+
+	PendingImageCopy& copy = mPendingImageCopies.emplace_back();
+	copy.srcBuffer = staged.buffer;
+	copy.dstImage = dstImage;
+	copy.range = range;
+	copy.firstRegion = static_cast<uint32_t>(mPendingImageRegions.size());
+	copy.regionCount = static_cast<uint32_t>(regions.size());
+
+	for (const VkBufferImageCopy& region : regions)
+	{
+		VkBufferImageCopy& stagedRegion = mPendingImageRegions.emplace_back(region);
+		stagedRegion.bufferOffset += staged.offset;
+	}
+}
+
+void StagingRing::Flush(const VkCommandBuffer commandBuffer, const uint64_t frameNumber)
+{
+	if (HasPendingCopies())
+	{
+		const bool bCopiedBuffers = !mPendingBufferCopies.empty();
+
+		RecordCopies(commandBuffer, mScratchBufferBarriers, mScratchImageBarriers);
+
+		for (VkImageMemoryBarrier& barrier : mScratchImageBarriers)
+		{
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		}
+
+		// One global barrier is cheaper than one per buffer
+		VkMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			bCopiedBuffers ? 1 : 0,
+			&bufferBarrier,
+			0,
+			nullptr,
+			static_cast<uint32_t>(mScratchImageBarriers.size()),
+			mScratchImageBarriers.data()
+		);
+	}
+
+	Retire(frameNumber);
+}
+
+void StagingRing::RecordCopies(const VkCommandBuffer commandBuffer, std::vector<VkBufferMemoryBarrier>& outBufferBarriers, std::vector<VkImageMemoryBarrier>& outImageBarriers)
+{
+	outBufferBarriers.clear();
+	outImageBarriers.clear();
+
+	if (!HasPendingCopies())
+	{
+		return;
+	}
+
+	outImageBarriers.resize(mPendingImageCopies.size());
+	for (size_t i = 0; i < mPendingImageCopies.size(); i++)
+	{
+		VkImageMemoryBarrier& barrier = outImageBarriers[i];
+		barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_NONE;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = mPendingImageCopies[i].dstImage;
+		barrier.subresourceRange = mPendingImageCopies[i].range;
+	}
+
+	if (!outImageBarriers.empty())
+	{
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(outImageBarriers.size()), outImageBarriers.data());
+	}
+
+	// Copies between the same pair of buffers go out as one command
+	for (size_t first = 0; first < mPendingBufferCopies.size();)
+	{
+		const PendingBufferCopy& firstCopy = mPendingBufferCopies[first];
+
+		mScratchBufferRegions.clear();
+		size_t last = first;
+		while (last < mPendingBufferCopies.size() && mPendingBufferCopies[last].srcBuffer == firstCopy.srcBuffer && mPendingBufferCopies[last].dstBuffer == firstCopy.dstBuffer)
+		{
+			mScratchBufferRegions.push_back(mPendingBufferCopies[last].region);
+			++last;
+		}
+
+		vkCmdCopyBuffer(commandBuffer, firstCopy.srcBuffer, firstCopy.dstBuffer, static_cast<uint32_t>(mScratchBufferRegions.size()), mScratchBufferRegions.data());
+		first = last;
+	}
+
+	for (const PendingImageCopy& copy : mPendingImageCopies)
+	{
+		vkCmdCopyBufferToImage(commandBuffer, copy.srcBuffer, copy.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.regionCount, &mPendingImageRegions[copy.firstRegion]);
+	}
+
+	outBufferBarriers.resize(mPendingBufferCopies.size());
+	for (size_t i = 0; i < mPendingBufferCopies.size(); i++)
+	{
+		VkBufferMemoryBarrier& barrier = outBufferBarriers[i];
+		barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_NONE;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = mPendingBufferCopies[i].dstBuffer;
+		barrier.offset = mPendingBufferCopies[i].region.dstOffset;
+		barrier.size = mPendingBufferCopies[i].region.size;
+	}
+
+	for (VkImageMemoryBarrier& barrier : outImageBarriers)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_NONE;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
+	mPendingBufferCopies.clear();
+	mPendingImageCopies.clear();
+	mPendingImageRegions.clear();
+}
+
+void StagingRing::Retire(const uint64_t frameNumber)
+{
+	assert(!HasPendingCopies());
+	assert(mRetirements.empty() || mRetirements.back().frameNumber <= frameNumber);
+
+	const uint64_t lastRetiredHead = mRetirements.empty() ? mRingTail : mRetirements.back().ringHead;
+	if (mRingHead != lastRetiredHead || !mTemporaryBuffers.empty())
+	{
+		FrameRetirement& retirement = mRetirements.emplace_back();
+		retirement.frameNumber = frameNumber;
+		retirement.ringHead = mRingHead;
+		retirement.temporaryBuffers = std::move(mTemporaryBuffers);
+		mTemporaryBuffers.clear();
+	}
+}
+
+StagingRing::StagedRange StagingRing::Stage(const void* pData, const VkDeviceSize size)
+{
+	assert(mDevice != VK_NULL_HANDLE);
+
+	const uint64_t ringOffset = mRingHead % mCapacity;
+	uint64_t alignedOffset = (ringOffset + mCopyAlignment - 1) / mCopyAlignment * mCopyAlignment;
+	uint64_t padding = alignedOffset - ringOffset;
+
+	// Never split an upload across the end of the ring, skip to the start instead
+	if (alignedOffset + size > mCapacity)
+	{
+		padding = mCapacity - ringOffset;
+		alignedOffset = 0;
+	}
+
+	if (size <= mCapacity && mRingHead + padding + size - mRingTail <= mCapacity)
+	{
+		mRingHead += padding + size;
+
+		std::memcpy(static_cast<uint8_t*>(mRingAllocation.pMapped) + alignedOffset, pData, size);
+		return {mRingBuffer, alignedOffset};
+	}
+
+	// The ring is full or the upload is bigger than the whole ring, give it a buffer of its own rather than wait
+	TemporaryBuffer& temporaryBuffer = mTemporaryBuffers.emplace_back();
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult bufferResult = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &temporaryBuffer.buffer);
+	VK_CHECK(bufferResult, "Failed to create temporary staging buffer: {}");
+
+	temporaryBuffer.allocation = mAllocator->AllocateForBuffer(temporaryBuffer.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	std::memcpy(temporaryBuffer.allocation.pMapped, pData, size);
+	return {temporaryBuffer.buffer, 0};
+}
@@ -0,0 +1,718 @@
+#include "Texture.h"
+
+#include "Threading.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	struct TextureFormatInfo
+	{
+		const char* name;
+		VkFormat unormFormat;
+		VkFormat srgbFormat;
+		uint32_t blockExtent;
+		uint32_t blockBytes;
+	};
+
+	constexpr std::array<TextureFormatInfo, static_cast<size_t>(ETextureFormat::Count)> TEXTURE_FORMAT_INFOS =
+	{{
+		{"RGBA8", VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, 1, 4},
+		// The RGB variant, BC1 is only chosen for opaque textures and its punch through alpha mode is never encoded
+		{"BC1", VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK, 4, 8},
+		{"BC3", VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, 4, 16},
+		{"BC7", VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, 4, 16},
+	}};
+
+	const TextureFormatInfo& GetFormatInfo(const ETextureFormat format)
+	{
+		assert(format < ETextureFormat::Count);
+		return TEXTURE_FORMAT_INFOS[static_cast<size_t>(format)];
+	}
+
+	float SRGBToLinear(const uint8_t value)
+	{
+		static const std::array<float, 256> table = []()
+		{
+			std::array<float, 256> result;
+			for (uint32_t valueIdx = 0; valueIdx < 256; valueIdx++)
+			{
+				const float encoded = static_cast<float>(valueIdx) / 255.f;
+				result[valueIdx] = encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+			}
+			return result;
+		}();
+		return table[value];
+	}
+
+	uint8_t LinearToSRGB(const float value)
+	{
+		const float clamped = std::clamp(value, 0.f, 1.f);
+		const float encoded = clamped <= 0.0031308f ? clamped * 12.92f : 1.055f * std::pow(clamped, 1.f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(encoded * 255.f + 0.5f);
+	}
+
+	uint8_t FloatToUnorm8(const float value)
+	{
+		return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+	}
+
+	/// TEXTURE FILES
+
+	constexpr uint32_t TEXTURE_FILE_MAGIC = 0x58544646; // "FFTX"
+	constexpr uint32_t TEXTURE_FILE_VERSION = 1;
+	constexpr uint32_t TEXTURE_FILE_FLAG_SRGB = 1;
+
+	// Staging copies into block compressed images need offsets aligned to the 16 byte blocks
+	constexpr uint64_t TEXTURE_FILE_ALIGNMENT = 16;
+
+	// Little endian, no padding
+	struct TextureFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t format;
+		uint32_t flags;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipCount;
+		uint32_t reserved;
+		// From the start of the file
+		uint64_t payloadOffset;
+		uint64_t payloadSize;
+	};
+	static_assert(sizeof(TextureFileHeader) == 48);
+
+	struct TextureFileMip
+	{
+		uint32_t width;
+		uint32_t height;
+		// From the start of the payload
+		uint64_t offset;
+		uint64_t size;
+	};
+	static_assert(sizeof(TextureFileMip) == 24);
+
+	uint64_t AlignTextureFileOffset(const uint64_t offset)
+	{
+		return (offset + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+	}
+
+	/// BLOCK COMPRESSION
+
+	// 16 texels of a 4x4 block, row by row, 4 bytes each
+	typedef std::array<uint8_t, 16 * 4> BlockTexels;
+
+	void GatherBlock(const uint8_t* pMip, const uint32_t width, const uint32_t height, const uint32_t blockX, const uint32_t blockY, BlockTexels& outTexels)
+	{
+		// Blocks hanging over the edge of small or odd sized mips repeat the edge texels, the GPU never samples those
+		for (uint32_t y = 0; y < 4; y++)
+		{
+			const uint32_t srcY = std::min(blockY * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++)
+			{
+				const uint32_t srcX = std::min(blockX * 4 + x, width - 1);
+				std::memcpy(&outTexels[(y * 4 + x) * 4], &pMip[(srcY * width + srcX) * 4], 4);
+			}
+		}
+	}
+
+	uint16_t PackRGB565(const float color[3])
+	{
+		const uint32_t r = static_cast<uint32_t>(std::clamp(color[0], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+		const uint32_t g = static_cast<uint32_t>(std::clamp(color[1], 0.f, 255.f) * 63.f / 255.f + 0.5f);
+		const uint32_t b = static_cast<uint32_t>(std::clamp(color[2], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void UnpackRGB565(const uint16_t packed, int32_t outColor[3])
+	{
+		const int32_t r = (packed >> 11) & 31;
+		const int32_t g = (packed >> 5) & 63;
+		const int32_t b = packed & 31;
+		outColor[0] = (r << 3) | (r >> 2);
+		outColor[1] = (g << 2) | (g >> 4);
+		outColor[2] = (b << 3) | (b >> 2);
+	}
+
+	/**
+	 * Pick the nearest of the four colors between the two endpoints for every texel
+	 * @return The 2 bit indices, texel 0 in the lowest bits
+	 */
+	uint32_t FindColorIndices(const BlockTexels& texels, const uint16_t color0, const uint16_t color1)
+	{
+		int32_t palette[4][3];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+		for (uint32_t channel = 0; channel < 3; channel++)
+		{
+			palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+			palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+		}
+
+		uint32_t indices = 0;
+		for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+		{
+			const uint8_t* pTexel = &texels[texelIdx * 4];
+
+			uint32_t bestIdx = 0;
+			int32_t bestError = INT32_MAX;
+			for (uint32_t paletteIdx = 0; paletteIdx < 4; paletteIdx++)
+			{
+				const int32_t dr = pTexel[0] - palette[paletteIdx][0];
+				const int32_t dg = pTexel[1] - palette[paletteIdx][1];
+				const int32_t db = pTexel[2] - palette[paletteIdx][2];
+				const int32_t error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIdx = paletteIdx;
+				}
+			}
+			indices |= bestIdx << (texelIdx * 2);
+		}
+		return indices;
+	}
+
+	/**
+	 * Fit the endpoints to the texels' principal axis, then refine them by least squares against the chosen indices
+	 */
+	void EncodeColorBlock(const BlockTexels& texels, uint8_t* pOut)
+	{
+		float mean[3] = {0.f, 0.f, 0.f};
+		float minColor[3] = {255.f, 255.f, 255.f};
+		float maxColor[3] = {0.f, 0.f, 0.f};
+		for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+		{
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				const float value = texels[texelIdx * 4 + channel];
+				mean[channel] += value / 16.f;
+				minColor[channel] = std::min(minColor[channel], value);
+				maxColor[channel] = std::max(maxColor[channel], value);
+			}
+		}
+
+		// Covariance, xx xy xz yy yz zz
+		float covariance[6] = {};
+		for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+		{
+			const float r = texels[texelIdx * 4 + 0] - mean[0];
+			const float g = texels[texelIdx * 4 + 1] - mean[1];
+			const float b = texels[texelIdx * 4 + 2] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		// Power iteration towards the principal axis, starting from the bounding box diagonal
+		float axis[3] = {maxColor[0] - minColor[0], maxColor[1] - minColor[1], maxColor[2] - minColor[2]};
+		for (uint32_t iteration = 0; iteration < 8; iteration++)
+		{
+			const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			const float length = std::max({std::abs(x), std::abs(y), std::abs(z)});
+			if (length < 1e-6f)
+			{
+				break;
+			}
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		const float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+		float endpoint0[3] = {mean[0], mean[1], mean[2]};
+		float endpoint1[3] = {mean[0], mean[1], mean[2]};
+		if (axisLengthSquared > 1e-12f)
+		{
+			float minProjection = FLT_MAX;
+			float maxProjection = -FLT_MAX;
+			for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+			{
+				const float projection =
+					(texels[texelIdx * 4 + 0] - mean[0]) * axis[0] +
+					(texels[texelIdx * 4 + 1] - mean[1]) * axis[1] +
+					(texels[texelIdx * 4 + 2] - mean[2]) * axis[2];
+				minProjection = std::min(minProjection, projection);
+				maxProjection = std::max(maxProjection, projection);
+			}
+
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				endpoint0[channel] = mean[channel] + axis[channel] * maxProjection / axisLengthSquared;
+				endpoint1[channel] = mean[channel] + axis[channel] * minProjection / axisLengthSquared;
+			}
+		}
+
+		// Weights of the endpoints in each palette entry
+		constexpr float PALETTE_WEIGHTS[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+
+		for (uint32_t iteration = 0; iteration < 2; iteration++)
+		{
+			const uint32_t indices = FindColorIndices(texels, PackRGB565(endpoint0), PackRGB565(endpoint1));
+
+			float aa = 0.f, bb = 0.f, ab = 0.f;
+			float ax[3] = {}, bx[3] = {};
+			for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+			{
+				const float a = PALETTE_WEIGHTS[(indices >> (texelIdx * 2)) & 3];
+				const float b = 1.f - a;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (uint32_t channel = 0; channel < 3; channel++)
+				{
+					ax[channel] += a * texels[texelIdx * 4 + channel];
+					bx[channel] += b * texels[texelIdx * 4 + channel];
+				}
+			}
+
+			const float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) < 1e-6f)
+			{
+				break;
+			}
+
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				endpoint0[channel] = std::clamp((bb * ax[channel] - ab * bx[channel]) / determinant, 0.f, 255.f);
+				endpoint1[channel] = std::clamp((aa * bx[channel] - ab * ax[channel]) / determinant, 0.f, 255.f);
+			}
+		}
+
+		uint16_t color0 = PackRGB565(endpoint0);
+		uint16_t color1 = PackRGB565(endpoint1);
+
+		// color0 > color1 selects the four color mode, equal endpoints only need index 0
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+		const uint32_t indices = color0 == color1 ? 0 : FindColorIndices(texels, color0, color1);
+
+		pOut[0] = static_cast<uint8_t>(color0);
+		pOut[1] = static_cast<uint8_t>(color0 >> 8);
+		pOut[2] = static_cast<uint8_t>(color1);
+		pOut[3] = static_cast<uint8_t>(color1 >> 8);
+		std::memcpy(pOut + 4, &indices, sizeof(indices));
+	}
+
+	/**
+	 * The eight value mode between the block's minimum and maximum alpha
+	 */
+	void EncodeAlphaBlock(const BlockTexels& texels, uint8_t* pOut)
+	{
+		uint8_t minAlpha = 255;
+		uint8_t maxAlpha = 0;
+		for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+		{
+			minAlpha = std::min(minAlpha, texels[texelIdx * 4 + 3]);
+			maxAlpha = std::max(maxAlpha, texels[texelIdx * 4 + 3]);
+		}
+
+		pOut[0] = maxAlpha;
+		pOut[1] = minAlpha;
+
+		uint64_t indices = 0;
+		if (maxAlpha != minAlpha)
+		{
+			int32_t palette[8];
+			palette[0] = maxAlpha;
+			palette[1] = minAlpha;
+			for (int32_t paletteIdx = 2; paletteIdx < 8; paletteIdx++)
+			{
+				palette[paletteIdx] = ((8 - paletteIdx) * maxAlpha + (paletteIdx - 1) * minAlpha) / 7;
+			}
+
+			for (uint32_t texelIdx = 0; texelIdx < 16; texelIdx++)
+			{
+				const int32_t alpha = texels[texelIdx * 4 + 3];
+
+				uint64_t bestIdx = 0;
+				int32_t bestError = INT32_MAX;
+				for (uint32_t paletteIdx = 0; paletteIdx < 8; paletteIdx++)
+				{
+					const int32_t error = std::abs(alpha - palette[paletteIdx]);
+					if (error < bestError)
+					{
+						bestError = error;
+						bestIdx = paletteIdx;
+					}
+				}
+				indices |= bestIdx << (texelIdx * 3);
+			}
+		}
+
+		// 48 bits of 3 bit indices, little endian
+		for (uint32_t byteIdx = 0; byteIdx < 6; byteIdx++)
+		{
+			pOut[2 + byteIdx] = static_cast<uint8_t>(indices >> (byteIdx * 8));
+		}
+	}
+}
+
+const char* GetTextureFormatName(const ETextureFormat format)
+{
+	return GetFormatInfo(format).name;
+}
+
+VkFormat GetTextureVkFormat(const ETextureFormat format, const bool bSRGB)
+{
+	const TextureFormatInfo& info = GetFormatInfo(format);
+	return bSRGB ? info.srgbFormat : info.unormFormat;
+}
+
+uint32_t GetTextureBlockExtent(const ETextureFormat format)
+{
+	return GetFormatInfo(format).blockExtent;
+}
+
+uint32_t GetTextureBlockBytes(const ETextureFormat format)
+{
+	return GetFormatInfo(format).blockBytes;
+}
+
+uint64_t CalculateTextureMipSize(const ETextureFormat format, const uint32_t width, const uint32_t height)
+{
+	const TextureFormatInfo& info = GetFormatInfo(format);
+	const uint64_t blocksX = (width + info.blockExtent - 1) / info.blockExtent;
+	const uint64_t blocksY = (height + info.blockExtent - 1) / info.blockExtent;
+	return blocksX * blocksY * info.blockBytes;
+}
+
+uint32_t CalculateMipCount(const uint32_t width, const uint32_t height)
+{
+	uint32_t mipCount = 1;
+	for (uint32_t extent = std::max(width, height); extent > 1; extent /= 2)
+	{
+		mipCount++;
+	}
+	return mipCount;
+}
+
+TextureData BuildMipChain(const std::span<const uint8_t> pixels, const uint32_t width, const uint32_t height, const bool bSRGB)
+{
+	if (width == 0 || height == 0 || pixels.size() != static_cast<size_t>(width) * height * 4)
+	{
+		throw std::runtime_error(std::format("Texture of {}x{} has {} bytes of texels", width, height, pixels.size()));
+	}
+
+	TextureData texture;
+	texture.format = ETextureFormat::RGBA8;
+	texture.bSRGB = bSRGB;
+
+	const uint32_t mipCount = CalculateMipCount(width, height);
+	texture.mips.resize(mipCount);
+
+	uint64_t totalSize = 0;
+	for (uint32_t mipIdx = 0; mipIdx < mipCount; mipIdx++)
+	{
+		TextureMip& mip = texture.mips[mipIdx];
+		mip.width = std::max(width >> mipIdx, 1u);
+		mip.height = std::max(height >> mipIdx, 1u);
+		mip.offset = totalSize;
+		mip.size = CalculateTextureMipSize(ETextureFormat::RGBA8, mip.width, mip.height);
+		totalSize += mip.size;
+	}
+
+	texture.data.resize(totalSize);
+	std::memcpy(texture.data.data(), pixels.data(), pixels.size());
+
+	// Each mip is filtered from the unquantized one above it so rounding does not build up down the chain
+	auto decode = [bSRGB](const uint8_t value) { return bSRGB ? SRGBToLinear(value) : static_cast<float>(value) / 255.f; };
+
+	std::vector<float> source(static_cast<size_t>(width) * height * 4);
+	for (size_t valueIdx = 0; valueIdx < source.size(); valueIdx++)
+	{
+		// Alpha is always linear
+		source[valueIdx] = (valueIdx % 4 == 3) ? static_cast<float>(pixels[valueIdx]) / 255.f : decode(pixels[valueIdx]);
+	}
+	std::vector<float> destination;
+
+	for (uint32_t mipIdx = 1; mipIdx < mipCount; mipIdx++)
+	{
+		const TextureMip& sourceMip = texture.mips[mipIdx - 1];
+		const TextureMip& mip = texture.mips[mipIdx];
+		destination.resize(static_cast<size_t>(mip.width) * mip.height * 4);
+
+		uint8_t* pOut = texture.data.data() + mip.offset;
+
+		for (uint32_t y = 0; y < mip.height; y++)
+		{
+			const uint32_t sourceY[2] = {std::min(y * 2, sourceMip.height - 1), std::min(y * 2 + 1, sourceMip.height - 1)};
+			for (uint32_t x = 0; x < mip.width; x++)
+			{
+				const uint32_t sourceX[2] = {std::min(x * 2, sourceMip.width - 1), std::min(x * 2 + 1, sourceMip.width - 1)};
+
+				float weightedColor[3] = {0.f, 0.f, 0.f};
+				float color[3] = {0.f, 0.f, 0.f};
+				float alpha = 0.f;
+				for (uint32_t sampleIdx = 0; sampleIdx < 4; sampleIdx++)
+				{
+					const float* pSource = &source[(static_cast<size_t>(sourceY[sampleIdx / 2]) * sourceMip.width + sourceX[sampleIdx % 2]) * 4];
+					for (uint32_t channel = 0; channel < 3; channel++)
+					{
+						weightedColor[channel] += pSource[channel] * pSource[3];
+						color[channel] += pSource[channel];
+					}
+					alpha += pSource[3];
+				}
+
+				float* pDestination = &destination[(static_cast<size_t>(y) * mip.width + x) * 4];
+				for (uint32_t channel = 0; channel < 3; channel++)
+				{
+					pDestination[channel] = alpha > 0.f ? weightedColor[channel] / alpha : color[channel] / 4.f;
+				}
+				pDestination[3] = alpha / 4.f;
+
+				uint8_t* pTexel = &pOut[(static_cast<size_t>(y) * mip.width + x) * 4];
+				for (uint32_t channel = 0; channel < 3; channel++)
+				{
+					pTexel[channel] = bSRGB ? LinearToSRGB(pDestination[channel]) : FloatToUnorm8(pDestination[channel]);
+				}
+				pTexel[3] = FloatToUnorm8(pDestination[3]);
+			}
+		}
+
+		std::swap(source, destination);
+	}
+
+	return texture;
+}
+
+bool HasTranslucentTexels(const TextureData& texture)
+{
+	assert(texture.format == ETextureFormat::RGBA8);
+
+	// Every mip is filtered from the first, checking that one is enough
+	const TextureMip& mip = texture.mips[0];
+	for (uint64_t byteIdx = mip.offset + 3; byteIdx < mip.offset + mip.size; byteIdx += 4)
+	{
+		if (texture.data[byteIdx] != 255)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+TextureData CompressTexture(const TextureData& source, const ETextureFormat format, ThreadPool* pThreadPool)
+{
+	if (source.format != ETextureFormat::RGBA8 || (format != ETextureFormat::BC1 && format != ETextureFormat::BC3))
+	{
+		throw std::runtime_error(std::format("Cannot compress {} to {}", GetTextureFormatName(source.format), GetTextureFormatName(format)));
+	}
+
+	TextureData texture;
+	texture.format = format;
+	texture.bSRGB = source.bSRGB;
+	texture.mips.resize(source.mips.size());
+
+	uint64_t totalSize = 0;
+	for (size_t mipIdx = 0; mipIdx < source.mips.size(); mipIdx++)
+	{
+		TextureMip& mip = texture.mips[mipIdx];
+		mip.width = source.mips[mipIdx].width;
+		mip.height = source.mips[mipIdx].height;
+		mip.offset = totalSize;
+		mip.size = CalculateTextureMipSize(format, mip.width, mip.height);
+		totalSize += mip.size;
+	}
+	texture.data.resize(totalSize);
+
+	const uint32_t blockBytes = GetTextureBlockBytes(format);
+
+	for (size_t mipIdx = 0; mipIdx < source.mips.size(); mipIdx++)
+	{
+		const TextureMip& sourceMip = source.mips[mipIdx];
+		const TextureMip& mip = texture.mips[mipIdx];
+		const uint32_t blocksX = (mip.width + 3) / 4;
+		const uint32_t blocksY = (mip.height + 3) / 4;
+
+		auto encodeRows = [&](uint32_t beginRow, uint32_t endRow, uint32_t)
+		{
+			BlockTexels texels;
+			for (uint32_t blockY = beginRow; blockY < endRow; blockY++)
+			{
+				for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+				{
+					GatherBlock(source.data.data() + sourceMip.offset, sourceMip.width, sourceMip.height, blockX, blockY, texels);
+
+					uint8_t* pBlock = texture.data.data() + mip.offset + (static_cast<uint64_t>(blockY) * blocksX + blockX) * blockBytes;
+					if (format == ETextureFormat::BC3)
+					{
+						EncodeAlphaBlock(texels, pBlock);
+						EncodeColorBlock(texels, pBlock + 8);
+					}
+					else
+					{
+						EncodeColorBlock(texels, pBlock);
+					}
+				}
+			}
+		};
+
+		// Rows of blocks are independent, the small mips are not worth waking the workers for
+		constexpr uint32_t ROWS_PER_BATCH = 8;
+		if (pThreadPool != nullptr && blocksY > ROWS_PER_BATCH)
+		{
+			pThreadPool->ParallelFor(blocksY, ROWS_PER_BATCH, encodeRows);
+		}
+		else
+		{
+			encodeRows(0, blocksY, 0);
+		}
+	}
+
+	return texture;
+}
+
+bool IsTextureFormatSupported(const VkPhysicalDevice physicalDevice, const VkFormat format)
+{
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+	const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+	return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
+
+TextureView ViewTexture(const TextureData& texture)
+{
+	TextureView view;
+	view.format = texture.format;
+	view.bSRGB = texture.bSRGB;
+	view.mips = texture.mips;
+	view.data = texture.data;
+	return view;
+}
+
+std::vector<VkBufferImageCopy> GetTextureCopyRegions(const std::span<const TextureMip> mips)
+{
+	std::vector<VkBufferImageCopy> regions(mips.size());
+	for (size_t mipIdx = 0; mipIdx < mips.size(); mipIdx++)
+	{
+		const TextureMip& mip = mips[mipIdx];
+
+		VkBufferImageCopy& region = regions[mipIdx];
+		region.bufferOffset = mip.offset;
+		// Tightly packed
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = static_cast<uint32_t>(mipIdx);
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = {0, 0, 0};
+		// A copy into a compressed image may end on a partial block only at the edge of the mip, which this always is
+		region.imageExtent = {mip.width, mip.height, 1};
+	}
+	return regions;
+}
+
+void WriteTextureFile(const std::filesystem::path& path, const TextureData& texture)
+{
+	assert(!texture.mips.empty());
+
+	TextureFileHeader header{};
+	header.magic = TEXTURE_FILE_MAGIC;
+	header.version = TEXTURE_FILE_VERSION;
+	header.format = static_cast<uint32_t>(texture.format);
+	header.flags = texture.bSRGB ? TEXTURE_FILE_FLAG_SRGB : 0;
+	header.width = texture.mips[0].width;
+	header.height = texture.mips[0].height;
+	header.mipCount = texture.GetMipCount();
+
+	// Mips are laid out again rather than written as one block, so each one starts aligned whatever the source packing
+	std::vector<TextureFileMip> fileMips(texture.mips.size());
+	uint64_t payloadSize = 0;
+	for (size_t mipIdx = 0; mipIdx < texture.mips.size(); mipIdx++)
+	{
+		payloadSize = AlignTextureFileOffset(payloadSize);
+		fileMips[mipIdx].width = texture.mips[mipIdx].width;
+		fileMips[mipIdx].height = texture.mips[mipIdx].height;
+		fileMips[mipIdx].offset = payloadSize;
+		fileMips[mipIdx].size = texture.mips[mipIdx].size;
+		payloadSize += texture.mips[mipIdx].size;
+	}
+
+	header.payloadOffset = AlignTextureFileOffset(sizeof(TextureFileHeader) + fileMips.size() * sizeof(TextureFileMip));
+	header.payloadSize = payloadSize;
+
+	std::vector<uint8_t> file(header.payloadOffset + header.payloadSize, 0);
+	std::memcpy(file.data(), &header, sizeof(header));
+	std::memcpy(file.data() + sizeof(header), fileMips.data(), fileMips.size() * sizeof(TextureFileMip));
+	for (size_t mipIdx = 0; mipIdx < texture.mips.size(); mipIdx++)
+	{
+		std::memcpy(file.data() + header.payloadOffset + fileMips[mipIdx].offset, texture.data.data() + texture.mips[mipIdx].offset, texture.mips[mipIdx].size);
+	}
+
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	stream.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+	if (!stream)
+	{
+		throw std::runtime_error(std::format("Failed to write texture file {}", path.string()));
+	}
+}
+
+bool ParseTextureFile(const std::span<const uint8_t> file, TextureView& outView)
+{
+	if (file.size() < sizeof(TextureFileHeader))
+	{
+		return false;
+	}
+
+	TextureFileHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+
+	if (header.magic != TEXTURE_FILE_MAGIC || header.version != TEXTURE_FILE_VERSION || header.format >= static_cast<uint32_t>(ETextureFormat::Count))
+	{
+		return false;
+	}
+
+	const uint64_t mipTableEnd = sizeof(TextureFileHeader) + static_cast<uint64_t>(header.mipCount) * sizeof(TextureFileMip);
+	if (header.mipCount == 0 || header.mipCount > CalculateMipCount(header.width, header.height) || mipTableEnd > header.payloadOffset ||
+		header.payloadOffset > file.size() || header.payloadSize > file.size() - header.payloadOffset)
+	{
+		return false;
+	}
+
+	const ETextureFormat format = static_cast<ETextureFormat>(header.format);
+
+	outView.format = format;
+	outView.bSRGB = (header.flags & TEXTURE_FILE_FLAG_SRGB) != 0;
+	outView.data = file.subspan(header.payloadOffset, header.payloadSize);
+	outView.mips.resize(header.mipCount);
+
+	for (uint32_t mipIdx = 0; mipIdx < header.mipCount; mipIdx++)
+	{
+		TextureFileMip fileMip;
+		std::memcpy(&fileMip, file.data() + sizeof(TextureFileHeader) + mipIdx * sizeof(TextureFileMip), sizeof(fileMip));
+
+		const bool bValidMip =
+			fileMip.width == std::max(header.width >> mipIdx, 1u) &&
+			fileMip.height == std::max(header.height >> mipIdx, 1u) &&
+			fileMip.size == CalculateTextureMipSize(format, fileMip.width, fileMip.height) &&
+			fileMip.offset % TEXTURE_FILE_ALIGNMENT == 0 &&
+			fileMip.offset <= header.payloadSize && fileMip.size <= header.payloadSize - fileMip.offset;
+		if (!bValidMip)
+		{
+			return false;
+		}
+
+		outView.mips[mipIdx] = {fileMip.width, fileMip.height, fileMip.offset, fileMip.size};
+	}
+
+	return true;
+}
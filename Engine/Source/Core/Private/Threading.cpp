@@ -0,0 +1,161 @@
+#include "Threading.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace
+{
+	static_assert(MAX_THREAD_SLOTS == 64, "The slot bitmap is a single 64 bit word");
+
+	// Bit n is set while a live thread owns slot n
+	std::atomic<uint64_t> ownedThreadSlots = 0;
+	std::atomic<uint32_t> sharedThreadSlotCounter = 0;
+
+	// Held by every thread that asked for a slot, hands the slot back when the thread exits
+	struct ThreadSlotLease
+	{
+		ThreadSlotLease()
+		{
+			uint64_t owned = ownedThreadSlots.load(std::memory_order_relaxed);
+			while (owned != ~0ull)
+			{
+				const uint32_t freeSlot = static_cast<uint32_t>(std::countr_one(owned));
+				if (ownedThreadSlots.compare_exchange_weak(owned, owned | (1ull << freeSlot), std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					slot = freeSlot;
+					bOwned = true;
+					return;
+				}
+			}
+
+			// More live threads than slots, this one shares a slot with a live thread
+			slot = sharedThreadSlotCounter.fetch_add(1, std::memory_order_relaxed) % MAX_THREAD_SLOTS;
+		}
+
+		~ThreadSlotLease()
+		{
+			if (bOwned)
+			{
+				ownedThreadSlots.fetch_and(~(1ull << slot), std::memory_order_release);
+			}
+		}
+
+		uint32_t slot = 0;
+		bool bOwned = false;
+	};
+}
+
+uint32_t GetCurrentThreadSlot()
+{
+	thread_local const ThreadSlotLease lease;
+	return lease.slot;
+}
+
+void ThreadPool::Init(const uint32_t numWorkers)
+{
+	assert(mWorkers.empty());
+
+	mStopping = false;
+	mWorkers.reserve(numWorkers);
+	for (uint32_t workerIdx = 0; workerIdx < numWorkers; workerIdx++)
+	{
+		mWorkers.emplace_back(&ThreadPool::WorkerMain, this, workerIdx + 1);
+	}
+}
+
+void ThreadPool::Shutdown()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for (std::thread& worker : mWorkers)
+	{
+		worker.join();
+	}
+	mWorkers.clear();
+}
+
+void ThreadPool::ParallelFor(const uint32_t count, const uint32_t batchSize, const RangeFn& fn)
+{
+	assert(batchSize > 0);
+	assert(mJobFn == nullptr);
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Not worth waking anyone up for
+	if (mWorkers.empty() || count <= batchSize)
+	{
+		fn(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard lock(mMutex);
+		mJobFn = &fn;
+		mJobCount = count;
+		mJobBatchSize = batchSize;
+		mNextBatch.store(0, std::memory_order_relaxed);
+		mBusyWorkers = static_cast<uint32_t>(mWorkers.size());
+		mJobGeneration++;
+	}
+	mWorkAvailable.notify_all();
+
+	RunBatches(0);
+
+	// Every worker has to check in, even the ones that found nothing left, before the job can be torn down
+	std::unique_lock lock(mMutex);
+	mWorkDone.wait(lock, [this]() { return mBusyWorkers == 0; });
+	mJobFn = nullptr;
+}
+
+void ThreadPool::WorkerMain(const uint32_t threadIdx)
+{
+	uint64_t seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock lock(mMutex);
+			mWorkAvailable.wait(lock, [this, seenGeneration]() { return mStopping || mJobGeneration != seenGeneration; });
+
+			if (mStopping)
+			{
+				return;
+			}
+
+			seenGeneration = mJobGeneration;
+		}
+
+		RunBatches(threadIdx);
+
+		bool bLastWorker = false;
+		{
+			std::lock_guard lock(mMutex);
+			bLastWorker = --mBusyWorkers == 0;
+		}
+		if (bLastWorker)
+		{
+			mWorkDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::RunBatches(const uint32_t threadIdx)
+{
+	const uint32_t numBatches = (mJobCount + mJobBatchSize - 1) / mJobBatchSize;
+
+	uint32_t batchIdx;
+	while ((batchIdx = mNextBatch.fetch_add(1, std::memory_order_relaxed)) < numBatches)
+	{
+		const uint32_t begin = batchIdx * mJobBatchSize;
+		const uint32_t end = std::min(begin + mJobBatchSize, mJobCount);
+		(*mJobFn)(begin, end, threadIdx);
+	}
+}
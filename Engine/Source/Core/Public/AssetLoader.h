@@ -0,0 +1,103 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Texture.h"
+
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <thread>
+
+class ThreadPool;
+
+typedef uint32_t AssetID;
+
+/**
+ * A texture as the AssetLoader found it, either cooked or decoded from its source image
+ */
+struct TextureAsset
+{
+	std::filesystem::path sourcePath;
+	bool bSRGB = true;
+
+	// Open if the texture was cooked, cooked then views into it
+	MappedFile cookedFile;
+	TextureView cooked;
+
+	// Only when there was no usable cooked file: the RGBA8 mip chain, and its BC1 or BC3 copy for devices that sample it
+	TextureData decoded;
+	TextureData compressed;
+
+	[[nodiscard]] bool IsCooked() const { return cookedFile.IsOpen(); }
+};
+
+/**
+ * Decode an image into an RGBA8 texture with its full mip chain
+ * Throws if the image cannot be read.
+ */
+TextureData DecodeTextureImage(const std::filesystem::path& path, bool bSRGB);
+
+/**
+ * Loads every asset the engine starts with at once, each one a job on the thread pool
+ * Started before the window and the Vulkan device are created, so reading and decoding happen while the driver is busy,
+ * then waited for before anything is uploaded. Nothing here touches Vulkan, the loaded assets are uploaded in one batch.
+ */
+class AssetLoader
+{
+public:
+	struct Statistics
+	{
+		uint32_t textureCount = 0;
+		uint32_t cookedCount = 0;
+		// From Start until every job was done
+		double loadMilliseconds = 0.0;
+		// Time spent in the jobs, summed over all threads
+		double decodeMilliseconds = 0.0;
+	};
+
+	~AssetLoader();
+
+	/**
+	 * Add a texture to load, must be called before Start
+	 * The cooked file of the same name in the build's cooked texture directory, with the TEXTURE_FILE_EXTENSION, is
+	 * mapped if it exists. Otherwise the image is decoded, mipped and block compressed by the job.
+	 */
+	AssetID LoadTexture(const std::filesystem::path& sourcePath, bool bSRGB = true);
+
+	/**
+	 * Run the jobs of every asset added so far on the pool and return right away
+	 * The pool belongs to the loader until Wait returns, nothing else may call ParallelFor on it meanwhile.
+	 */
+	void Start(ThreadPool& threadPool);
+
+	/**
+	 * Wait for every job and give the pool back
+	 * Rethrows the first error any job ran into.
+	 */
+	void Wait();
+
+	/**
+	 * @return The loaded texture, only valid between Wait and Release
+	 */
+	[[nodiscard]] const TextureAsset& GetTexture(AssetID texture) const;
+
+	/**
+	 * Free everything that was loaded and unmap the cooked files, once the assets are staged for upload
+	 */
+	void Release();
+
+	[[nodiscard]] Statistics GetStatistics() const { return mStatistics; }
+
+private:
+	void LoadTextureJob(TextureAsset& texture);
+
+	// A deque so entries stay put while others are added, mapped files cannot move
+	std::deque<TextureAsset> mTextures;
+
+	std::thread mLoadThread;
+	std::exception_ptr mError;
+	bool mWaited = false;
+
+	Statistics mStatistics;
+};
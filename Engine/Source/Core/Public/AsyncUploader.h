@@ -0,0 +1,105 @@
+#pragma once
+
+#include "StagingRing.h"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <vector>
+
+/**
+ * Streams buffer and image data to the GPU through the transfer queue without ever waiting on the CPU
+ * Each Submit signals a timeline semaphore. When the transfer queue belongs to another family, the copies end in a
+ * release of ownership and Acquire records the matching acquire on the graphics queue; the graphics submission only has to
+ * wait on the semaphore in the frame that first uses the uploaded resources.
+ * Destinations must be created with VK_SHARING_MODE_EXCLUSIVE. Enqueue* is thread safe, Submit and Acquire must be
+ * called from the thread that submits graphics work since both queues may be one and the same.
+ */
+class AsyncUploader
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_STAGING_CAPACITY = 64ull * 1024 * 1024;
+
+	// Stages that may read uploaded data, graphics submissions wait on the timeline semaphore at these
+	static constexpr VkPipelineStageFlags CONSUMER_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkQueue transferQueue, uint32_t transferQueueFamilyIdx, uint32_t graphicsQueueFamilyIdx, VkDeviceSize stagingCapacity = DEFAULT_STAGING_CAPACITY);
+
+	/**
+	 * The device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Copy size bytes of pData into dstBuffer at dstOffset with the next Submit
+	 * The buffer must not be used by the graphics queue until it has been acquired
+	 */
+	void EnqueueBufferUpload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize size);
+
+	/**
+	 * Upload image data with the next Submit, the image ends up in shader read only layout
+	 * @param regions Copy regions whose bufferOffset is relative to pData
+	 */
+	void EnqueueImageUpload(VkImage dstImage, const VkImageSubresourceRange& range, std::span<const VkBufferImageCopy> regions, const void* pData, VkDeviceSize size);
+
+	/**
+	 * Submit everything enqueued so far to the transfer queue
+	 * @return The timeline value that signals once those uploads are done, the last submitted value when nothing was pending
+	 */
+	uint64_t Submit();
+
+	/**
+	 * Take ownership on the graphics queue of everything submitted up to uploadValue that has not been acquired yet
+	 * Pass GetCompletedValue() to only pick up uploads that already finished, so the graphics queue never stalls on them
+	 * @param graphicsCommandBuffer Acquire barriers are recorded here, outside of any rendering scope
+	 * @return The value the graphics submission must wait for on GetTimelineSemaphore(), 0 if it does not need to wait
+	 */
+	uint64_t Acquire(VkCommandBuffer graphicsCommandBuffer, uint64_t uploadValue);
+
+	[[nodiscard]] uint64_t GetCompletedValue() const;
+
+	[[nodiscard]] bool IsComplete(uint64_t uploadValue) const { return uploadValue <= GetCompletedValue(); }
+
+	[[nodiscard]] VkSemaphore GetTimelineSemaphore() const { return mTimelineSemaphore; }
+
+private:
+	struct SubmittedBatch
+	{
+		uint64_t timelineValue;
+		VkCommandBuffer commandBuffer;
+		// The release barriers, Acquire records them again on the graphics side
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+	};
+
+	/**
+	 * Recycle the staging space of finished batches, and their command buffers once they no longer need acquiring
+	 */
+	void ReclaimLocked();
+
+	VkCommandBuffer GetCommandBufferLocked();
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+
+	VkQueue mTransferQueue = VK_NULL_HANDLE;
+	uint32_t mTransferQueueFamilyIdx = 0;
+	uint32_t mGraphicsQueueFamilyIdx = 0;
+	// Same family means no ownership transfer, the semaphore alone orders the queues
+	bool mNeedsOwnershipTransfer = false;
+
+	VkCommandPool mCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> mFreeCommandBuffers;
+
+	VkSemaphore mTimelineSemaphore = VK_NULL_HANDLE;
+	uint64_t mLastSubmittedValue = 0;
+	// Batches are always acquired in submission order, so everything up to this value has been acquired
+	uint64_t mLastAcquiredValue = 0;
+
+	StagingRing mStaging;
+
+	// Oldest first
+	std::deque<SubmittedBatch> mSubmittedBatches;
+
+	mutable std::mutex mMutex;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "VulkanCommon.h"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Index of a resource in its bindless table, as read by shaders
+typedef uint32_t BindlessIndex;
+
+/**
+ * One descriptor set holding every texture and storage buffer, shaders index into it instead of having a set bound per draw
+ * The set is bound once per command buffer and never changes. Resources are added and removed while frames that use the
+ * set are still in flight, which descriptor indexing allows for the slots those frames do not read. Slots are only reused
+ * once the frames that could read them completed. Thread safe.
+ */
+class BindlessDescriptors
+{
+public:
+	static constexpr uint32_t TEXTURE_BINDING = 0;
+	static constexpr uint32_t STORAGE_BUFFER_BINDING = 1;
+	static constexpr BindlessIndex INVALID_INDEX = UINT32_MAX;
+
+	/**
+	 * @return Whether the device has every descriptor indexing feature the set needs
+	 */
+	static bool IsSupported(VkPhysicalDevice physicalDevice);
+
+	/**
+	 * Turn on what the set needs in the features the device is created with, only if IsSupported
+	 */
+	static void EnableFeatures(VkPhysicalDeviceVulkan12Features& features);
+
+	/**
+	 * @param maxTextures Size of the texture table, lowered to what the device allows
+	 * @param maxStorageBuffers Size of the storage buffer table, lowered to what the device allows
+	 */
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t maxTextures, uint32_t maxStorageBuffers);
+
+	void Shutdown();
+
+	/**
+	 * @return The index shaders sample the texture with, throws if the table is full
+	 */
+	BindlessIndex AddTexture(VkImageView imageView, VkSampler sampler);
+
+	/**
+	 * @return The index shaders read the buffer range with, throws if the table is full
+	 */
+	BindlessIndex AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+	/**
+	 * Give the slot back once frameNumber completed, frames up to it may still read the texture
+	 */
+	void RemoveTexture(BindlessIndex texture, uint64_t frameNumber);
+
+	void RemoveStorageBuffer(BindlessIndex buffer, uint64_t frameNumber);
+
+	/**
+	 * Make the slots removed up to completedFrameNumber available again
+	 */
+	void RecycleSlots(uint64_t completedFrameNumber);
+
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIdx) const;
+
+	[[nodiscard]] VkDescriptorSetLayout GetSetLayout() const { return mSetLayout; }
+
+	[[nodiscard]] uint32_t GetTextureCapacity() const { return mTextures.capacity; }
+
+	[[nodiscard]] uint32_t GetStorageBufferCapacity() const { return mStorageBuffers.capacity; }
+
+private:
+	struct RetiredSlot
+	{
+		BindlessIndex slot;
+		uint64_t frameNumber;
+	};
+
+	struct Table
+	{
+		const char* name = "";
+		uint32_t capacity = 0;
+		// Slots past this one were never handed out
+		uint32_t nextUnusedSlot = 0;
+		std::vector<BindlessIndex> freeSlots;
+		// Oldest first
+		std::deque<RetiredSlot> retiredSlots;
+	};
+
+	/**
+	 * Requires mMutex
+	 */
+	static BindlessIndex AllocateSlot(Table& table);
+
+	static void RetireSlot(Table& table, BindlessIndex slot, uint64_t frameNumber);
+
+	static void RecycleTable(Table& table, uint64_t completedFrameNumber);
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet mDescriptorSet = VK_NULL_HANDLE;
+
+	// Held while writing the set as well, updates to one set must not race each other
+	std::mutex mMutex;
+	Table mTextures;
+	Table mStorageBuffers;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <bitset>
+
+
+extern uint32_t componentCounter;
+
+constexpr uint32_t MAX_COMPONENTS = 32;
+typedef std::bitset<MAX_COMPONENTS> ComponentMask;
+
+constexpr uint32_t NUM_COMPONENTS_PER_CHUNK = 64;
+
+constexpr uint32_t NUM_CHUNKS_PER_POOL = 2048;
+constexpr uint32_t MAX_ENTITIES = NUM_CHUNKS_PER_POOL * NUM_COMPONENTS_PER_CHUNK;
+
+/**
+ * @tparam T The class of the component to get the ID for
+ * @return ID of the component class
+ */
+template <class T>
+uint32_t GetComponentId()
+{
+	static uint32_t componentId = componentCounter++;
+	return componentId;
+}
+
+// ComponentMask stored as a plain word so the entity table can be scanned with SIMD
+typedef uint32_t PackedComponentMask;
+static_assert(MAX_COMPONENTS <= sizeof(PackedComponentMask) * 8, "ComponentMask no longer fits in a PackedComponentMask");
+
+inline PackedComponentMask PackComponentMask(const ComponentMask& mask)
+{
+	return static_cast<PackedComponentMask>(mask.to_ulong());
+}
+
+/**
+ * One bit per chunk of a double buffered pool, set when the next copy of one of its components is handed out for writing
+ * Marking is thread safe so systems writing components in parallel can share it
+ */
+class ChunkWriteMask
+{
+public:
+	void Mark(const uint32_t chunkIdx)
+	{
+		std::atomic<uint64_t>& word = mWords[chunkIdx / 64];
+		const uint64_t bit = 1ull << (chunkIdx % 64);
+
+		// Nearly every write lands in an already marked chunk, skipping the read-modify-write keeps the line shared
+		if ((word.load(std::memory_order_relaxed) & bit) == 0)
+		{
+			word.fetch_or(bit, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * Call fn(chunkIdx) for every marked chunk and clear the marks, not thread safe
+	 */
+	template<typename Fn>
+	void ConsumeMarked(Fn&& fn)
+	{
+		for (uint32_t wordIdx = 0; wordIdx < NUM_WORDS; ++wordIdx)
+		{
+			for (uint64_t bits = mWords[wordIdx].exchange(0, std::memory_order_relaxed); bits != 0; bits &= bits - 1)
+			{
+				fn(wordIdx * 64 + std::countr_zero(bits));
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t NUM_WORDS = NUM_CHUNKS_PER_POOL / 64;
+
+	std::atomic<uint64_t> mWords[NUM_WORDS] = {};
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FIREFLY_SIMD_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+// MSVC allows AVX2 intrinsics in any function, the runtime check keeps us off them on older CPUs
+#define FIREFLY_TARGET_AVX2
+#else
+#define FIREFLY_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/**
+ * @return Whether both the CPU and the OS support AVX2, always false off x64
+ * SSE2 is part of the x64 baseline and needs no check.
+ */
+bool IsAvx2Supported();
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Threading.h"
+
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * The six planes bounding what viewProj projects onto the screen, in the space viewProj transforms from
+ * xyz is the unit normal pointing inside and w the distance, so dot(xyz, p) + w is the signed distance of p.
+ * The near plane is the one of a -1 to 1 depth range, which also holds everything in front of a 0 to 1 one.
+ */
+std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProj);
+
+// Bounding spheres with one array per component, so a SIMD register loads the same component of 4 or 8 spheres at once
+struct BoundingSpheres
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+
+	void Resize(uint32_t count);
+
+	[[nodiscard]] uint32_t Size() const { return static_cast<uint32_t>(radius.size()); }
+};
+
+/**
+ * Find every sphere in [begin, end) that is at least partly inside all six planes
+ * Tests 8 spheres at a time with AVX2 or 4 with SSE2 depending on what the CPU supports, with a scalar fallback for the tail and other architectures
+ * @param planes As returned by ExtractFrustumPlanes, in the space of the spheres
+ * @param outIndices Receives the indices of the visible spheres in ascending order, must have room for end - begin entries
+ * @return The number of indices written to outIndices
+ */
+uint32_t CullSpheres(const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, uint32_t begin, uint32_t end, uint32_t* outIndices);
+
+/**
+ * Runs CullSpheres over a thread pool and joins the visible indices of every batch into one list
+ * Keeps its buffers between calls, so culling a similar count every frame does not allocate.
+ */
+class FrustumCuller
+{
+public:
+	/**
+	 * @param batchSize Spheres culled by one thread at a time, at least a few thousand to be worth a worker waking up.
+	 * A cloud of no more than batchSize spheres, or a pool without workers, is culled on the calling thread alone.
+	 * @return The indices of the visible spheres in ascending order, valid until the next call
+	 */
+	std::span<const uint32_t> Cull(ThreadPool& threadPool, const BoundingSpheres& spheres, const std::array<glm::vec4, 6>& planes, uint32_t batchSize);
+
+private:
+	std::vector<uint32_t> mVisibleIndices;
+	// Every batch writes its indices at its own begin, these say how many before they are packed together
+	std::vector<uint32_t> mBatchVisibleCounts;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// SPIR-V compiled from Engine/Shaders by the build, one .spv.inc per shader holding its words as a comma separated list
+
+/**
+ * Specialization constant IDs of the sprite shaders, matching the constant_id layouts in shader.vert, shader.frag and
+ * shader_bindless.frag
+ */
+enum ESpriteShaderConstant : uint32_t
+{
+	// VkBool32, multiply the texture by the interpolated vertex color
+	SPRITE_CONSTANT_VERTEX_COLOR_TINT = 0,
+};
+
+/**
+ * Specialization constant IDs of cull.comp
+ */
+enum ECullShaderConstant : uint32_t
+{
+	// Which of the three culling dispatches the pipeline runs, GpuCulling::ECullPhase
+	CULL_CONSTANT_PHASE = 0,
+};
+
+namespace EmbeddedShaders
+{
+	inline constexpr uint32_t SPRITE_VERT[] =
+	{
+#include "shader.vert.spv.inc"
+	};
+
+	inline constexpr uint32_t SPRITE_FRAG[] =
+	{
+#include "shader.frag.spv.inc"
+	};
+
+	// Samples the bindless texture table at set 1 instead of the texture in the per frame set
+	inline constexpr uint32_t SPRITE_BINDLESS_FRAG[] =
+	{
+#include "shader_bindless.frag.spv.inc"
+	};
+
+	// Frustum culls instances and writes the indirect draws, GpuCulling
+	inline constexpr uint32_t CULL_COMP[] =
+	{
+#include "cull.comp.spv.inc"
+	};
+
+	static_assert(SPRITE_VERT[0] == 0x07230203 && SPRITE_FRAG[0] == 0x07230203 && SPRITE_BINDLESS_FRAG[0] == 0x07230203 && CULL_COMP[0] == 0x07230203, "Embedded shaders do not start with the SPIR-V magic number");
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Threading.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+typedef uint64_t EntityID;
+typedef uint32_t EntityIndex;
+typedef uint32_t EntityVersion;
+
+constexpr EntityIndex INVALID_ENTITY_INDEX = static_cast<EntityIndex>(-1);
+
+inline EntityID CreateEntityId(const EntityIndex index, const EntityVersion version)
+{
+	return static_cast<EntityID>(index) << 32 | version;
+}
+
+inline EntityIndex GetEntityIndex(const EntityID id)
+{
+	return id >> 32;
+}
+
+inline EntityVersion GetEntityVersion(const EntityID id)
+{
+	return static_cast<EntityVersion>(id);
+}
+
+inline bool IsEntityValid(const EntityID id)
+{
+	return GetEntityIndex(id) != INVALID_ENTITY_INDEX;
+}
+
+/**
+ * Hands out entity ids that are safe to create and destroy from any number of threads at once.
+ * Freed indices go onto a lock-free (tagged Treiber stack) free list and come back with their version bumped.
+ * Each thread slot also keeps a small block of reserved indices so that parallel spawners mostly touch their own cache line.
+ */
+class EntityAllocator
+{
+public:
+	explicit EntityAllocator(uint32_t inCapacity);
+
+	EntityAllocator(const EntityAllocator&) = delete;
+	EntityAllocator& operator=(const EntityAllocator&) = delete;
+
+	/**
+	 * Thread safe
+	 * @return A new entity id, or an id for which IsEntityValid is false if every index is in use
+	 */
+	EntityID Allocate();
+
+	/**
+	 * Thread safe. Bumps the version of the index so stale ids no longer compare equal
+	 * @param id A live id previously returned by Allocate
+	 */
+	void Free(EntityID id);
+
+	/**
+	 * Return every index sitting in a per-thread reservation block to the shared free list
+	 * Not thread safe with Allocate / Free, intended to be called at a frame boundary
+	 */
+	void FlushThreadCaches();
+
+	/**
+	 * @return One past the highest index that has ever been handed out, useful as an iteration bound
+	 */
+	[[nodiscard]] uint32_t GetHighWaterMark() const;
+
+	[[nodiscard]] uint32_t GetCapacity() const { return mCapacity; }
+
+private:
+	static constexpr uint32_t RESERVATION_BLOCK_SIZE = 16;
+
+	struct alignas(64) ReservationBlock
+	{
+		std::atomic_flag inUse;
+		uint32_t count = 0;
+		EntityIndex indices[RESERVATION_BLOCK_SIZE];
+	};
+
+	bool PopFreeIndex(EntityIndex& outIndex);
+
+	void PushFreeIndex(EntityIndex index);
+
+	void RefillBlock(ReservationBlock& block);
+
+	bool ReserveFromHighWaterMark(EntityIndex& outIndex);
+
+	bool StealFromOtherBlocks(uint32_t ownSlot, EntityIndex& outIndex);
+
+	static uint64_t PackHead(const EntityIndex index, const uint32_t tag)
+	{
+		return static_cast<uint64_t>(tag) << 32 | index;
+	}
+
+	const uint32_t mCapacity;
+
+	// Only the owner of an index reads or writes its version, ownership is handed over through the free list / blocks
+	std::unique_ptr<EntityVersion[]> mVersions;
+	std::unique_ptr<std::atomic<EntityIndex>[]> mFreeListNext;
+
+	// Low 32 bits are the top index, high 32 bits are an ABA tag bumped on every successful exchange
+	alignas(64) std::atomic<uint64_t> mFreeListHead;
+	alignas(64) std::atomic<uint32_t> mHighWaterMark = 0;
+
+	std::unique_ptr<ReservationBlock[]> mReservationBlocks;
+};
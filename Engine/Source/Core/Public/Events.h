@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Threading.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+
+extern uint32_t eventTypeCounter;
+
+/**
+ * @tparam T The class of the event to get the ID for
+ * @return ID of the event class
+ */
+template <class T>
+uint32_t GetEventTypeId()
+{
+	static uint32_t eventTypeId = eventTypeCounter++;
+	return eventTypeId;
+}
+
+// Lets Scene drive every channel at the frame boundary, one virtual call per channel rather than per event
+struct EventChannelBase
+{
+	virtual ~EventChannelBase() = default;
+
+	virtual void Merge() = 0;
+
+	virtual void EndFrame() = 0;
+};
+
+/**
+ * Typed queue of events of one kind
+ * Any thread can Emit into its own append buffer; Merge gathers them into one contiguous array that readers iterate.
+ * Events stay readable through ReadPrevious for one more frame after EndFrame, then their storage is reused.
+ * Buffers keep their capacity between frames so steady state emission does not allocate.
+ */
+template<typename T>
+class EventChannel final : public EventChannelBase
+{
+public:
+	EventChannel()
+		: mWriters(new WriterBuffer[MAX_THREAD_SLOTS])
+	{
+	}
+
+	/**
+	 * Thread safe
+	 */
+	void Emit(const T& event)
+	{
+		WriterBuffer& writer = ClaimWriter();
+		writer.events.push_back(event);
+		writer.inUse.clear(std::memory_order_release);
+	}
+
+	/**
+	 * Thread safe. Appends a whole span under a single claim of the calling thread's buffer
+	 */
+	void Emit(const std::span<const T> events)
+	{
+		WriterBuffer& writer = ClaimWriter();
+		writer.events.insert(writer.events.end(), events.begin(), events.end());
+		writer.inUse.clear(std::memory_order_release);
+	}
+
+	/**
+	 * Move everything emitted since the last merge into the array returned by Read
+	 * Must not overlap with Emit or Read, call it at a sync point between systems
+	 */
+	void Merge() override
+	{
+		size_t numPending = 0;
+		for (uint32_t slot = 0; slot < MAX_THREAD_SLOTS; ++slot)
+		{
+			numPending += mWriters[slot].events.size();
+		}
+
+		if (numPending == 0)
+		{
+			return;
+		}
+
+		mCurrent.reserve(mCurrent.size() + numPending);
+		for (uint32_t slot = 0; slot < MAX_THREAD_SLOTS; ++slot)
+		{
+			std::vector<T>& events = mWriters[slot].events;
+			mCurrent.insert(mCurrent.end(), events.begin(), events.end());
+			events.clear();
+		}
+	}
+
+	/**
+	 * Retire this frame's events to ReadPrevious and drop the ones from the frame before
+	 */
+	void EndFrame() override
+	{
+		Merge();
+		std::swap(mCurrent, mPrevious);
+		mCurrent.clear();
+	}
+
+	/**
+	 * @return Every event merged this frame, grouped by the thread slot that emitted them
+	 */
+	[[nodiscard]] std::span<const T> Read() const { return mCurrent; }
+
+	/**
+	 * @return The events of the previous frame, for systems that run before this frame's emitters
+	 */
+	[[nodiscard]] std::span<const T> ReadPrevious() const { return mPrevious; }
+
+private:
+	struct alignas(64) WriterBuffer
+	{
+		std::atomic_flag inUse;
+		std::vector<T> events;
+	};
+
+	WriterBuffer& ClaimWriter()
+	{
+		// Threads that share a slot move on to the next free buffer instead of waiting
+		for (uint32_t slot = GetCurrentThreadSlot();; slot = (slot + 1) % MAX_THREAD_SLOTS)
+		{
+			if (!mWriters[slot].inUse.test_and_set(std::memory_order_acquire))
+			{
+				return mWriters[slot];
+			}
+		}
+	}
+
+	std::unique_ptr<WriterBuffer[]> mWriters;
+
+	std::vector<T> mCurrent;
+	std::vector<T> mPrevious;
+};
+
+/**
+ * Every event channel of a scene, indexed by GetEventTypeId, shared by Scene and StaticScene
+ */
+class EventChannels
+{
+public:
+	/**
+	 * Get the channel for events of class T, creating it on first use
+	 * Creation is not thread safe, so touch every channel once during setup before systems run in parallel
+	 */
+	template<typename T>
+	EventChannel<T>& Get()
+	{
+		const uint32_t eventTypeId = GetEventTypeId<T>();
+		if (eventTypeId >= mChannels.size())
+		{
+			mChannels.resize(eventTypeId + 1);
+		}
+
+		if (!mChannels[eventTypeId])
+		{
+			mChannels[eventTypeId] = std::make_unique<EventChannel<T>>();
+		}
+
+		return static_cast<EventChannel<T>&>(*mChannels[eventTypeId]);
+	}
+
+	void MergeAll()
+	{
+		for (const std::unique_ptr<EventChannelBase>& channel : mChannels)
+		{
+			if (channel)
+			{
+				channel->Merge();
+			}
+		}
+	}
+
+	void EndFrameAll()
+	{
+		for (const std::unique_ptr<EventChannelBase>& channel : mChannels)
+		{
+			if (channel)
+			{
+				channel->EndFrame();
+			}
+		}
+	}
+
+private:
+	std::vector<std::unique_ptr<EventChannelBase>> mChannels;
+};
@@ -1,12 +1,26 @@
 #pragma once
 
+#include "AssetLoader.h"
+#include "AsyncUploader.h"
+#include "BindlessDescriptors.h"
+#include "Culling.h"
+#include "FramePacing.h"
+#include "FrameRing.h"
+#include "GpuAllocator.h"
+#include "GpuCulling.h"
+#include "PipelineManager.h"
+#include "RenderComponents.h"
+#include "RenderGraph.h"
 #include "Scene.h"
+#include "StagingRing.h"
+#include "StaticScene.h"
+#include "Threading.h"
 
 #include "SDL3/SDL_init.h"
 #include "SDL3/SDL_video.h"
 #include "SDL3/SDL_vulkan.h"
 
-#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -14,106 +28,14 @@
 
 #include <stb_image.h>
 
+#include <algorithm>
 #include <vector>
 #include <array>
 #include <iostream>
+#include <deque>
 #include <queue>
 #include <format>
 
-inline const char *Vulkan_GetResultString(VkResult result)
-{
-    switch ((int)result) {
-    case VK_SUCCESS:
-        return "VK_SUCCESS";
-    case VK_NOT_READY:
-        return "VK_NOT_READY";
-    case VK_TIMEOUT:
-        return "VK_TIMEOUT";
-    case VK_EVENT_SET:
-        return "VK_EVENT_SET";
-    case VK_EVENT_RESET:
-        return "VK_EVENT_RESET";
-    case VK_INCOMPLETE:
-        return "VK_INCOMPLETE";
-    case VK_ERROR_OUT_OF_HOST_MEMORY:
-        return "VK_ERROR_OUT_OF_HOST_MEMORY";
-    case VK_ERROR_OUT_OF_DEVICE_MEMORY:
-        return "VK_ERROR_OUT_OF_DEVICE_MEMORY";
-    case VK_ERROR_INITIALIZATION_FAILED:
-        return "VK_ERROR_INITIALIZATION_FAILED";
-    case VK_ERROR_DEVICE_LOST:
-        return "VK_ERROR_DEVICE_LOST";
-    case VK_ERROR_MEMORY_MAP_FAILED:
-        return "VK_ERROR_MEMORY_MAP_FAILED";
-    case VK_ERROR_LAYER_NOT_PRESENT:
-        return "VK_ERROR_LAYER_NOT_PRESENT";
-    case VK_ERROR_EXTENSION_NOT_PRESENT:
-        return "VK_ERROR_EXTENSION_NOT_PRESENT";
-    case VK_ERROR_FEATURE_NOT_PRESENT:
-        return "VK_ERROR_FEATURE_NOT_PRESENT";
-    case VK_ERROR_INCOMPATIBLE_DRIVER:
-        return "VK_ERROR_INCOMPATIBLE_DRIVER";
-    case VK_ERROR_TOO_MANY_OBJECTS:
-        return "VK_ERROR_TOO_MANY_OBJECTS";
-    case VK_ERROR_FORMAT_NOT_SUPPORTED:
-        return "VK_ERROR_FORMAT_NOT_SUPPORTED";
-    case VK_ERROR_FRAGMENTED_POOL:
-        return "VK_ERROR_FRAGMENTED_POOL";
-    case VK_ERROR_UNKNOWN:
-        return "VK_ERROR_UNKNOWN";
-    case VK_ERROR_OUT_OF_POOL_MEMORY:
-        return "VK_ERROR_OUT_OF_POOL_MEMORY";
-    case VK_ERROR_INVALID_EXTERNAL_HANDLE:
-        return "VK_ERROR_INVALID_EXTERNAL_HANDLE";
-    case VK_ERROR_FRAGMENTATION:
-        return "VK_ERROR_FRAGMENTATION";
-    case VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS:
-        return "VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS";
-    case VK_ERROR_SURFACE_LOST_KHR:
-        return "VK_ERROR_SURFACE_LOST_KHR";
-    case VK_ERROR_NATIVE_WINDOW_IN_USE_KHR:
-        return "VK_ERROR_NATIVE_WINDOW_IN_USE_KHR";
-    case VK_SUBOPTIMAL_KHR:
-        return "VK_SUBOPTIMAL_KHR";
-    case VK_ERROR_OUT_OF_DATE_KHR:
-        return "VK_ERROR_OUT_OF_DATE_KHR";
-    case VK_ERROR_INCOMPATIBLE_DISPLAY_KHR:
-        return "VK_ERROR_INCOMPATIBLE_DISPLAY_KHR";
-    case VK_ERROR_VALIDATION_FAILED_EXT:
-        return "VK_ERROR_VALIDATION_FAILED_EXT";
-    case VK_ERROR_INVALID_SHADER_NV:
-        return "VK_ERROR_INVALID_SHADER_NV";
-#if VK_HEADER_VERSION >= 135 && VK_HEADER_VERSION < 162
-    case VK_ERROR_INCOMPATIBLE_VERSION_KHR:
-        return "VK_ERROR_INCOMPATIBLE_VERSION_KHR";
-#endif
-    case VK_ERROR_INVALID_DRM_FORMAT_MODIFIER_PLANE_LAYOUT_EXT:
-        return "VK_ERROR_INVALID_DRM_FORMAT_MODIFIER_PLANE_LAYOUT_EXT";
-    case VK_ERROR_NOT_PERMITTED_EXT:
-        return "VK_ERROR_NOT_PERMITTED_EXT";
-    case VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT:
-        return "VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT";
-    case VK_THREAD_IDLE_KHR:
-        return "VK_THREAD_IDLE_KHR";
-    case VK_THREAD_DONE_KHR:
-        return "VK_THREAD_DONE_KHR";
-    case VK_OPERATION_DEFERRED_KHR:
-        return "VK_OPERATION_DEFERRED_KHR";
-    case VK_OPERATION_NOT_DEFERRED_KHR:
-        return "VK_OPERATION_NOT_DEFERRED_KHR";
-    case VK_PIPELINE_COMPILE_REQUIRED_EXT:
-        return "VK_PIPELINE_COMPILE_REQUIRED_EXT";
-    default:
-        break;
-    }
-    if (result < 0) {
-        return "VK_ERROR_<Unknown>";
-    }
-    return "VK_<Unknown>";
-}
-
-#define VK_CHECK(result, formattedMessage) if(result != VK_SUCCESS) { throw std::runtime_error(std::format(formattedMessage, Vulkan_GetResultString(result))); }
-
 struct Vertex
 {
 	glm::vec2 pos;
@@ -125,11 +47,33 @@ struct Vertex
 	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
 };
 
-struct UniformBufferObject
+// Per instance vertex input, the vertex shader builds the model matrix from it so each sprite costs 32 bytes
+// Also read by the GPU culling as Instance in cull.comp
+struct InstanceData
+{
+	glm::vec4 translationRotation;
+	glm::vec2 scale;
+	// Slot in the bindless texture table
+	uint32_t textureIdx;
+	// Only read by the GPU culling, the vertex shader draws one mesh per draw
+	uint32_t meshIdx;
+
+	static VkVertexInputBindingDescription getBindingDescription();
+
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
+};
+
+static_assert(sizeof(InstanceData) == GpuCulling::INSTANCE_STRIDE, "InstanceData no longer matches Instance in cull.comp");
+
+// Written into the frame ring once per frame, per sprite data travels in InstanceData instead
+struct FrameUniforms
 {
-	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	// proj * view, saves every vertex the multiply
+	alignas(16) glm::mat4 viewProj;
+	// Of viewProj in world space, for the GPU culling
+	alignas(16) glm::vec4 frustumPlanes[6];
 };
 
 class Engine
@@ -137,6 +81,34 @@ class Engine
 public:
 	void run();
 
+	/**
+	 * Pick the frame pacing before run, it can still be cycled with P while running
+	 */
+	void setFramePacingMode(EFramePacingMode mode) { framePacingMode = mode; }
+
+	/**
+	 * Sample textures through the bindless tables where the device supports them, on by default
+	 * Turned off, or on devices without descriptor indexing, every draw uses the texture in the per frame set.
+	 */
+	void setBindlessDescriptors(bool bEnabled) { bindlessRequested = bEnabled; }
+
+	/**
+	 * Frustum cull the sprites and build their draws on the GPU where the device supports it, on by default
+	 * Turned off, or on devices without indirect draws starting at any instance, the CPU culls the sprites and builds one draw per mesh.
+	 */
+	void setGpuCulling(bool bEnabled) { gpuCullingRequested = bEnabled; }
+
+	/**
+	 * Read back what the GPU culling wrote in each of the first numFrames frames and check it against the CPU culling,
+	 * then close. Throws on the first difference. Needs GPU culling, 0 turns validation off.
+	 */
+	void setGpuCullingValidation(uint32_t numFrames) { gpuCullingValidationFrames = numFrames; }
+
+	/**
+	 * Spheres one pool thread culls at a time when the CPU culls, sprite counts up to it are culled on the main thread alone
+	 */
+	void setCpuCullingBatchSize(uint32_t batchSize) { cpuCullingBatchSize = std::max(batchSize, 1u); }
+
 private:
 	void mainLoop();
 
@@ -148,20 +120,75 @@ private:
 
 	void cleanupWindow();
 
+	void initScene();
+
 private:
 
+	/**
+	 * Wait until the GPU is done with the resources of the frame slot about to be reused and recycle them
+	 */
+	void waitForFrameSlot();
+
 	void drawFrame(float deltaTime);
 
+	/**
+	 * Put the averaged frame timings in the window title about once a second
+	 */
+	void reportFrameTimings();
+
 	void initGraphics();
 
 	void cleanupGraphics();
 
+	/**
+	 * Gather every entity with a Transform and a Sprite into instance data allocated from the frame ring, reading the
+	 * copies published by the last SwapComponentBuffers
+	 * Points instanceDataOffset at the data and sets renderInstanceCount. With GPU culling every instance goes in query
+	 * order for the culling to group, otherwise only the ones inside frustumPlanes go in, grouped by mesh, and
+	 * meshBatches holds each mesh's range.
+	 */
+	void extractRenderInstances(const std::array<glm::vec4, 6>& frustumPlanes);
+
+	/**
+	 * Render every sprite into targetView, splitting the draws over secondary command buffers when there are enough of them
+	 * Layout transitions around the pass are left to the render graph
+	 */
+	void recordSpritePass(VkCommandBuffer commandBuffer, VkImageView targetView);
+
+	/**
+	 * Bind everything the sprite draws need, secondary command buffers inherit none of it from the primary
+	 */
+	void recordDrawState(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+
+	/**
+	 * Record the draws in [begin, end) of drawCommands
+	 */
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end);
+
+	/**
+	 * @return A secondary command buffer from the calling thread's pool for the current frame, reset with the pool
+	 */
+	VkCommandBuffer getSecondaryCommandBuffer(uint32_t threadIdx);
+
 private:
-	void createSwapChain();
+	/**
+	 * @param oldSwapchain The swapchain being replaced, it stays valid for presents already queued to it
+	 */
+	void createSwapChain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+
+	/**
+	 * Replace the swapchain after a resize or a change of present mode without waiting for the device to go idle
+	 */
+	void recreateSwapChain();
+
+	/**
+	 * Destroy the swapchains and views replaced before completedFrameNumber was submitted
+	 */
+	void destroyRetiredSwapchains(uint64_t completedFrameNumber);
 
 	void createImageViews();
 
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& bufferAllocation);
 
 private:
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -179,7 +206,30 @@ private:
 	const uint32_t WIDTH = 800;
 	const uint32_t HEIGHT = 600;
 
-	const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+	// Per frame resources are created for the most any pacing mode uses, framePacer decides how many are cycled through
+	const uint32_t MAX_FRAMES_IN_FLIGHT = FramePacer::MAX_FRAMES_IN_FLIGHT;
+
+	const uint32_t MAX_INSTANCES = MAX_ENTITIES;
+
+	const uint32_t NUM_SPRITES = 100000;
+
+	// Instances a pool thread copies into the frame ring, or bounds it gathers, at a time
+	const uint32_t INSTANCES_PER_EXTRACT_BATCH = 4096;
+
+	// Culling a sphere takes under 2 ns, so smaller batches cost about as much to hand out as to cull
+	static constexpr uint32_t DEFAULT_CPU_CULLING_BATCH_SIZE = 32768;
+
+	// Below this many draws per thread, recording inline beats the cost of secondary command buffers
+	const uint32_t MIN_DRAWS_PER_RECORDING_THREAD = 64;
+
+	const uint32_t MAX_RECORDING_THREADS = 8;
+
+	// Pipelines requested at runtime compile on these, one is plenty once startup has prewarmed the known ones
+	const uint32_t PIPELINE_COMPILE_THREADS = 1;
+
+	// Sizes of the bindless tables, lowered to the device limits
+	const uint32_t MAX_BINDLESS_TEXTURES = 16384;
+	const uint32_t MAX_BINDLESS_STORAGE_BUFFERS = 4096;
 
 	const std::vector<Vertex> vertices =
 	{
@@ -194,6 +244,20 @@ private:
 		3, 0, 2, 1
 	};
 
+	// A range of the shared vertex and index buffers
+	struct MeshRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t vertexOffset;
+	};
+
+	// Indexed by Sprite::meshIdx
+	const std::vector<MeshRange> meshes =
+	{
+		{0, static_cast<uint32_t>(indices.size()), 0}
+	};
+
 #ifndef NDEBUG
 	const std::vector<const char*> desiredValidationLayers =
 	{
@@ -219,18 +283,49 @@ private:
 
 	VkDevice vulkanDevice = VK_NULL_HANDLE;
 
+	DeviceMemoryAllocator gpuAllocator;
+
+	StagingRing stagingRing;
+
+	AsyncUploader asyncUploader;
+
+	// Rebuilt every frame, owns the transitions of the swapchain image and any transient targets
+	RenderGraph renderGraph;
+
+	// The upload every frame has to wait for before it can draw, the scene's meshes and textures
+	uint64_t requiredUploadValue = 0;
+
 	VkSurfaceKHR vulkanSurface = VK_NULL_HANDLE;
 
 	VkSwapchainKHR vulkanSwapchain = VK_NULL_HANDLE;
 	std::vector<VkImage> vulkanSwapchainImages;
 	std::vector<VkImageView> vulkanSwapchainImageViews;
+
+	struct RetiredSwapchain
+	{
+		VkSwapchainKHR swapchain;
+		std::vector<VkImageView> imageViews;
+		// Destroyed once this frame has completed
+		uint64_t frameNumber;
+	};
+
+	// Replaced by a resize but possibly still used by frames in flight, oldest first
+	std::deque<RetiredSwapchain> retiredSwapchains;
 	VkSurfaceFormatKHR vulkanSwapchainSurfaceFormat;
 	VkExtent2D vulkanSwapchainSurfaceExtent;
 
 	VkDescriptorSetLayout vulkanDescriptorSetLayout;
 	VkPipelineLayout vulkanPipelineLayout;
 
-	VkPipeline vulkanGraphicsPipeline;
+	PipelineManager pipelineManager;
+
+	bool bindlessRequested = true;
+	bool bindlessSupported = false;
+	// Only initialized if bindlessSupported
+	BindlessDescriptors bindlessDescriptors;
+	// Kept to request variants of the sprite pipeline, such as for another swapchain format
+	GraphicsPipelineDesc spritePipelineDesc;
+	PipelineID spritePipeline = PipelineManager::INVALID_PIPELINE;
 
 	uint32_t graphicsQueueFamilyIndex = 0;
 	VkQueue vulkanGraphicsQueue;
@@ -242,40 +337,125 @@ private:
 	VkQueue vulkanTransferQueue;
 
 	VkCommandPool vulkanGraphicsCommandPool;
-	VkCommandPool vulkanTransferCommandPool;
 
 	std::vector<VkCommandBuffer> vulkanGraphicsCommandBuffers;
 
+	// Command pools are externally synchronized, so every recording thread gets its own for every frame in flight
+	struct RecordingContext
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> secondaryCommandBuffers;
+		// Handed out this frame, the rest are free
+		uint32_t numUsedCommandBuffers = 0;
+	};
+
+	// Indexed by inFlightFrameIdx * threadPool.GetThreadCount() + thread index
+	std::vector<RecordingContext> recordingContexts;
+
 private:
 	VkBuffer vulkanVertexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory vulkanVertexBufferMemory = VK_NULL_HANDLE;
+	GpuAllocation vulkanVertexBufferAllocation;
 
 	VkBuffer vulkanIndexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory vulkanIndexBufferMemory = VK_NULL_HANDLE;
-
-	std::vector<VkBuffer> vulkanUniformBuffers;
-	std::vector<VkDeviceMemory> vulkanUniformBufferMemory;
-	std::vector<void*> vulkanUniformBufferMappedMemory;
+	GpuAllocation vulkanIndexBufferAllocation;
+
+	// Frame uniforms and instance data, rewritten every frame into the region of the frame in flight
+	FrameRing frameRing;
+	// Room left in each frame's region for per object constants beyond the frame uniforms and instance data
+	const VkDeviceSize FRAME_RING_HEADROOM = 256 * 1024;
+
+	// Into frameRing for the frame being recorded
+	uint32_t frameUniformsOffset = 0;
+	uint32_t instanceDataOffset = 0;
+	uint32_t renderInstanceCount = 0;
+
+	bool gpuCullingRequested = true;
+	bool gpuCullingSupported = false;
+	uint32_t cpuCullingBatchSize = DEFAULT_CPU_CULLING_BATCH_SIZE;
+	uint32_t gpuCullingValidationFrames = 0;
+	uint32_t gpuCullingValidatedFrames = 0;
+	// Only initialized if gpuCullingSupported
+	GpuCulling gpuCulling;
 
 	VkDescriptorPool vulkanDescriptorPool;
-	std::vector<VkDescriptorSet> vulkanDescriptorSets;
+	// Shared by every frame, binding 0 is a dynamic uniform buffer offset to frameUniformsOffset when bound
+	VkDescriptorSet vulkanDescriptorSet = VK_NULL_HANDLE;
 
 private:
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
+	GpuAllocation textureImageAllocation;
+	VkFormat textureFormat = VK_FORMAT_UNDEFINED;
+	uint32_t textureMipLevels = 1;
 
 	VkImageView textureImageView;
 	VkSampler textureSampler;
+	BindlessIndex textureBindlessIdx = 0;
 
 private:
-	Scene scene;
+	// The set of components the engine uses is fixed, so builds with FIREFLY_STATIC_SCENE resolve them at compile time
+#ifdef FIREFLY_STATIC_SCENE
+	typedef StaticScene<Transform, Sprite, TestComponent1, TestComponent2> EngineScene;
+#else
+	typedef Scene EngineScene;
+#endif
+
+	EngineScene scene;
+
+	QueryID renderableQuery = 0;
+
+	struct MeshBatch
+	{
+		uint32_t firstInstance = 0;
+		uint32_t instanceCount = 0;
+	};
+
+	// Parallel to meshes
+	std::vector<MeshBatch> meshBatches;
+
+	// Parallel to meshes, around the origin the vertex shader scales and rotates the mesh about
+	std::vector<float> meshBoundingRadii;
+
+	// Parallel to the renderable query's entities, only used when the CPU culls
+	BoundingSpheres renderableBounds;
+	FrustumCuller frustumCuller;
+
+	struct DrawCommand
+	{
+		uint32_t meshIdx;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	// This frame's draws in submission order, recording threads take disjoint ranges of it
+	std::vector<DrawCommand> drawCommands;
+
+	// One per batch of drawCommands, executed in order so the draw order matches inline recording
+	std::vector<VkCommandBuffer> recordedSecondaryCommandBuffers;
+
+	ThreadPool threadPool;
+
+	// Decodes the scene's assets on threadPool while the window and device are created, declared after the pool so
+	// it is destroyed first
+	AssetLoader assetLoader;
+	AssetID sceneTexture = 0;
 	
 	bool windowCloseRequested = false;
 
 	uint32_t inFlightFrameIdx = 0;
 
+	EFramePacingMode framePacingMode = EFramePacingMode::Throughput;
+
+	FramePacer framePacer;
+
+	std::chrono::high_resolution_clock::time_point lastTimingReportTime;
+
+	// Counts submitted frames starting at 1, so 0 always reads as already completed
+	uint64_t frameNumber = 1;
+
 	bool frameBufferResized = false;
 
+	bool textureCompressionBCSupported = false;
+
 	enum class EBinaryInput
 	{
 		AKey = 0, BKey, CKey, DKey,
@@ -332,11 +512,11 @@ private:
 
 	} InputState;
 	
-	float modelRotationRad = 0.f;
-
 	glm::vec3 cameraPosition = {-2.f, 0.f, 2.f};
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderingFinishedSemaphores;
 	std::vector<VkFence> inFlightFences;
+	// The frameNumber last submitted with each of inFlightFences
+	std::vector<uint64_t> inFlightFrameNumbers;
 };
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "VulkanCommon.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// Tradeoffs between smoothness, latency and tearing, picked per deployment
+enum class EFramePacingMode : uint8_t
+{
+	// Vsync with the CPU running up to three frames ahead, the GPU never starves but input waits in the queue longer
+	Throughput = 0,
+	// One frame in flight and input sampled only once the previous frame has finished on the GPU
+	LowLatency,
+	// Present as soon as a frame is done even if it tears, two frames in flight
+	VsyncOff,
+	Count
+};
+
+const char* GetFramePacingModeName(EFramePacingMode mode);
+
+/**
+ * @param name A name as returned by GetFramePacingModeName, ignoring case
+ * @return false if no mode has that name
+ */
+bool ParseFramePacingMode(std::string_view name, EFramePacingMode& outMode);
+
+/**
+ * What a frame cost, in milliseconds
+ */
+struct FrameTimings
+{
+	// Blocked on the frame slot's fence before the frame could start
+	float cpuWaitMs = 0.f;
+	// From the start of one frame on the CPU to the start of the next
+	float cpuFrameMs = 0.f;
+	// Between the timestamps around the frame's command buffer, 0 when the queue has no timestamps
+	float gpuMs = 0.f;
+	// From sampling input until the GPU finished the frame, the present itself adds up to another refresh when vsynced
+	float inputToPresentMs = 0.f;
+};
+
+/**
+ * Owns how many frames may be in flight, when input is sampled relative to waiting for the GPU and which present mode
+ * the swapchain is created with, and measures what each frame cost
+ * The engine keeps MAX_FRAMES_IN_FLIGHT sets of per frame resources and only cycles through the first GetFramesInFlight().
+ * Timings of a frame become known once its slot is waited on again, GetLatestTimings lags accordingly.
+ */
+class FramePacer
+{
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	/**
+	 * @param queueFamilyIdx The family the frames are submitted to, for whether it supports timestamps
+	 */
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIdx, EFramePacingMode mode);
+
+	/**
+	 * The device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Takes effect from the next frame, the caller recreates the swapchain so the present mode follows
+	 */
+	void SetMode(EFramePacingMode mode);
+
+	[[nodiscard]] EFramePacingMode GetMode() const { return mMode; }
+
+	[[nodiscard]] uint32_t GetFramesInFlight() const;
+
+	/**
+	 * Wait for the previous frame before sampling input rather than after, trading CPU/GPU overlap for latency
+	 */
+	[[nodiscard]] bool ShouldWaitBeforeSampling() const;
+
+	/**
+	 * @param availablePresentModes What the surface supports, FIFO always is
+	 */
+	[[nodiscard]] VkPresentModeKHR ChoosePresentMode(std::span<const VkPresentModeKHR> availablePresentModes) const;
+
+	/**
+	 * @return How many swapchain images to ask for, before clamping to the surface's limits
+	 */
+	[[nodiscard]] uint32_t ChooseSwapchainImageCount(uint32_t surfaceMinImageCount) const;
+
+	/**
+	 * Call right after waiting on the frame slot's fence, resolves the timings of the frame that last used the slot
+	 */
+	void OnFrameSlotReady(uint32_t frameSlot, Clock::time_point waitStart, Clock::time_point waitEnd);
+
+	/**
+	 * Call when the input the next submitted frame acts on has been polled
+	 */
+	void OnInputSampled();
+
+	/**
+	 * Record the timestamp at the very start of the frame's command buffer, including the query reset
+	 */
+	void WriteBeginTimestamp(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	/**
+	 * Record the timestamp at the very end of the frame's command buffer
+	 */
+	void WriteEndTimestamp(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	/**
+	 * Call right after the frame's command buffer was submitted
+	 */
+	void OnSubmitted(uint32_t frameSlot);
+
+	[[nodiscard]] const FrameTimings& GetLatestTimings() const { return mLatestTimings; }
+
+	/**
+	 * Average over the frames resolved since the previous call, for periodic reporting
+	 * @return false if no frame was resolved since
+	 */
+	bool ConsumeAverageTimings(FrameTimings& outTimings, uint32_t& outFrameCount);
+
+private:
+	struct FrameSlot
+	{
+		// Known when the frame starts, reported together with the rest once the slot comes around again
+		float cpuWaitMs = 0.f;
+		float cpuFrameMs = 0.f;
+
+		Clock::time_point inputSampleTime;
+		Clock::time_point submitTime;
+		bool bTimestampsWritten = false;
+		bool bSubmitted = false;
+	};
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+
+	EFramePacingMode mMode = EFramePacingMode::Throughput;
+
+	// Two timestamps per frame slot, null when the queue family has no timestamp support
+	VkQueryPool mTimestampQueryPool = VK_NULL_HANDLE;
+	// Nanoseconds per timestamp tick
+	float mTimestampPeriod = 1.f;
+	uint64_t mTimestampMask = ~0ull;
+
+	std::array<FrameSlot, MAX_FRAMES_IN_FLIGHT> mFrameSlots;
+
+	// Input may be sampled before the slot is free, so it only moves into the slot on submission
+	Clock::time_point mPendingInputSampleTime;
+
+	Clock::time_point mPreviousFrameStart;
+	bool mHasPreviousFrameStart = false;
+
+	FrameTimings mLatestTimings;
+
+	FrameTimings mAccumulatedTimings;
+	uint32_t mAccumulatedFrameCount = 0;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "GpuAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+
+struct FrameRingAllocation
+{
+	void* pMapped = nullptr;
+	// From the start of the ring buffer, usable as a dynamic descriptor offset or a vertex buffer offset
+	uint32_t offset = 0;
+};
+
+/**
+ * A persistently mapped buffer for everything the CPU writes fresh every frame: frame uniforms, per object constants and instance data
+ * It holds one region per frame in flight and each frame bump allocates from its own region. Uniform blocks written into it are
+ * bound through dynamic offsets of a descriptor set written once, so nothing is created, allocated or updated per frame or per object.
+ * Allocate is thread safe, BeginFrame is not.
+ */
+class FrameRing
+{
+public:
+	/**
+	 * @param bytesPerFrame Most a frame allocates, the whole ring must stay under 4 GiB as dynamic offsets are 32 bit
+	 * @param usage Every way the allocations are bound, uniform, storage and vertex buffer
+	 */
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize bytesPerFrame, uint32_t numFrames, VkBufferUsageFlags usage);
+
+	/**
+	 * The device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Start allocating from the region of frameSlot, dropping everything allocated the last time it was used
+	 * The GPU must be done with the frame that last used the slot.
+	 */
+	void BeginFrame(uint32_t frameSlot);
+
+	/**
+	 * Throws if the frame's region is full
+	 * @return Space aligned for any uniform, storage or vertex binding, valid until the slot comes around again
+	 */
+	FrameRingAllocation Allocate(VkDeviceSize size);
+
+	[[nodiscard]] VkBuffer GetBuffer() const { return mBuffer; }
+
+	[[nodiscard]] VkDeviceSize GetAlignment() const { return mAlignment; }
+
+	/**
+	 * @return Bytes allocated so far by the current frame, alignment padding included
+	 */
+	[[nodiscard]] VkDeviceSize GetFrameUsage() const;
+
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* mAllocator = nullptr;
+
+	VkBuffer mBuffer = VK_NULL_HANDLE;
+	GpuAllocation mAllocation;
+
+	VkDeviceSize mAlignment = 0;
+	VkDeviceSize mBytesPerFrame = 0;
+	uint32_t mNumFrames = 0;
+
+	VkDeviceSize mFrameBegin = 0;
+	// Relative to mFrameBegin
+	std::atomic<VkDeviceSize> mFrameCursor = 0;
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "VulkanCommon.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// Resources that need to live in separate blocks so neighbouring allocations never violate bufferImageGranularity
+enum class EGpuResourceKind : uint8_t
+{
+	// Buffers and linearly tiled images
+	Linear = 0,
+	// Optimally tiled images
+	Optimal,
+	Count
+};
+
+/**
+ * A range of device memory handed out by DeviceMemoryAllocator
+ * Bind resources with memory and offset; pMapped is only set for host visible memory, which stays mapped for its whole lifetime
+ */
+struct GpuAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	// Kept so Defragment can place the allocation somewhere else with the same constraints
+	VkDeviceSize alignment = 1;
+	void* pMapped = nullptr;
+
+	uint32_t memoryTypeIdx = 0;
+	EGpuResourceKind kind = EGpuResourceKind::Linear;
+	// Index into the allocator's blocks, DEDICATED_BLOCK when the allocation owns its VkDeviceMemory
+	uint32_t blockIdx = 0;
+
+	[[nodiscard]] bool IsValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+/**
+ * Reserves large VkDeviceMemory blocks per memory type and sub-allocates buffers and images out of them
+ * Keeps vkAllocateMemory calls far below maxMemoryAllocationCount; requests that are large, or that the driver
+ * prefers to be dedicated, get their own allocation instead. Thread safe.
+ */
+class DeviceMemoryAllocator
+{
+public:
+	static constexpr uint32_t DEDICATED_BLOCK = UINT32_MAX;
+
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	struct Statistics
+	{
+		uint32_t blockCount = 0;
+		uint32_t dedicatedAllocationCount = 0;
+		uint32_t allocationCount = 0;
+		// Sum of the sizes of every VkDeviceMemory we own
+		VkDeviceSize reservedBytes = 0;
+		// Bytes handed out to live allocations, excluding alignment padding
+		VkDeviceSize usedBytes = 0;
+		// The largest single free range in any block, a rough measure of fragmentation
+		VkDeviceSize largestFreeRange = 0;
+	};
+
+	/**
+	 * Called by Defragment once per allocation it wants to move
+	 * The callee creates a new resource bound to newAllocation, copies the old contents across and rebinds its users
+	 * @return false to keep the allocation where it is
+	 */
+	typedef std::function<bool(const GpuAllocation& oldAllocation, const GpuAllocation& newAllocation)> DefragmentMoveFn;
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+
+	/**
+	 * Release every block, all allocations must have been freed by now
+	 */
+	void Shutdown();
+
+	/**
+	 * Allocate memory for the buffer and bind it
+	 * @param properties Flags the memory type must have
+	 */
+	GpuAllocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+
+	/**
+	 * Allocate memory for the image and bind it
+	 * @param properties Flags the memory type must have
+	 */
+	GpuAllocation AllocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties);
+
+	/**
+	 * Allocate memory without binding it to anything
+	 * @param bDedicated Give the allocation its own VkDeviceMemory
+	 */
+	GpuAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, EGpuResourceKind kind, bool bDedicated = false);
+
+	/**
+	 * Return the memory to its block, the resource bound to it must already be destroyed
+	 */
+	void Free(GpuAllocation& allocation);
+
+	/**
+	 * Move allocations out of sparsely used blocks into free space of the fuller ones, then release blocks that became empty
+	 * Only the allocations passed in are candidates, they are updated in place when moved
+	 * The old range is released as soon as moveFn returns, so moveFn must finish its copy before returning
+	 * and must not call back into the allocator
+	 * @return The number of allocations that moved
+	 */
+	uint32_t Defragment(std::span<GpuAllocation*> allocations, const DefragmentMoveFn& moveFn);
+
+	[[nodiscard]] Statistics GetStatistics() const;
+
+	/**
+	 * @return The first memory type allowed by typeBits with all of properties, or UINT32_MAX
+	 */
+	[[nodiscard]] uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+
+private:
+	struct FreeRange
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize usedBytes = 0;
+		uint32_t allocationCount = 0;
+		uint32_t memoryTypeIdx = 0;
+		EGpuResourceKind kind = EGpuResourceKind::Linear;
+		uint8_t* pMapped = nullptr;
+		// Sorted by offset, adjacent ranges are always merged
+		std::vector<FreeRange> freeRanges;
+	};
+
+	/**
+	 * Walks the memory types allowed by the requirements in order, moving on to the next one when a heap is exhausted
+	 * @param pDedicatedInfo Chained into dedicated allocations so the driver knows which resource they are for, may be null
+	 */
+	GpuAllocation AllocateLocked(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, EGpuResourceKind kind, bool bDedicated, const VkMemoryDedicatedAllocateInfo* pDedicatedInfo);
+
+	/**
+	 * Best fit search through the free ranges of the block
+	 * @return Whether the block had room, in which case outAllocation is filled in
+	 */
+	bool SubAllocate(uint32_t blockIdx, VkDeviceSize size, VkDeviceSize alignment, GpuAllocation& outAllocation);
+
+	bool AllocateDedicated(uint32_t memoryTypeIdx, VkDeviceSize size, const VkMemoryDedicatedAllocateInfo* pDedicatedInfo, GpuAllocation& outAllocation);
+
+	/**
+	 * @return The index of the new block, or UINT32_MAX if the heap is out of memory
+	 */
+	uint32_t CreateBlock(uint32_t memoryTypeIdx, EGpuResourceKind kind);
+
+	void FreeLocked(GpuAllocation& allocation);
+
+	void ReleaseBlock(uint32_t blockIdx);
+
+	[[nodiscard]] VkDeviceSize GetBlockSize(uint32_t memoryTypeIdx) const;
+
+	[[nodiscard]] VkDeviceSize GetMinAlignment(uint32_t memoryTypeIdx) const;
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties mMemoryProperties{};
+	VkDeviceSize mNonCoherentAtomSize = 1;
+	VkDeviceSize mPreferredBlockSize = DEFAULT_BLOCK_SIZE;
+
+	// Released blocks leave a hole (memory == VK_NULL_HANDLE) so the indices stored in live allocations stay valid
+	std::vector<MemoryBlock> mBlocks;
+
+	uint32_t mDedicatedAllocationCount = 0;
+	VkDeviceSize mDedicatedBytes = 0;
+
+	mutable std::mutex mMutex;
+};
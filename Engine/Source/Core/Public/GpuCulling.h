@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Culling.h"
+#include "GpuAllocator.h"
+#include "PipelineManager.h"
+#include "RenderGraph.h"
+#include "StagingRing.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Index range and bounds of one mesh as the cull shader reads them, matches Mesh in cull.comp
+struct GpuCullMesh
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	// Around the mesh's origin, before the instance's scale
+	float boundingRadius;
+};
+
+/**
+ * Frustum culls instances on the GPU and draws the visible ones with indirect draws the GPU wrote itself
+ * A compute pass reads the frame's instances from the frame ring, tests each one's bounding sphere against the frustum
+ * planes in the frame uniforms, and writes the survivors grouped by mesh into a culled instance buffer plus one
+ * VkDrawIndexedIndirectCommand per mesh with any. The CPU only hands over the instances and never sees the draws.
+ * Draws go through vkCmdDrawIndexedIndirectCount where the device has it, else through every mesh's command with the
+ * unused ones empty. Needs nothing beyond core compute, so it also runs on software implementations such as lavapipe.
+ * Every frame in flight has its own counters, draws and culled instances, so a frame's culling never waits for the draws
+ * of the one before it. With validation enabled each frame's results are read back and checked against FrustumCuller.
+ */
+class GpuCulling
+{
+public:
+	// local_size_x of cull.comp
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+	// Bytes per instance, InstanceData has to match Instance in cull.comp
+	static constexpr uint32_t INSTANCE_STRIDE = 32;
+
+	// The draw count sits in front of the commands in the draw buffer
+	static constexpr VkDeviceSize DRAW_COMMANDS_OFFSET = 16;
+
+	struct Outputs
+	{
+		// Draw count and commands, read as IndirectBufferRead
+		RenderGraphResource draws = RenderGraph::INVALID_RESOURCE;
+		// The per instance vertex buffer of the draws, read as VertexBufferRead
+		RenderGraphResource instances = RenderGraph::INVALID_RESOURCE;
+	};
+
+	/**
+	 * @param queueFamilyIndex The family the culling dispatches and the draws are recorded for
+	 * @return Whether the device can take indirect draws starting at any instance and the family runs compute
+	 */
+	static bool IsSupported(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex);
+
+	/**
+	 * Turn on the features IsSupported needs, plus multi draw indirect and draw indirect count where the device has them
+	 */
+	static void EnableFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures& features, VkPhysicalDeviceVulkan12Features& vulkan12Features);
+
+	/**
+	 * @param frameRingBuffer Holds the frame uniforms and source instances, bound through dynamic offsets
+	 * @param frameUniformsSize Bytes of the frame uniforms, which end with the frustum planes
+	 * @param maxInstances Most instances culled in a frame, every frame's source instances must have room for this many
+	 * @param numFrames Frames in flight, each frame slot gets its own outputs
+	 * @param meshes Indexed by the instances' mesh index, uploaded through stagingRing
+	 */
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, PipelineManager& pipelineManager, StagingRing& stagingRing,
+		VkBuffer frameRingBuffer, VkDeviceSize frameUniformsSize, uint32_t maxInstances, uint32_t numFrames, std::span<const GpuCullMesh> meshes);
+
+	/**
+	 * The device must be idle, the pipelines belong to the pipeline manager
+	 */
+	void Shutdown();
+
+	/**
+	 * Add the passes culling this frame's instances, the pass drawing them declares the accesses of Outputs
+	 * @param frameSlot The frame in flight being recorded, the GPU must be done with the frame that last used it
+	 * @param frameUniformsOffset @param sourceInstancesOffset Into the frame ring buffer
+	 */
+	Outputs AddPasses(RenderGraph& renderGraph, uint32_t frameSlot, uint32_t frameUniformsOffset, uint32_t sourceInstancesOffset, uint32_t instanceCount);
+
+	/**
+	 * Record the culled draws of the frame slot, with its GetInstanceBuffer bound as the per instance vertex buffer
+	 */
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t frameSlot) const;
+
+	[[nodiscard]] VkBuffer GetInstanceBuffer(uint32_t frameSlot) const { return mFrameSlots[frameSlot].instanceBuffer; }
+
+	/**
+	 * Copy every frame's draws and culled instances to host visible memory at the end of its culling, for ValidateFrame
+	 * Call once after Init.
+	 */
+	void EnableValidation();
+
+	/**
+	 * Keep a copy of what the frame slot's culling is about to read, before AddPasses of the same frame
+	 * @param sourceInstances The instances written at sourceInstancesOffset, INSTANCE_STRIDE bytes each
+	 * @param planes The frustum planes written into the frame uniforms
+	 */
+	void CaptureValidationInputs(uint32_t frameSlot, std::span<const std::byte> sourceInstances, const std::array<glm::vec4, 6>& planes);
+
+	/**
+	 * Check what the GPU culled in the frame slot's last frame against FrustumCuller on the captured inputs, call once
+	 * the frame's fence has signalled. Instances within rounding of a plane may go either way, anything else must match:
+	 * the same visible instances in the same order, grouped by mesh, with one draw per mesh with any.
+	 * Throws describing the first difference.
+	 * @return Whether the slot had a frame to check
+	 */
+	bool ValidateFrame(uint32_t frameSlot, ThreadPool& threadPool);
+
+	[[nodiscard]] bool HasDrawIndirectCount() const { return mHasDrawIndirectCount; }
+
+private:
+	// The value of CULL_CONSTANT_PHASE in cull.comp
+	enum class ECullPhase : uint32_t
+	{
+		CountVisible = 0,
+		BuildDraws,
+		ScatterVisible,
+		Count
+	};
+
+	// CullParameters in cull.comp
+	struct PushConstants
+	{
+		uint32_t instanceCount;
+		uint32_t meshCount;
+	};
+
+	// What one frame's dispatches read
+	struct FrameInputs
+	{
+		uint32_t frameUniformsOffset;
+		uint32_t sourceInstancesOffset;
+		uint32_t instanceCount;
+	};
+
+	// Everything one frame in flight writes
+	struct FrameSlot
+	{
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+		// First culled instance of every mesh, then every workgroup's count of every mesh
+		VkBuffer counterBuffer = VK_NULL_HANDLE;
+		GpuAllocation counterAllocation;
+
+		VkBuffer drawBuffer = VK_NULL_HANDLE;
+		GpuAllocation drawAllocation;
+
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		GpuAllocation instanceAllocation;
+
+		// Only with validation, the draw buffer followed by the culled instances
+		VkBuffer readbackBuffer = VK_NULL_HANDLE;
+		GpuAllocation readbackAllocation;
+
+		// What the frame's culling read, only with validation
+		std::vector<std::byte> validationInstances;
+		std::array<glm::vec4, 6> validationPlanes{};
+		uint32_t validationInstanceCount = 0;
+		bool bValidationPending = false;
+	};
+
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& outBuffer, GpuAllocation& outAllocation);
+
+	void RecordDispatch(VkCommandBuffer commandBuffer, ECullPhase phase, const FrameSlot& slot, const FrameInputs& inputs, uint32_t groupCount) const;
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* mAllocator = nullptr;
+
+	bool mHasDrawIndirectCount = false;
+	bool mHasMultiDrawIndirect = false;
+
+	uint32_t mMaxInstances = 0;
+	uint32_t mMeshCount = 0;
+
+	VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
+
+	// Indexed by ECullPhase, one specialization of cull.comp each
+	VkPipeline mPipelines[static_cast<size_t>(ECullPhase::Count)] = {};
+
+	VkBuffer mMeshBuffer = VK_NULL_HANDLE;
+	GpuAllocation mMeshAllocation;
+
+	VkDeviceSize mCounterBufferSize = 0;
+	VkDeviceSize mDrawBufferSize = 0;
+
+	std::vector<FrameSlot> mFrameSlots;
+
+	// Kept for ValidateFrame
+	std::vector<GpuCullMesh> mMeshes;
+	BoundingSpheres mValidationBounds;
+	FrustumCuller mValidationCuller;
+};
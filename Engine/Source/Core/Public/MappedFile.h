@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+/**
+ * A whole file mapped read only into memory
+ * Pages are read in by the OS as they are first touched, so copying the contents somewhere else reads the file once
+ * with no buffer in between.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * @return false if the file does not exist, is empty or cannot be mapped
+	 */
+	bool Open(const std::filesystem::path& path);
+
+	void Close();
+
+	[[nodiscard]] bool IsOpen() const { return mpData != nullptr; }
+
+	/**
+	 * @return The file contents, valid until Close
+	 */
+	[[nodiscard]] std::span<const uint8_t> GetData() const { return {mpData, mSize}; }
+
+private:
+	const uint8_t* mpData = nullptr;
+	size_t mSize = 0;
+
+#ifdef _WIN32
+	void* mFileHandle = nullptr;
+	void* mMappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Component.h"
+
+#include <cstdint>
+
+/**
+ * Find every index in [begin, end) whose mask contains all of requiredMask and none of excludedMask
+ * Uses AVX2 or SSE2 depending on what the CPU supports, with a scalar fallback for the tail and other architectures
+ * @param masks Packed component masks indexed by entity index
+ * @param outIndices Receives the matching indices in ascending order, must have room for end - begin entries
+ * @return The number of indices written to outIndices
+ */
+uint32_t ScanComponentMasks(const PackedComponentMask* masks, uint32_t begin, uint32_t end, PackedComponentMask requiredMask, PackedComponentMask excludedMask, uint32_t* outIndices);
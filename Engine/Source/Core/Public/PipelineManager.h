@@ -0,0 +1,274 @@
+#pragma once
+
+#include "Threading.h"
+#include "VulkanCommon.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t ShaderID;
+typedef uint32_t PipelineID;
+
+/**
+ * A 32 bit specialization constant, bools are VkBool32 and floats their bit pattern
+ */
+struct SpecializationConstant
+{
+	uint32_t constantID;
+	uint32_t value;
+};
+
+/**
+ * Everything that decides a graphics pipeline built for dynamic rendering
+ * Plain data so two descriptions of the same pipeline hash and compare equal, viewport and scissor are always dynamic
+ */
+struct GraphicsPipelineDesc
+{
+	ShaderID vertexShader = UINT32_MAX;
+	ShaderID fragmentShader = UINT32_MAX;
+
+	// Given to every stage, a stage ignores the IDs it does not declare
+	std::vector<SpecializationConstant> specializationConstants;
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	bool bDepthTest = false;
+	bool bDepthWrite = false;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	// One blend state per color attachment
+	std::vector<VkFormat> colorFormats;
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendStates;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	// Owned by the caller and alive for as long as the pipeline is used
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	bool operator==(const GraphicsPipelineDesc& other) const;
+};
+
+/**
+ * @return A hash of every field of desc, equal descriptions hash equal
+ */
+uint64_t HashGraphicsPipelineDesc(const GraphicsPipelineDesc& desc);
+
+/**
+ * Everything that decides a compute pipeline
+ */
+struct ComputePipelineDesc
+{
+	ShaderID computeShader = UINT32_MAX;
+
+	std::vector<SpecializationConstant> specializationConstants;
+
+	// Owned by the caller and alive for as long as the pipeline is used
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	bool operator==(const ComputePipelineDesc& other) const;
+};
+
+/**
+ * Owns shader modules, graphics pipelines and the VkPipelineCache they are compiled through
+ * The cache is loaded from disk on Init and written back on Shutdown, so pipelines compiled by an earlier run on the same
+ * device and driver come out of the cache instead of the compiler. Registering a pipeline whose description matches one
+ * already registered returns the existing one. Thread safe.
+ * Pipelines can be requested without waiting for them, background threads compile them while the render thread draws
+ * with a fallback or skips the draws until they are ready.
+ */
+class PipelineManager
+{
+public:
+	static constexpr PipelineID INVALID_PIPELINE = UINT32_MAX;
+
+	struct Statistics
+	{
+		uint32_t shaderCount = 0;
+		uint32_t pipelineCount = 0;
+		// Registrations answered with an existing pipeline
+		uint32_t deduplicatedCount = 0;
+		// Size of the cache blob accepted from disk, 0 if there was none or it belonged to another device or driver
+		size_t loadedCacheBytes = 0;
+		// Compiled by the background threads rather than by a caller waiting for them
+		uint32_t backgroundCompiledCount = 0;
+		uint32_t failedCount = 0;
+		// Time spent inside vkCreateGraphicsPipelines and vkCreateComputePipelines, summed over all threads
+		double compileMilliseconds = 0.0;
+	};
+
+	/**
+	 * @param cachePath Where the pipeline cache is read from and written back to, its directory is created if needed
+	 * @param numCompileThreads Threads compiling requested pipelines in the background
+	 */
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::filesystem::path& cachePath, uint32_t numCompileThreads = 1);
+
+	/**
+	 * Stop the background threads, pipelines still queued are never compiled
+	 * Save the cache and destroy every pipeline and shader module, the device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Write the cache to disk now, for example after a loading screen compiled many pipelines
+	 * Failing to write is not fatal, the next run just compiles again
+	 */
+	void SaveCache();
+
+	/**
+	 * @param code SPIR-V words, the same code registered twice shares one module
+	 */
+	ShaderID RegisterShader(std::span<const uint32_t> code);
+
+	/**
+	 * Compile the pipeline, or find the one registered for an equal description, and wait until it is ready
+	 * A pipeline that was only requested is compiled right away by the calling thread, or waited for if a background
+	 * thread is already on it.
+	 */
+	PipelineID RegisterGraphicsPipeline(const GraphicsPipelineDesc& desc);
+
+	/**
+	 * Queue the pipeline for a background thread and return without waiting, equal descriptions share one pipeline
+	 * @param fallback Returned by GetPipeline until this one is ready, it must accept the same draws. When the
+	 * description was already requested, the fallback is only taken if the shared pipeline has none yet.
+	 */
+	PipelineID RequestGraphicsPipeline(const GraphicsPipelineDesc& desc, PipelineID fallback = INVALID_PIPELINE);
+
+	/**
+	 * Compile every pipeline a level or menu is known to need, spread over all threads of the pool, and wait for them
+	 * Meant for loading screens, the threads of the pool are busy until it returns.
+	 * @return The pipeline for each description, in the same order, INVALID_PIPELINE for the ones that failed to compile
+	 * after logging why, the rest are still compiled
+	 */
+	std::vector<PipelineID> PrewarmGraphicsPipelines(std::span<const GraphicsPipelineDesc> descs, ThreadPool& threadPool);
+
+	/**
+	 * Compile the compute pipeline, or find the one created for an equal description
+	 * Compute pipelines are few and needed before their first dispatch, so they are compiled right away and never in the background.
+	 * @return Owned by the manager and destroyed on Shutdown
+	 */
+	VkPipeline CreateComputePipeline(const ComputePipelineDesc& desc);
+
+	[[nodiscard]] bool IsPipelineReady(PipelineID pipeline) const;
+
+	/**
+	 * @return The pipeline if it is ready, else its fallback if that is, else VK_NULL_HANDLE and the caller skips the draw
+	 */
+	[[nodiscard]] VkPipeline GetPipeline(PipelineID pipeline) const;
+
+	[[nodiscard]] Statistics GetStatistics() const;
+
+private:
+	// Written in front of the driver's blob, which only identifies the device, so a driver update invalidates the file too
+	struct CacheFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	static constexpr uint32_t CACHE_FILE_MAGIC = 0x43504646; // "FFPC"
+	static constexpr uint32_t CACHE_FILE_VERSION = 1;
+
+	struct Shader
+	{
+		VkShaderModule module;
+		uint64_t codeHash;
+		std::vector<uint32_t> code;
+	};
+
+	enum class EPipelineState : uint8_t
+	{
+		Queued,
+		Compiling,
+		Ready,
+		Failed
+	};
+
+	struct Pipeline
+	{
+		// Never changes once the entry is added, so it can be read without holding the lock
+		GraphicsPipelineDesc desc;
+		uint64_t hash;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		EPipelineState state = EPipelineState::Queued;
+		PipelineID fallback = INVALID_PIPELINE;
+	};
+
+	/**
+	 * @return The cache contents if the file exists and was written for this device and driver, empty otherwise
+	 */
+	std::vector<uint8_t> LoadCacheFile() const;
+
+	VkPipeline CreateGraphicsPipeline(const GraphicsPipelineDesc& desc);
+
+	/**
+	 * @return The entry with an equal description, INVALID_PIPELINE if there is none. Requires mMutex.
+	 */
+	PipelineID FindPipeline(const GraphicsPipelineDesc& desc, uint64_t hash) const;
+
+	/**
+	 * @return Whether target is pipeline itself or somewhere down its chain of fallbacks. Requires mMutex.
+	 */
+	bool FallsBackTo(PipelineID pipeline, PipelineID target) const;
+
+	/**
+	 * Compile a pipeline the caller just moved to Compiling, the lock is released while compiling
+	 * @return false if compiling failed, the entry is then Failed
+	 */
+	bool CompilePipeline(PipelineID pipeline, std::unique_lock<std::mutex>& lock, bool bBackground);
+
+	void CompileThreadMain();
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties mDeviceProperties{};
+
+	std::filesystem::path mCachePath;
+	VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+
+	mutable std::mutex mMutex;
+
+	// Deques so entries stay put while others are added
+	std::deque<Shader> mShaders;
+	std::unordered_map<uint64_t, std::vector<ShaderID>> mShadersByHash;
+
+	std::deque<Pipeline> mPipelines;
+	std::unordered_map<uint64_t, std::vector<PipelineID>> mPipelinesByHash;
+
+	struct ComputePipeline
+	{
+		ComputePipelineDesc desc;
+		VkPipeline pipeline;
+	};
+
+	// Searched linearly, there are only a handful
+	std::vector<ComputePipeline> mComputePipelines;
+
+	std::vector<std::thread> mCompileThreads;
+	// Entries may have been claimed by a waiting caller meanwhile, the compile threads skip those
+	std::deque<PipelineID> mCompileQueue;
+	std::condition_variable mCompileQueued;
+	std::condition_variable mCompileFinished;
+	bool mStopping = false;
+
+	Statistics mStatistics;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Component.h"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+typedef uint32_t PrefabID;
+
+/**
+ * A set of components together with their initial values
+ * Register it with RegisterPrefab of a Scene or StaticScene once, then stamp out copies with InstantiatePrefab
+ */
+class Prefab
+{
+public:
+	/**
+	 * Add a component to the prefab, or replace its initial value if it is already part of it
+	 * @tparam T The class of the component, copied around with memcpy so it must be trivially copyable
+	 * @param value The value every instance starts with
+	 */
+	template<typename T>
+	Prefab& Set(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Prefab components are stamped with memcpy");
+
+		const uint32_t componentId = GetComponentId<T>();
+
+		ComponentTemplate* pTemplate = nullptr;
+		for (ComponentTemplate& component : mComponents)
+		{
+			if (component.componentId == componentId)
+			{
+				pTemplate = &component;
+				break;
+			}
+		}
+
+		if (pTemplate == nullptr)
+		{
+			pTemplate = &mComponents.emplace_back();
+			pTemplate->componentId = componentId;
+			pTemplate->componentSize = sizeof(T);
+			pTemplate->stamp.resize(sizeof(T) * NUM_COMPONENTS_PER_CHUNK);
+		}
+
+		// Pre-replicate the value across a whole chunk so any run of instances is a single memcpy
+		for (uint32_t i = 0; i < NUM_COMPONENTS_PER_CHUNK; ++i)
+		{
+			std::memcpy(pTemplate->stamp.data() + i * sizeof(T), &value, sizeof(T));
+		}
+
+		mMask.set(componentId);
+		return *this;
+	}
+
+	[[nodiscard]] ComponentMask GetMask() const { return mMask; }
+
+private:
+	friend struct Scene;
+	template<typename... Components>
+	friend class StaticScene;
+
+	struct ComponentTemplate
+	{
+		uint32_t componentId = 0;
+		size_t componentSize = 0;
+		// NUM_COMPONENTS_PER_CHUNK back to back copies of the initial value
+		std::vector<uint8_t> stamp;
+	};
+
+	ComponentMask mMask;
+	std::vector<ComponentTemplate> mComponents;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+// Placement of an entity in the world, rotation is about the Z axis in radians
+struct Transform
+{
+	glm::vec3 position{0.f};
+	float rotation = 0.f;
+	glm::vec2 scale{1.f};
+};
+
+// Marks an entity as drawn with one of the engine's meshes, all sprites sharing a mesh go out in a single instanced draw
+// whatever their textures
+struct Sprite
+{
+	uint32_t meshIdx = 0;
+	// Slot of the texture in the bindless table, ignored when the device has no bindless descriptors
+	uint32_t textureIdx = 0;
+};
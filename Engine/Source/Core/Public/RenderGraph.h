@@ -0,0 +1,281 @@
+#pragma once
+
+#include "GpuAllocator.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The ways a pass can touch a resource, each maps to one synchronization2 stage, access and image layout
+enum class ERenderGraphAccess : uint8_t
+{
+	// Nothing has touched the resource yet, its contents are undefined
+	None = 0,
+	// A swapchain image straight out of vkAcquireNextImageKHR, whose semaphore is waited on at color attachment output
+	SwapchainAcquire,
+	ColorAttachmentWrite,
+	DepthAttachmentWrite,
+	DepthAttachmentRead,
+	VertexShaderSampledRead,
+	FragmentShaderSampledRead,
+	ComputeShaderSampledRead,
+	ComputeShaderStorageRead,
+	ComputeShaderStorageWrite,
+	TransferRead,
+	TransferWrite,
+	VertexBufferRead,
+	IndexBufferRead,
+	IndirectBufferRead,
+	UniformRead,
+	Present,
+	Count
+};
+
+// A transient image the graph creates and places in memory shared with other transients that are never alive at the same time
+struct RenderGraphImageDesc
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{0, 0};
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+typedef uint32_t RenderGraphResource;
+typedef uint32_t RenderGraphPass;
+
+/**
+ * Rebuilt every frame: declare resources and passes with the accesses they make, Compile, then Execute
+ * Compile culls passes whose results nothing consumes, gives transient images memory aliased between non overlapping
+ * lifetimes, and works out the minimal synchronization2 barriers between passes. Physical transient images and their
+ * memory persist across frames and are only recreated when the declared graph changes.
+ */
+class RenderGraph
+{
+public:
+	static constexpr RenderGraphResource INVALID_RESOURCE = UINT32_MAX;
+
+	/**
+	 * Records the pass' commands, barriers for its accesses have already been recorded
+	 */
+	typedef std::function<void(VkCommandBuffer commandBuffer)> ExecuteFn;
+
+	struct Statistics
+	{
+		uint32_t passCount = 0;
+		uint32_t culledPassCount = 0;
+		uint32_t imageBarrierCount = 0;
+		uint32_t memoryBarrierCount = 0;
+		uint32_t transientImageCount = 0;
+		// Memory the transient images actually occupy
+		VkDeviceSize transientMemoryBytes = 0;
+		// What they would occupy without aliasing
+		VkDeviceSize unaliasedTransientMemoryBytes = 0;
+	};
+
+	void Init(VkDevice device, DeviceMemoryAllocator& allocator);
+
+	/**
+	 * The device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Clear last frame's declarations and destroy physical resources retired by frames that have completed
+	 * @param frameNumber The frame about to be declared, increasing by at least one every call
+	 * @param completedFrameNumber The latest frame known to have finished executing
+	 */
+	void BeginFrame(uint64_t frameNumber, uint64_t completedFrameNumber);
+
+	/**
+	 * Bring an image the graph does not own into the graph
+	 * @param initialAccess How the image was last used before this frame's graph
+	 * @param finalAccess The state Execute leaves it in, None leaves it wherever the last pass did
+	 */
+	RenderGraphResource ImportImage(VkImage image, VkImageView view, const VkImageSubresourceRange& range, ERenderGraphAccess initialAccess, ERenderGraphAccess finalAccess);
+
+	/**
+	 * Bring a buffer the graph does not own into the graph, its accesses are synchronized with global memory barriers
+	 */
+	RenderGraphResource ImportBuffer(VkBuffer buffer, ERenderGraphAccess initialAccess);
+
+	/**
+	 * Declare an image that only lives for this frame, its contents are undefined at its first use
+	 */
+	RenderGraphResource CreateImage(const RenderGraphImageDesc& desc);
+
+	/**
+	 * @param bHasSideEffects Never cull the pass, for passes whose results leave the graph some other way
+	 */
+	RenderGraphPass AddPass(const char* name, ExecuteFn execute, bool bHasSideEffects = false);
+
+	/**
+	 * Declare that pass touches resource in the given way, in the order the pass does
+	 */
+	void UseResource(RenderGraphPass pass, RenderGraphResource resource, ERenderGraphAccess access);
+
+	void Compile();
+
+	void Execute(VkCommandBuffer commandBuffer);
+
+	/**
+	 * Only valid for resources used by a pass that survived Compile
+	 */
+	[[nodiscard]] VkImage GetImage(RenderGraphResource resource) const;
+
+	[[nodiscard]] VkImageView GetImageView(RenderGraphResource resource) const;
+
+	[[nodiscard]] const Statistics& GetStatistics() const { return mStatistics; }
+
+private:
+	struct AccessInfo
+	{
+		VkPipelineStageFlags2 stageMask;
+		VkAccessFlags2 accessMask;
+		VkImageLayout layout;
+		VkImageUsageFlags usage;
+		bool bWrite;
+	};
+
+	static const AccessInfo& GetAccessInfo(ERenderGraphAccess access);
+
+	// What has happened to a resource so far, enough to decide what the next access has to wait for
+	struct ResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+		// Reads since the last write, a following write must wait for them
+		VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+		// The stages and accesses the last write has been made visible to
+		VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+	};
+
+	struct Resource
+	{
+		bool bImported = false;
+		bool bImage = true;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkImageSubresourceRange range{};
+
+		ERenderGraphAccess finalAccess = ERenderGraphAccess::None;
+
+		// Transient images only
+		RenderGraphImageDesc desc;
+		VkImageUsageFlags usage = 0;
+		VkMemoryRequirements memoryRequirements{};
+		uint32_t slotIdx = UINT32_MAX;
+
+		// Span of surviving passes using the resource
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+
+		ResourceState state;
+	};
+
+	struct PassAccess
+	{
+		RenderGraphResource resource;
+		ERenderGraphAccess access;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		ExecuteFn execute;
+		bool bHasSideEffects = false;
+		bool bCulled = false;
+
+		std::vector<PassAccess> accesses;
+
+		// Recorded before the pass, a range of mImageBarriers plus an optional global barrier
+		uint32_t firstImageBarrier = 0;
+		uint32_t imageBarrierCount = 0;
+		VkMemoryBarrier2 memoryBarrier{};
+	};
+
+	// A range of memory shared by transient images whose lifetimes do not overlap, kept across frames
+	struct MemorySlot
+	{
+		GpuAllocation allocation;
+		// Bumped whenever the allocation is replaced, images bound to an older generation are stale
+		uint32_t generation = 0;
+
+		// Every access to the memory since the last image took it over, the next occupant waits for all of them
+		VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+
+		// Per frame assignment
+		VkDeviceSize requiredSize = 0;
+		VkDeviceSize requiredAlignment = 1;
+		uint32_t requiredTypeBits = 0;
+		uint32_t lastPass = 0;
+		bool bAssigned = false;
+	};
+
+	struct PhysicalImage
+	{
+		RenderGraphImageDesc desc;
+		VkImageUsageFlags usage;
+		uint32_t slotIdx;
+		uint32_t slotGeneration;
+
+		VkImage image;
+		VkImageView view;
+
+		bool bUsedThisFrame;
+	};
+
+	// Physical resources that may still be used by frames in flight
+	struct Garbage
+	{
+		uint64_t frameNumber;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		std::vector<GpuAllocation> allocations;
+	};
+
+	void CullPasses();
+
+	void AssignMemorySlots();
+
+	void CreatePhysicalImages();
+
+	void BuildBarriers();
+
+	/**
+	 * Work out what access needs to wait for given the resource's history and advance the history past it
+	 * @return Whether a barrier is needed, in which case the source and destination scopes are filled in
+	 */
+	static bool TransitionState(ResourceState& state, const AccessInfo& accessInfo, bool bImage, VkPipelineStageFlags2& outSrcStages, VkAccessFlags2& outSrcAccess, VkImageLayout& outOldLayout);
+
+	void AddImageBarrier(Resource& resource, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkImageLayout oldLayout, const AccessInfo& accessInfo);
+
+	void RetireSlotAllocation(MemorySlot& slot);
+
+	Garbage& GetCurrentGarbage();
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* mAllocator = nullptr;
+
+	uint64_t mFrameNumber = 0;
+
+	std::vector<Resource> mResources;
+	std::vector<Pass> mPasses;
+	std::vector<VkImageMemoryBarrier2> mImageBarriers;
+
+	// Barriers that put imported images in their final state after the last pass
+	uint32_t mFirstFinalImageBarrier = 0;
+
+	std::vector<MemorySlot> mMemorySlots;
+	std::vector<PhysicalImage> mPhysicalImages;
+	std::vector<Garbage> mGarbage;
+
+	bool mCompiled = false;
+
+	Statistics mStatistics;
+};
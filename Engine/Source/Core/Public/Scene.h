@@ -1,41 +1,32 @@
 #pragma once
 
+#include "Component.h"
+#include "EntityAllocator.h"
+#include "Events.h"
+#include "MaskScan.h"
+#include "Prefab.h"
+#include "SceneQueries.h"
+
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <bitset>
+#include <memory>
+#include <span>
+#include <type_traits>
 #include <vector>
 
-
-extern uint32_t componentCounter;
-
-typedef uint64_t EntityID;
-
-constexpr uint32_t MAX_COMPONENTS = 32;
-typedef std::bitset<MAX_COMPONENTS> ComponentMask;
-
-constexpr uint32_t NUM_COMPONENTS_PER_CHUNK = 64;
-
-constexpr uint32_t NUM_CHUNKS_PER_POOL = 8;
-constexpr uint32_t MAX_ENTITIES = NUM_CHUNKS_PER_POOL * NUM_COMPONENTS_PER_CHUNK;
-
-/**
- * @tparam T The class of the component to get the ID for
- * @return ID of the component class
- */
-template <class T>
-uint32_t GetComponentId()
-{
-	static uint32_t componentId = componentCounter++;
-	return componentId;
-}
-
 struct Scene
 {
-	struct EntityDesc
-	{
-		EntityID id;
-		ComponentMask mask;
-	};
+	// Number of matching entities handed to a ForEachMatchingBatch callback at a time
+	static constexpr uint32_t MASK_SCAN_BATCH_SIZE = 256;
 
+	Scene();
+
+	/**
+	 * Safe to call from several threads at once, but not concurrently with anything that adds or removes components
+	 * @return The id of the new entity
+	 */
 	EntityID CreateEntity();
 
 	void DestroyEntity(EntityID id);
@@ -45,77 +36,317 @@ struct Scene
 	{
 		EntityIndex entityIdx = GetEntityIndex(id);
 
-		if (mEntities[entityIdx].id != id)
+		if (mEntityIds[entityIdx] != id)
 		{
 			return nullptr;
 		}
 
 		const uint32_t componentId = GetComponentId<T>();
 
-		if(mComponentPools.size() <= componentId)
+		ComponentPool* pool = GetOrCreatePool(componentId, sizeof(T));
+
+		const PackedComponentMask oldMask = mEntityMasks[entityIdx];
+		mEntityMasks[entityIdx] |= 1u << componentId;
+
+		if (oldMask != mEntityMasks[entityIdx])
 		{
-			mComponentPools.resize(componentId + 1, nullptr);
+			mQueries.Update(id, oldMask, mEntityMasks[entityIdx]);
 		}
-			
-		if(mComponentPools[componentId] == nullptr)
+
+		return static_cast<T*>(pool->GetOrCreateComponent(id));
+	}
+
+	/**
+	 * @return The component of the entity, or nullptr if the entity is stale or does not have one
+	 */
+	template<typename T>
+	T* GetComponent(EntityID id) const
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+		const uint32_t componentId = GetComponentId<T>();
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & (1u << componentId)) == 0)
 		{
-			mComponentPools[componentId] = new ComponentPool(sizeof(T));
+			return nullptr;
 		}
 
-		mEntities[entityIdx].mask.set(componentId);
+		return static_cast<T*>(mComponentPools[componentId]->GetComponent(id));
+	}
 
-		return static_cast<T*>(mComponentPools[componentId]->GetOrCreateComponent(id));
+	/**
+	 * @return The component of the entity for writing, or nullptr if the entity is stale or does not have one
+	 * For double buffered components this is the next copy, and only the chunks written through it are copied forward on swap
+	 */
+	template<typename T>
+	T* GetWriteComponent(EntityID id)
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+		const uint32_t componentId = GetComponentId<T>();
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & (1u << componentId)) == 0)
+		{
+			return nullptr;
+		}
+
+		return static_cast<T*>(mComponentPools[componentId]->GetWriteComponent(id));
 	}
 
 	template<typename T>
 	void RemoveComponent(EntityID id)
 	{
-		if (mEntities[GetEntityIndex(id)].id != id)
+		if (mEntityIds[GetEntityIndex(id)] != id)
 		{
 			return;
 		}
 
-		const int componentId = GetComponentId<T>();
+		const uint32_t componentId = GetComponentId<T>();
 
-		if (ComponentPool* pool = mComponentPools[componentId])
+		if (componentId < mComponentPools.size() && mComponentPools[componentId] != nullptr)
 		{
-			pool->FreeComponent(id);
+			mComponentPools[componentId]->FreeComponent(id);
 		}
 		
-		mEntities[GetEntityIndex(id)].mask.reset(componentId);
+		const PackedComponentMask oldMask = mEntityMasks[GetEntityIndex(id)];
+		mEntityMasks[GetEntityIndex(id)] &= ~(1u << componentId);
+
+		if (oldMask != mEntityMasks[GetEntityIndex(id)])
+		{
+			mQueries.Update(id, oldMask, mEntityMasks[GetEntityIndex(id)]);
+		}
 	}
 
-#ifndef NDEBUG
-	void DebugPrintState() const;
-#endif
-	
-private:
+	[[nodiscard]] ComponentMask GetComponentMask(EntityID id) const
+	{
+		return mEntityIds[GetEntityIndex(id)] == id ? ComponentMask(mEntityMasks[GetEntityIndex(id)]) : ComponentMask();
+	}
+
+	/**
+	 * Scan the packed entity masks with SIMD and hand the matching entities over in batches
+	 * @param requiredMask Components an entity must have
+	 * @param excludedMask Components an entity must not have
+	 * @param fn Called as fn(std::span<const EntityID>) with up to MASK_SCAN_BATCH_SIZE entities at a time
+	 */
+	template<typename Fn>
+	void ForEachMatchingBatch(const ComponentMask requiredMask, const ComponentMask excludedMask, Fn&& fn) const
+	{
+		EntityIndex matchingIndices[MASK_SCAN_BATCH_SIZE];
+		EntityID matchingIds[MASK_SCAN_BATCH_SIZE];
+
+		const PackedComponentMask required = PackComponentMask(requiredMask);
+		const PackedComponentMask excluded = PackComponentMask(excludedMask);
+
+		const uint32_t end = mEntityAllocator.GetHighWaterMark();
+		for (uint32_t begin = 0; begin < end; begin += MASK_SCAN_BATCH_SIZE)
+		{
+			const uint32_t numMatching = ScanComponentMasks(mEntityMasks.data(), begin, std::min(begin + MASK_SCAN_BATCH_SIZE, end), required, excluded, matchingIndices);
+
+			uint32_t numIds = 0;
+			for (uint32_t i = 0; i < numMatching; ++i)
+			{
+				matchingIds[numIds] = mEntityIds[matchingIndices[i]];
+				// Dead slots have an empty mask, so they can only slip through when nothing is required
+				numIds += required != 0 || IsEntityValid(matchingIds[numIds]);
+			}
+
+			if (numIds > 0)
+			{
+				fn(std::span<const EntityID>(matchingIds, numIds));
+			}
+		}
+	}
+
+	/**
+	 * Call fn(EntityID, Ts&...) for every entity that has all of Ts
+	 */
+	template<typename... Ts, typename Fn>
+	void ForEach(Fn&& fn)
+	{
+		ComponentMask requiredMask;
+		(requiredMask.set(GetComponentId<Ts>()), ...);
+
+		ForEachMatchingBatch(requiredMask, ComponentMask(), [&](const std::span<const EntityID> ids)
+		{
+			for (const EntityID id : ids)
+			{
+				fn(id, *static_cast<Ts*>(mComponentPools[GetComponentId<Ts>()]->GetComponent(id))...);
+			}
+		});
+	}
+
+	/**
+	 * Destroy every entity whose mask matches, found with the same SIMD scan as ForEachMatchingBatch
+	 */
+	void DestroyEntities(ComponentMask requiredMask, ComponentMask excludedMask = ComponentMask());
+
+	/**
+	 * Register a persistent query whose matching entities are cached and kept up to date incrementally
+	 * whenever a component is added or removed, an entity is destroyed or a prefab is instantiated
+	 * @param requiredMask Components an entity must have, must not be empty
+	 * @param excludedMask Components an entity must not have
+	 * @return The id to pass to GetQueryEntities / ForEachInQuery
+	 */
+	QueryID RegisterQuery(ComponentMask requiredMask, ComponentMask excludedMask = ComponentMask());
+
+	template<typename... Ts>
+	QueryID RegisterQuery()
+	{
+		ComponentMask requiredMask;
+		(requiredMask.set(GetComponentId<Ts>()), ...);
+		return RegisterQuery(requiredMask);
+	}
+
+	/**
+	 * @return The entities currently matching the query, in no particular order
+	 * Invalidated by any change that adds or removes a match
+	 */
+	[[nodiscard]] std::span<const EntityID> GetQueryEntities(const QueryID queryId) const
+	{
+		return mQueries.GetEntities(queryId);
+	}
+
+	/**
+	 * Call fn(EntityID, Ts&...) for every entity matching a query registered with at least Ts
+	 */
+	template<typename... Ts, typename Fn>
+	void ForEachInQuery(const QueryID queryId, Fn&& fn)
+	{
+		assert(((mQueries.GetRequiredMask(queryId) & (1u << GetComponentId<Ts>())) && ...));
+
+		for (const EntityID id : mQueries.GetEntities(queryId))
+		{
+			fn(id, *static_cast<Ts*>(mComponentPools[GetComponentId<Ts>()]->GetComponent(id))...);
+		}
+	}
+
+	/**
+	 * Take ownership of a prefab so it can be instantiated later
+	 * @return The id to pass to InstantiatePrefab
+	 */
+	PrefabID RegisterPrefab(Prefab prefab);
+
+	/**
+	 * Create outIds.size() entities that carry a copy of every component of the prefab
+	 * Components are stamped into their pools a contiguous run at a time rather than one GetOrAddComponent per entity
+	 * @param prefabId A prefab previously returned by RegisterPrefab
+	 * @param outIds Receives the ids of the new entities
+	 */
+	void InstantiatePrefab(PrefabID prefabId, std::span<EntityID> outIds);
+
+	/**
+	 * Same as InstantiatePrefab, then hands the freshly stamped T components to overrideFn so per instance fields can be patched
+	 * @param overrideFn Called as overrideFn(std::span<const EntityID> ids, std::span<T> components) once per run of instances that are contiguous in memory
+	 */
+	template<typename T, typename Fn>
+	void InstantiatePrefab(const PrefabID prefabId, const std::span<EntityID> outIds, Fn&& overrideFn)
+	{
+		InstantiatePrefab(prefabId, outIds);
+
+		const uint32_t componentId = GetComponentId<T>();
+		if (outIds.empty() || !mPrefabs[prefabId].mMask.test(componentId))
+		{
+			return;
+		}
 
-	typedef uint32_t EntityIndex;
-	typedef uint32_t EntityVersion;
+		ComponentPool* pool = mComponentPools[componentId];
+
+		size_t runStart = 0;
+		T* pRunStart = static_cast<T*>(pool->GetWriteComponent(outIds[0]));
+		for (size_t i = 1; i <= outIds.size(); ++i)
+		{
+			T* pComponent = i < outIds.size() ? static_cast<T*>(pool->GetWriteComponent(outIds[i])) : nullptr;
+			if (pComponent != pRunStart + (i - runStart))
+			{
+				overrideFn(std::span<const EntityID>(outIds.data() + runStart, i - runStart), std::span<T>(pRunStart, i - runStart));
+				runStart = i;
+				pRunStart = pComponent;
+			}
+		}
+	}
 
-	static EntityID CreateEntityId(const EntityIndex index, const EntityVersion version)
+	/**
+	 * Give every T component a second copy so simulation and rendering can run a frame apart without locks
+	 * GetOrAddComponent / GetWriteComponent then return the "next" copy that simulation writes, while GetComponent,
+	 * GetReadComponent, ForEach and ForEachInQuery return the "current" copy from before the last SwapComponentBuffers
+	 * and must not be written through. Existing components are copied once.
+	 * The next copy starts every frame equal to the current one, so writers can read-modify-write it as usual.
+	 */
+	template<typename T>
+	void DeclareDoubleBuffered()
 	{
-		return static_cast<EntityID>(index) << 32 | version;
+		static_assert(std::is_trivially_copyable_v<T>, "Double buffered components are copied forward with memcpy");
+		ComponentPool* pool = GetOrCreatePool(GetComponentId<T>(), sizeof(T));
+		if (!pool->bDoubleBuffered)
+		{
+			pool->EnableDoubleBuffering();
+			mDoubleBufferedPools.push_back(pool);
+		}
 	}
 
-	static EntityIndex GetEntityIndex(const EntityID id)
+	/**
+	 * @return The current (last frame's) value of a double buffered component, or the only value of a regular one
+	 * Safe to call from a render thread while simulation writes next values, as long as no components are added or removed meanwhile
+	 */
+	template<typename T>
+	const T* GetReadComponent(EntityID id) const
 	{
-		return id >> 32;
+		const EntityIndex entityIdx = GetEntityIndex(id);
+		const uint32_t componentId = GetComponentId<T>();
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & (1u << componentId)) == 0)
+		{
+			return nullptr;
+		}
+
+		return static_cast<const T*>(mComponentPools[componentId]->GetComponent(id));
 	}
 
-	static EntityVersion GetEntityVersion(const EntityID id)
+	/**
+	 * Publish the values simulation wrote this frame as the current ones, then copy the chunks that were written
+	 * forward into the new next copy. Chunks nobody asked to write are left alone, so the cost scales with what changed.
+	 * Must not overlap with readers of GetReadComponent or writers, call it at the frame boundary
+	 */
+	void SwapComponentBuffers();
+
+	/**
+	 * Get the channel for events of class T, creating it on first use
+	 * Creation is not thread safe, so touch every channel once during setup before systems run in parallel
+	 */
+	template<typename T>
+	EventChannel<T>& GetEventChannel()
 	{
-		return static_cast<EntityVersion>(id);
+		return mEventChannels.Get<T>();
 	}
 
-	static bool IsEntityValid(EntityID id)
+	/**
+	 * Shorthand for GetEventChannel<T>().Emit, thread safe once the channel exists
+	 */
+	template<typename T>
+	void EmitEvent(const T& event)
 	{
-		return (id >> 32) != static_cast<EntityIndex>(-1);
+		GetEventChannel<T>().Emit(event);
 	}
 
-	std::vector<EntityDesc> mEntities;
-	std::vector<EntityIndex> mFreeEntities;
+	/**
+	 * Make everything emitted so far readable, call it at the sync point between producing and consuming systems
+	 */
+	void MergeEvents() { mEventChannels.MergeAll(); }
+
+	/**
+	 * Retire this frame's events of every channel, call it once at the frame boundary
+	 */
+	void EndEventFrame() { mEventChannels.EndFrameAll(); }
+
+#ifndef NDEBUG
+	void DebugPrintState() const;
+#endif
+	
+private:
+	EntityAllocator mEntityAllocator{MAX_ENTITIES};
+
+	// Both sized to MAX_ENTITIES up front so concurrent CreateEntity calls only ever write to the slot they were handed
+	// The masks are kept apart from the ids so they can be scanned as one packed array
+	std::vector<EntityID> mEntityIds;
+	std::vector<PackedComponentMask> mEntityMasks;
 
 private:
 	struct ComponentPoolChunk
@@ -128,7 +359,7 @@ private:
 		ComponentPoolChunk(ComponentPoolChunk&& Other) noexcept;
 		ComponentPoolChunk& operator=(ComponentPoolChunk&& Other) noexcept;
 
-		explicit ComponentPoolChunk(size_t inComponentSize);
+		ComponentPoolChunk(size_t inComponentSize, bool bDoubleBuffered);
 
 		~ComponentPoolChunk();
 
@@ -140,13 +371,26 @@ private:
 		 */
 		uint32_t AllocateComponent(EntityID id);
 
+		/**
+		 * Allocate a run of adjacent components starting at the first free slot of this chunk
+		 * Presumes that there is free space in the chunk
+		 * @param ids The ids of the entities that will be associated with the components
+		 * @param maxCount The maximum number of components to allocate
+		 * @param outFirstIndex The index within the chunk of the first allocated component
+		 * @return The number of components allocated, which may be fewer than maxCount
+		 */
+		uint32_t AllocateComponentRun(const EntityID* ids, uint32_t maxCount, uint32_t& outFirstIndex);
+
 		/**
 		 * Free a previously allocated component
 		 * @param index The index of the component within the chunk to free
 		 */
 		void FreeComponent(uint32_t index);
 
-		[[nodiscard]] void* GetComponent(uint32_t index) const;
+		/**
+		 * @param bufferIdx Which copy of the component to return, 1 is only valid for double buffered chunks
+		 */
+		[[nodiscard]] void* GetComponent(uint32_t index, uint32_t bufferIdx = 0) const;
 
 		[[nodiscard]] EntityID GetEntityId(uint32_t idx) const;
 	
@@ -156,9 +400,14 @@ private:
 
 		[[nodiscard]] bool IsValid() const { return componentSize > 0 && pData != nullptr; }
 
+		// The entity ids live after the components so the components themselves are one contiguous array
+		[[nodiscard]] EntityID* GetEntityIds() const { return reinterpret_cast<EntityID*>(pData + componentSize * NUM_COMPONENTS_PER_CHUNK); }
+
 		size_t componentSize = 0;
 		std::bitset<NUM_COMPONENTS_PER_CHUNK> freeComponents{};
 		uint8_t* pData = nullptr;
+		// Second copy of the component array, only allocated for double buffered pools
+		uint8_t* pBackData = nullptr;
 	};
 
 
@@ -168,6 +417,36 @@ private:
 
 		void* GetOrCreateComponent(EntityID id);
 
+		/**
+		 * @return The component of the entity, or nullptr if it does not have one in this pool
+		 * The current copy for double buffered pools, looking it up leaves the written chunks alone
+		 */
+		[[nodiscard]] void* GetComponent(EntityID id) const;
+
+		/**
+		 * @return The next copy of the component for double buffered pools with its chunk marked written, otherwise the same as GetComponent
+		 */
+		[[nodiscard]] void* GetWriteComponent(EntityID id);
+
+		/**
+		 * Allocate the second copy for every chunk and seed it from the first
+		 */
+		void EnableDoubleBuffering();
+
+		/**
+		 * Flip which copy is written and bring the chunks written since the last swap up to date in the new next copy
+		 */
+		void SwapBuffers();
+
+		/**
+		 * Allocate components for a run of entities that have none in this pool yet and initialize them from a stamp
+		 * @param ids The ids of the entities
+		 * @param count The number of entities in ids
+		 * @param stamp At least NUM_COMPONENTS_PER_CHUNK initial values laid out back to back
+		 * @return The number of components allocated, always at least one; call again with the remainder
+		 */
+		uint32_t StampComponents(const EntityID* ids, uint32_t count, const uint8_t* stamp);
+
 		void FreeComponent(EntityID id);
 
 #ifndef NDEBUG
@@ -177,10 +456,26 @@ private:
 		ComponentPoolChunk chunks[NUM_CHUNKS_PER_POOL];
 		uint32_t sparseMap[MAX_ENTITIES] = {};
 		size_t componentSize = 0;
+		bool bDoubleBuffered = false;
+		// Which copy simulation writes, every read returns the other one; flipped by SwapComponentBuffers
+		uint32_t writeBufferIdx = 0;
+		// Chunks whose next copy was handed out since the last swap, only tracked for double buffered pools
+		ChunkWriteMask writtenChunks;
 	};
 	
+	ComponentPool* GetOrCreatePool(uint32_t componentId, size_t componentSize);
+
 	// TODO: Could probably turn this into a map
 	std::vector<ComponentPool*> mComponentPools;
+
+	std::vector<ComponentPool*> mDoubleBufferedPools;
+
+	std::vector<Prefab> mPrefabs;
+
+private:
+	SceneQueries mQueries;
+
+	EventChannels mEventChannels;
 };
 
 struct TestComponent1
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Component.h"
+#include "EntityAllocator.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+typedef uint32_t QueryID;
+
+/**
+ * The persistent queries of a scene and their cached matches, shared by Scene and StaticScene
+ * The scene reports every change of an entity's mask through Update, masks are in the scene's own component id space.
+ */
+class SceneQueries
+{
+public:
+	/**
+	 * The scene adds the entities already matching through AddInitialMatch
+	 * @param requiredMask Must not be empty
+	 */
+	QueryID Register(PackedComponentMask requiredMask, PackedComponentMask excludedMask);
+
+	void AddInitialMatch(QueryID queryId, EntityID id);
+
+	/**
+	 * Add or remove the entity from every query whose match result differs between the two masks
+	 */
+	void Update(EntityID id, PackedComponentMask oldMask, PackedComponentMask newMask);
+
+	/**
+	 * @return The entities currently matching the query, in no particular order
+	 * Invalidated by any change that adds or removes a match
+	 */
+	[[nodiscard]] std::span<const EntityID> GetEntities(const QueryID queryId) const
+	{
+		return mQueries[queryId].entities;
+	}
+
+	[[nodiscard]] PackedComponentMask GetRequiredMask(const QueryID queryId) const
+	{
+		return mQueries[queryId].requiredMask;
+	}
+
+private:
+	struct CachedQuery
+	{
+		[[nodiscard]] bool Matches(const PackedComponentMask mask) const
+		{
+			return (mask & requiredMask) == requiredMask && (mask & excludedMask) == 0;
+		}
+
+		PackedComponentMask requiredMask = 0;
+		PackedComponentMask excludedMask = 0;
+		std::vector<EntityID> entities;
+		// Position of each entity within entities + 1, indexed by entity index, 0 when it does not match
+		std::vector<uint32_t> denseIndices;
+	};
+
+	std::vector<CachedQuery> mQueries;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "GpuAllocator.h"
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+/**
+ * A persistently mapped upload buffer shared by every subsystem
+ * Enqueue* copies the data into the ring straight away and records the GPU copy, Flush then replays all of them
+ * into the frame's command buffer. Ring space is handed back once the frame that flushed it has completed on the GPU,
+ * so neither enqueueing nor flushing ever waits. Uploads that do not fit get a temporary buffer retired the same way.
+ * Not thread safe, enqueue from the thread that records the frame.
+ */
+class StagingRing
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_CAPACITY = 32ull * 1024 * 1024;
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize capacity = DEFAULT_CAPACITY);
+
+	/**
+	 * The device must be idle
+	 */
+	void Shutdown();
+
+	/**
+	 * Reclaim the space of every frame up to and including completedFrameNumber
+	 * @param completedFrameNumber The latest frame whose submission is known to have finished executing
+	 */
+	void BeginFrame(uint64_t completedFrameNumber);
+
+	/**
+	 * Copy size bytes of pData into dstBuffer at dstOffset on the next Flush
+	 * The destination is readable by vertex input, uniform and shader reads of any command after the flush
+	 */
+	void EnqueueBufferCopy(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize size);
+
+	/**
+	 * Upload image data on the next Flush, transitioning range from undefined to shader read only layout around the copies
+	 * @param regions Copy regions whose bufferOffset is relative to pData
+	 */
+	void EnqueueImageCopy(VkImage dstImage, const VkImageSubresourceRange& range, std::span<const VkBufferImageCopy> regions, const void* pData, VkDeviceSize size);
+
+	/**
+	 * Record every pending copy and the barriers that make them visible, must be outside of any rendering scope
+	 * @param frameNumber The frame the command buffer belongs to, its space is reclaimed once BeginFrame sees it completed
+	 */
+	void Flush(VkCommandBuffer commandBuffer, uint64_t frameNumber);
+
+	/**
+	 * Record every pending copy but leave making them visible to the caller, for uploads that end in a queue ownership transfer
+	 * Fills in one barrier per copied resource with the transfer write as source, images go from transfer dst to shader read only layout
+	 * The caller sets the remaining fields of the barriers and records them, then calls Retire
+	 */
+	void RecordCopies(VkCommandBuffer commandBuffer, std::vector<VkBufferMemoryBarrier>& outBufferBarriers, std::vector<VkImageMemoryBarrier>& outImageBarriers);
+
+	/**
+	 * Hand the space staged since the last Retire back once BeginFrame sees frameNumber completed
+	 * @param frameNumber Any counter that increases with every submission, such as a timeline semaphore value
+	 */
+	void Retire(uint64_t frameNumber);
+
+	[[nodiscard]] bool HasPendingCopies() const { return !mPendingBufferCopies.empty() || !mPendingImageCopies.empty(); }
+
+private:
+	struct StagedRange
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+	};
+
+	struct PendingBufferCopy
+	{
+		VkBuffer srcBuffer;
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+
+	struct PendingImageCopy
+	{
+		VkBuffer srcBuffer;
+		VkImage dstImage;
+		VkImageSubresourceRange range;
+		// Indices into mPendingImageRegions
+		uint32_t firstRegion;
+		uint32_t regionCount;
+	};
+
+	struct TemporaryBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		GpuAllocation allocation;
+	};
+
+	// Everything up to ringHead, plus the temporary buffers, can be reused once frameNumber has completed
+	struct FrameRetirement
+	{
+		uint64_t frameNumber;
+		uint64_t ringHead;
+		std::vector<TemporaryBuffer> temporaryBuffers;
+	};
+
+	/**
+	 * Reserve space in the ring, or in a new temporary buffer when the ring is full, and copy pData into it
+	 */
+	StagedRange Stage(const void* pData, VkDeviceSize size);
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* mAllocator = nullptr;
+
+	VkBuffer mRingBuffer = VK_NULL_HANDLE;
+	GpuAllocation mRingAllocation;
+	VkDeviceSize mCapacity = 0;
+	VkDeviceSize mCopyAlignment = 16;
+
+	// Running byte counts, the ring offset is the count modulo mCapacity
+	uint64_t mRingHead = 0;
+	uint64_t mRingTail = 0;
+
+	std::vector<TemporaryBuffer> mTemporaryBuffers;
+	std::deque<FrameRetirement> mRetirements;
+
+	std::vector<PendingBufferCopy> mPendingBufferCopies;
+	std::vector<PendingImageCopy> mPendingImageCopies;
+	std::vector<VkBufferImageCopy> mPendingImageRegions;
+
+	// Reused by Flush so it does not allocate every frame
+	std::vector<VkBufferMemoryBarrier> mScratchBufferBarriers;
+	std::vector<VkImageMemoryBarrier> mScratchImageBarriers;
+	std::vector<VkBufferCopy> mScratchBufferRegions;
+};
@@ -0,0 +1,813 @@
+#pragma once
+
+#include "Component.h"
+#include "EntityAllocator.h"
+#include "Events.h"
+#include "MaskScan.h"
+#include "Prefab.h"
+#include "SceneQueries.h"
+
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A Scene whose full set of components is known at compile time
+ * Component ids are constexpr indices into Components, the pools are a std::tuple of typed storage and
+ * mask tests are built at compile time, so there is no pool indirection, no void* casts and no runtime id lookup.
+ * Mirrors the API of Scene, entities, components, queries, prefabs and events, so systems templated on the scene type
+ * work with either. Prefabs keep the runtime ids of GetComponentId and are mapped onto the static ids once per instantiation.
+ */
+template<typename... Components>
+class StaticScene
+{
+	static_assert(sizeof...(Components) > 0, "A StaticScene needs at least one component type");
+	static_assert(sizeof...(Components) <= MAX_COMPONENTS, "Too many components for a ComponentMask");
+
+	template<typename T>
+	static constexpr uint32_t FindComponentId()
+	{
+		constexpr bool matches[] = { std::is_same_v<T, Components>... };
+		for (uint32_t i = 0; i < sizeof...(Components); ++i)
+		{
+			if (matches[i])
+			{
+				return i;
+			}
+		}
+		return sizeof...(Components);
+	}
+
+public:
+	// Number of matching entities handed to a ForEachMatchingBatch callback at a time
+	static constexpr uint32_t MASK_SCAN_BATCH_SIZE = 256;
+
+	template<typename T>
+	static constexpr uint32_t COMPONENT_ID = FindComponentId<T>();
+
+	template<typename... Ts>
+	static constexpr PackedComponentMask COMPONENT_MASK = ((1u << COMPONENT_ID<Ts>) | ... | 0u);
+
+	StaticScene()
+		: mEntityIds(MAX_ENTITIES, CreateEntityId(INVALID_ENTITY_INDEX, 0))
+		, mEntityMasks(MAX_ENTITIES, 0)
+	{
+	}
+
+	/**
+	 * Safe to call from several threads at once, but not concurrently with anything that adds or removes components
+	 * @return The id of the new entity
+	 */
+	EntityID CreateEntity()
+	{
+		const EntityID id = mEntityAllocator.Allocate();
+		assert(IsEntityValid(id));
+
+		return mEntityIds[GetEntityIndex(id)] = id;
+	}
+
+	void DestroyEntity(const EntityID id)
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id)
+		{
+			return;
+		}
+
+		const PackedComponentMask mask = mEntityMasks[entityIdx];
+		std::apply([id, mask](auto&... pools)
+		{
+			((mask & (1u << COMPONENT_ID<typename std::remove_reference_t<decltype(pools)>::ComponentType>) ? pools.FreeComponent(id) : void()), ...);
+		}, mPools);
+
+		mQueries.Update(id, mask, 0);
+
+		mEntityIds[entityIdx] = CreateEntityId(INVALID_ENTITY_INDEX, GetEntityVersion(id) + 1);
+		mEntityMasks[entityIdx] = 0;
+
+		mEntityAllocator.Free(id);
+	}
+
+	template<typename T>
+	T* GetOrAddComponent(const EntityID id)
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id)
+		{
+			return nullptr;
+		}
+
+		const PackedComponentMask oldMask = mEntityMasks[entityIdx];
+		mEntityMasks[entityIdx] |= COMPONENT_MASK<T>;
+
+		if (oldMask != mEntityMasks[entityIdx])
+		{
+			mQueries.Update(id, oldMask, mEntityMasks[entityIdx]);
+		}
+
+		return GetPool<T>().GetOrCreateComponent(id);
+	}
+
+	/**
+	 * @return The component of the entity, or nullptr if the entity is stale or does not have one
+	 */
+	template<typename T>
+	T* GetComponent(const EntityID id) const
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & COMPONENT_MASK<T>) == 0)
+		{
+			return nullptr;
+		}
+
+		return GetPool<T>().GetComponent(id);
+	}
+
+	/**
+	 * Same as Scene::GetWriteComponent
+	 */
+	template<typename T>
+	T* GetWriteComponent(const EntityID id)
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & COMPONENT_MASK<T>) == 0)
+		{
+			return nullptr;
+		}
+
+		return GetPool<T>().GetWriteComponent(id);
+	}
+
+	template<typename T>
+	void RemoveComponent(const EntityID id)
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & COMPONENT_MASK<T>) == 0)
+		{
+			return;
+		}
+
+		GetPool<T>().FreeComponent(id);
+
+		const PackedComponentMask oldMask = mEntityMasks[entityIdx];
+		mEntityMasks[entityIdx] &= ~COMPONENT_MASK<T>;
+
+		mQueries.Update(id, oldMask, mEntityMasks[entityIdx]);
+	}
+
+	/**
+	 * @return The components of the entity as a mask of runtime GetComponentId ids, the same as Scene::GetComponentMask
+	 */
+	[[nodiscard]] ComponentMask GetComponentMask(const EntityID id) const
+	{
+		return mEntityIds[GetEntityIndex(id)] == id ? ToRuntimeMask(mEntityMasks[GetEntityIndex(id)]) : ComponentMask();
+	}
+
+	/**
+	 * Same as Scene::ForEachMatchingBatch, masks hold runtime GetComponentId ids and are mapped onto the static ones
+	 * Requiring a component that is not one of Components matches nothing
+	 */
+	template<typename Fn>
+	void ForEachMatchingBatch(const ComponentMask requiredMask, const ComponentMask excludedMask, Fn&& fn) const
+	{
+		if (!HasOnlySceneComponents(requiredMask))
+		{
+			return;
+		}
+
+		ForEachMatchingStaticBatch(ToStaticMask(requiredMask), ToStaticMask(excludedMask), std::forward<Fn>(fn));
+	}
+
+	/**
+	 * Call fn(EntityID, Ts&...) for every entity that has all of Ts
+	 */
+	template<typename... Ts, typename Fn>
+	void ForEach(Fn&& fn)
+	{
+		ForEachMatchingStaticBatch(COMPONENT_MASK<Ts...>, 0, [&](const std::span<const EntityID> ids)
+		{
+			for (const EntityID id : ids)
+			{
+				fn(id, *GetPool<Ts>().GetComponent(id)...);
+			}
+		});
+	}
+
+	/**
+	 * Same as Scene::DestroyEntities, masks hold runtime GetComponentId ids
+	 */
+	void DestroyEntities(const ComponentMask requiredMask, const ComponentMask excludedMask = ComponentMask())
+	{
+		ForEachMatchingBatch(requiredMask, excludedMask, [this](const std::span<const EntityID> ids)
+		{
+			for (const EntityID id : ids)
+			{
+				DestroyEntity(id);
+			}
+		});
+	}
+
+	/**
+	 * Same as Scene::RegisterQuery, masks hold runtime GetComponentId ids
+	 * @param requiredMask Components an entity must have, must not be empty and must all be among Components
+	 */
+	QueryID RegisterQuery(const ComponentMask requiredMask, const ComponentMask excludedMask = ComponentMask())
+	{
+		assert(HasOnlySceneComponents(requiredMask) && "Query requires a component that is not part of this StaticScene");
+		return RegisterStaticQuery(ToStaticMask(requiredMask), ToStaticMask(excludedMask));
+	}
+
+	template<typename... Ts>
+	QueryID RegisterQuery()
+	{
+		return RegisterStaticQuery(COMPONENT_MASK<Ts...>, 0);
+	}
+
+	/**
+	 * @return The entities currently matching the query, in no particular order
+	 * Invalidated by any change that adds or removes a match
+	 */
+	[[nodiscard]] std::span<const EntityID> GetQueryEntities(const QueryID queryId) const
+	{
+		return mQueries.GetEntities(queryId);
+	}
+
+	/**
+	 * Call fn(EntityID, Ts&...) for every entity matching a query registered with at least Ts
+	 */
+	template<typename... Ts, typename Fn>
+	void ForEachInQuery(const QueryID queryId, Fn&& fn)
+	{
+		assert((mQueries.GetRequiredMask(queryId) & COMPONENT_MASK<Ts...>) == COMPONENT_MASK<Ts...>);
+
+		for (const EntityID id : mQueries.GetEntities(queryId))
+		{
+			fn(id, *GetPool<Ts>().GetComponent(id)...);
+		}
+	}
+
+	/**
+	 * Take ownership of a prefab so it can be instantiated later, every component it holds must be one of Components
+	 * @return The id to pass to InstantiatePrefab
+	 */
+	PrefabID RegisterPrefab(Prefab prefab)
+	{
+		mPrefabs.push_back(std::move(prefab));
+		return static_cast<PrefabID>(mPrefabs.size() - 1);
+	}
+
+	/**
+	 * Same as Scene::InstantiatePrefab, components are stamped into their pools a contiguous run at a time
+	 */
+	void InstantiatePrefab(const PrefabID prefabId, const std::span<EntityID> outIds)
+	{
+		assert(prefabId < mPrefabs.size());
+		const Prefab& prefab = mPrefabs[prefabId];
+
+		const PackedComponentMask mask = ToStaticMask(prefab.mMask);
+		assert(static_cast<size_t>(std::popcount(mask)) == prefab.mMask.count() && "Prefab holds a component that is not part of this StaticScene");
+
+		for (EntityID& id : outIds)
+		{
+			id = mEntityAllocator.Allocate();
+			assert(IsEntityValid(id));
+
+			mEntityIds[GetEntityIndex(id)] = id;
+			mEntityMasks[GetEntityIndex(id)] = mask;
+
+			mQueries.Update(id, 0, mask);
+		}
+
+		for (const Prefab::ComponentTemplate& component : prefab.mComponents)
+		{
+			[[maybe_unused]] const bool bStamped = (StampPrefabComponents<Components>(component.componentId, component.stamp.data(), outIds) || ...);
+			assert(bStamped);
+		}
+	}
+
+	/**
+	 * Same as InstantiatePrefab, then hands the freshly stamped T components to overrideFn so per instance fields can be patched
+	 * @param overrideFn Called as overrideFn(std::span<const EntityID> ids, std::span<T> components) once per run of instances that are contiguous in memory
+	 */
+	template<typename T, typename Fn>
+	void InstantiatePrefab(const PrefabID prefabId, const std::span<EntityID> outIds, Fn&& overrideFn)
+	{
+		InstantiatePrefab(prefabId, outIds);
+
+		if (outIds.empty() || !mPrefabs[prefabId].mMask.test(GetComponentId<T>()))
+		{
+			return;
+		}
+
+		TypedComponentPool<T>& pool = GetPool<T>();
+
+		size_t runStart = 0;
+		T* pRunStart = pool.GetWriteComponent(outIds[0]);
+		for (size_t i = 1; i <= outIds.size(); ++i)
+		{
+			T* pComponent = i < outIds.size() ? pool.GetWriteComponent(outIds[i]) : nullptr;
+			if (pComponent != pRunStart + (i - runStart))
+			{
+				overrideFn(std::span<const EntityID>(outIds.data() + runStart, i - runStart), std::span<T>(pRunStart, i - runStart));
+				runStart = i;
+				pRunStart = pComponent;
+			}
+		}
+	}
+
+	/**
+	 * Same as Scene::DeclareDoubleBuffered
+	 */
+	template<typename T>
+	void DeclareDoubleBuffered()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Double buffered components are copied forward with memcpy");
+		GetPool<T>().EnableDoubleBuffering();
+	}
+
+	/**
+	 * @return The current (last frame's) value of a double buffered component, or the only value of a regular one
+	 * Safe to call from a render thread while simulation writes next values, as long as no components are added or removed meanwhile
+	 */
+	template<typename T>
+	const T* GetReadComponent(const EntityID id) const
+	{
+		const EntityIndex entityIdx = GetEntityIndex(id);
+
+		if (mEntityIds[entityIdx] != id || (mEntityMasks[entityIdx] & COMPONENT_MASK<T>) == 0)
+		{
+			return nullptr;
+		}
+
+		return GetPool<T>().GetComponent(id);
+	}
+
+	/**
+	 * Same as Scene::SwapComponentBuffers
+	 */
+	void SwapComponentBuffers()
+	{
+		std::apply([](auto&... pools) { (pools.SwapBuffers(), ...); }, mPools);
+	}
+
+	/**
+	 * Get the channel for events of class T, creating it on first use
+	 * Creation is not thread safe, so touch every channel once during setup before systems run in parallel
+	 */
+	template<typename T>
+	EventChannel<T>& GetEventChannel()
+	{
+		return mEventChannels.Get<T>();
+	}
+
+	/**
+	 * Shorthand for GetEventChannel<T>().Emit, thread safe once the channel exists
+	 */
+	template<typename T>
+	void EmitEvent(const T& event)
+	{
+		GetEventChannel<T>().Emit(event);
+	}
+
+	/**
+	 * Make everything emitted so far readable, call it at the sync point between producing and consuming systems
+	 */
+	void MergeEvents() { mEventChannels.MergeAll(); }
+
+	/**
+	 * Retire this frame's events of every channel, call it once at the frame boundary
+	 */
+	void EndEventFrame() { mEventChannels.EndFrameAll(); }
+
+#ifndef NDEBUG
+	void DebugPrintState() const
+	{
+		std::cout << "Entities: \n";
+		for (uint32_t entityIdx = 0; entityIdx < mEntityAllocator.GetHighWaterMark(); ++entityIdx)
+		{
+			const EntityID id = mEntityIds[entityIdx];
+			const ComponentMask mask = ToRuntimeMask(mEntityMasks[entityIdx]);
+			std::cout << "\t" << GetEntityIndex(id) << ", " << GetEntityVersion(id) << "\n";
+			std::cout << "\t\t";
+			for (uint32_t j = 0; j < mask.size(); ++j)
+			{
+				std::cout << mask.test(j);
+			}
+			std::cout << "\n";
+		}
+
+		uint32_t componentId = 0;
+		std::apply([&componentId](const auto&... pools)
+		{
+			((std::cout << "Component Pool " << componentId++ << ": " << pools.CountComponents() << " components\n"), ...);
+		}, mPools);
+		std::cout.flush();
+	}
+#endif
+
+private:
+	template<typename T>
+	struct TypedComponentPool
+	{
+		typedef T ComponentType;
+
+		struct Chunk
+		{
+			alignas(T) std::byte components[sizeof(T) * NUM_COMPONENTS_PER_CHUNK];
+			EntityID entityIds[NUM_COMPONENTS_PER_CHUNK];
+			uint64_t freeComponents = ~0ull;
+			// Second copy of the components, only allocated for double buffered pools
+			std::unique_ptr<T[]> backComponents;
+
+			/**
+			 * @param bufferIdx Which copy of the component to return, 1 is only valid for double buffered chunks
+			 */
+			T* GetComponent(const uint32_t index, const uint32_t bufferIdx = 0)
+			{
+				return bufferIdx == 0 ? std::launder(reinterpret_cast<T*>(components) + index) : &backComponents[index];
+			}
+		};
+
+		TypedComponentPool() = default;
+
+		TypedComponentPool(const TypedComponentPool&) = delete;
+		TypedComponentPool& operator=(const TypedComponentPool&) = delete;
+
+		~TypedComponentPool()
+		{
+			for (std::unique_ptr<Chunk>& chunk : chunks)
+			{
+				for (uint64_t used = chunk ? ~chunk->freeComponents : 0; used != 0; used &= used - 1)
+				{
+					chunk->GetComponent(std::countr_zero(used))->~T();
+				}
+			}
+		}
+
+		T* GetOrCreateComponent(const EntityID id)
+		{
+			const EntityIndex entityIdx = GetEntityIndex(id);
+			assert(entityIdx < MAX_ENTITIES);
+
+			if (sparseMap[entityIdx] != 0)
+			{
+				return GetWriteComponent(id);
+			}
+
+			static_assert(NUM_COMPONENTS_PER_CHUNK == 64, "Free slot scan assumes one word per chunk");
+			for (uint32_t chunkIdx = 0; chunkIdx < NUM_CHUNKS_PER_POOL; ++chunkIdx)
+			{
+				if (!chunks[chunkIdx])
+				{
+					CreateChunk(chunkIdx);
+				}
+
+				Chunk& chunk = *chunks[chunkIdx];
+				if (chunk.freeComponents == 0)
+				{
+					continue;
+				}
+
+				const uint32_t innerIdx = std::countr_zero(chunk.freeComponents);
+				chunk.freeComponents &= ~(1ull << innerIdx);
+				chunk.entityIds[innerIdx] = id;
+
+				// 0 is our null value so we store the actual idx + 1
+				sparseMap[entityIdx] = innerIdx + chunkIdx * NUM_COMPONENTS_PER_CHUNK + 1;
+
+				T* pComponent = ::new (static_cast<void*>(chunk.components + innerIdx * sizeof(T))) T();
+				if (bDoubleBuffered)
+				{
+					// Readers may see this component before the next swap, so give the other copy the same value
+					chunk.backComponents[innerIdx] = *pComponent;
+				}
+				// The caller initializes the new component, so it is written like any other
+				return GetWriteComponent(id);
+			}
+
+			// We ran out of chunk space?
+			assert(false);
+			return nullptr;
+		}
+
+		/**
+		 * Allocate components for a run of entities that have none in this pool yet and copy them from a stamp
+		 * @param stamp At least NUM_COMPONENTS_PER_CHUNK initial values laid out back to back
+		 * @return The number of components allocated, always at least one; call again with the remainder
+		 */
+		uint32_t StampComponents(const EntityID* ids, const uint32_t count, const uint8_t* stamp)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Prefab components are stamped with memcpy");
+
+			for (uint32_t chunkIdx = 0; chunkIdx < NUM_CHUNKS_PER_POOL; ++chunkIdx)
+			{
+				if (!chunks[chunkIdx])
+				{
+					CreateChunk(chunkIdx);
+				}
+
+				Chunk& chunk = *chunks[chunkIdx];
+				if (chunk.freeComponents == 0)
+				{
+					continue;
+				}
+
+				const uint32_t firstIdx = std::countr_zero(chunk.freeComponents);
+				const uint32_t runLength = std::min<uint32_t>(std::countr_one(chunk.freeComponents >> firstIdx), count);
+
+				// The stamp holds a full chunk worth of values so the whole run is covered by one copy
+				std::memcpy(chunk.components + firstIdx * sizeof(T), stamp, runLength * sizeof(T));
+				if (bDoubleBuffered)
+				{
+					std::memcpy(chunk.backComponents.get() + firstIdx, stamp, runLength * sizeof(T));
+				}
+
+				for (uint32_t i = 0; i < runLength; ++i)
+				{
+					assert(sparseMap[GetEntityIndex(ids[i])] == 0);
+					chunk.freeComponents &= ~(1ull << (firstIdx + i));
+					chunk.entityIds[firstIdx + i] = ids[i];
+					sparseMap[GetEntityIndex(ids[i])] = firstIdx + i + chunkIdx * NUM_COMPONENTS_PER_CHUNK + 1;
+				}
+
+				return runLength;
+			}
+
+			// We ran out of chunk space?
+			assert(false);
+			return count;
+		}
+
+		T* GetComponent(const EntityID id) const
+		{
+			const uint32_t sparseIdx = sparseMap[GetEntityIndex(id)];
+			if (sparseIdx == 0)
+			{
+				return nullptr;
+			}
+
+			Chunk& chunk = *chunks[(sparseIdx - 1) / NUM_COMPONENTS_PER_CHUNK];
+			const uint32_t innerIdx = (sparseIdx - 1) % NUM_COMPONENTS_PER_CHUNK;
+
+			assert(chunk.entityIds[innerIdx] == id);
+
+			return chunk.GetComponent(innerIdx, bDoubleBuffered ? writeBufferIdx ^ 1 : 0);
+		}
+
+		/**
+		 * @return The next copy of the component for double buffered pools with its chunk marked written, otherwise the same as GetComponent
+		 */
+		T* GetWriteComponent(const EntityID id)
+		{
+			const uint32_t sparseIdx = sparseMap[GetEntityIndex(id)];
+			if (sparseIdx == 0)
+			{
+				return nullptr;
+			}
+
+			const uint32_t chunkIdx = (sparseIdx - 1) / NUM_COMPONENTS_PER_CHUNK;
+			const uint32_t innerIdx = (sparseIdx - 1) % NUM_COMPONENTS_PER_CHUNK;
+
+			assert(chunks[chunkIdx]->entityIds[innerIdx] == id);
+
+			if (bDoubleBuffered)
+			{
+				writtenChunks.Mark(chunkIdx);
+			}
+			return chunks[chunkIdx]->GetComponent(innerIdx, writeBufferIdx);
+		}
+
+		/**
+		 * Allocate the second copy for every chunk and seed it from the first
+		 */
+		void EnableDoubleBuffering()
+		{
+			if (bDoubleBuffered)
+			{
+				return;
+			}
+			bDoubleBuffered = true;
+
+			for (std::unique_ptr<Chunk>& chunk : chunks)
+			{
+				if (chunk)
+				{
+					chunk->backComponents = std::make_unique_for_overwrite<T[]>(NUM_COMPONENTS_PER_CHUNK);
+					std::memcpy(chunk->backComponents.get(), chunk->components, sizeof(chunk->components));
+				}
+			}
+		}
+
+		/**
+		 * Flip which copy is written and bring the chunks written since the last swap up to date in the new next copy
+		 */
+		void SwapBuffers()
+		{
+			if (!bDoubleBuffered)
+			{
+				return;
+			}
+
+			writeBufferIdx ^= 1;
+
+			writtenChunks.ConsumeMarked([this](const uint32_t chunkIdx)
+			{
+				if (chunks[chunkIdx])
+				{
+					std::memcpy(chunks[chunkIdx]->GetComponent(0, writeBufferIdx), chunks[chunkIdx]->GetComponent(0, writeBufferIdx ^ 1), sizeof(T) * NUM_COMPONENTS_PER_CHUNK);
+				}
+			});
+		}
+
+		void FreeComponent(const EntityID id)
+		{
+			const EntityIndex entityIdx = GetEntityIndex(id);
+			const uint32_t sparseIdx = sparseMap[entityIdx];
+			if (sparseIdx == 0)
+			{
+				return;
+			}
+
+			const uint32_t chunkIdx = (sparseIdx - 1) / NUM_COMPONENTS_PER_CHUNK;
+			const uint32_t innerIdx = (sparseIdx - 1) % NUM_COMPONENTS_PER_CHUNK;
+
+			Chunk& chunk = *chunks[chunkIdx];
+			assert(chunk.entityIds[innerIdx] == id);
+
+			chunk.GetComponent(innerIdx)->~T();
+			chunk.freeComponents |= 1ull << innerIdx;
+			sparseMap[entityIdx] = 0;
+
+			if (chunk.freeComponents == ~0ull)
+			{
+				chunks[chunkIdx].reset();
+			}
+		}
+
+#ifndef NDEBUG
+		[[nodiscard]] uint32_t CountComponents() const
+		{
+			uint32_t count = 0;
+			for (const std::unique_ptr<Chunk>& chunk : chunks)
+			{
+				count += chunk ? std::popcount(~chunk->freeComponents) : 0;
+			}
+			return count;
+		}
+#endif
+
+		void CreateChunk(const uint32_t chunkIdx)
+		{
+			chunks[chunkIdx] = std::make_unique<Chunk>();
+			if (bDoubleBuffered)
+			{
+				chunks[chunkIdx]->backComponents = std::make_unique_for_overwrite<T[]>(NUM_COMPONENTS_PER_CHUNK);
+			}
+		}
+
+		std::unique_ptr<Chunk> chunks[NUM_CHUNKS_PER_POOL];
+		// On the heap so a StaticScene can still live on the stack
+		std::vector<uint32_t> sparseMap = std::vector<uint32_t>(MAX_ENTITIES, 0);
+		bool bDoubleBuffered = false;
+		// Which copy simulation writes, every read returns the other one; flipped by SwapComponentBuffers
+		uint32_t writeBufferIdx = 0;
+		// Chunks whose next copy was handed out since the last swap, only tracked for double buffered pools
+		ChunkWriteMask writtenChunks;
+	};
+
+	template<typename T>
+	TypedComponentPool<T>& GetPool()
+	{
+		static_assert(COMPONENT_ID<T> < sizeof...(Components), "Component is not part of this StaticScene");
+		return std::get<COMPONENT_ID<T>>(mPools);
+	}
+
+	template<typename T>
+	const TypedComponentPool<T>& GetPool() const
+	{
+		static_assert(COMPONENT_ID<T> < sizeof...(Components), "Component is not part of this StaticScene");
+		return std::get<COMPONENT_ID<T>>(mPools);
+	}
+
+	/**
+	 * @return The static mask of the components set in a mask of runtime GetComponentId ids, the ones not in Components are dropped
+	 */
+	static PackedComponentMask ToStaticMask(const ComponentMask& runtimeMask)
+	{
+		return ((runtimeMask.test(GetComponentId<Components>()) ? COMPONENT_MASK<Components> : 0u) | ... | 0u);
+	}
+
+	/**
+	 * @return The mask of runtime GetComponentId ids of the components set in a static mask
+	 */
+	static ComponentMask ToRuntimeMask(const PackedComponentMask staticMask)
+	{
+		ComponentMask runtimeMask;
+		(runtimeMask.set(GetComponentId<Components>(), (staticMask & COMPONENT_MASK<Components>) != 0), ...);
+		return runtimeMask;
+	}
+
+	/**
+	 * @return Whether every component in a mask of runtime ids is one of Components, ToStaticMask drops the others
+	 */
+	static bool HasOnlySceneComponents(const ComponentMask& runtimeMask)
+	{
+		return static_cast<size_t>(std::popcount(ToStaticMask(runtimeMask))) == runtimeMask.count();
+	}
+
+	/**
+	 * ForEachMatchingBatch with masks of static ids
+	 */
+	template<typename Fn>
+	void ForEachMatchingStaticBatch(const PackedComponentMask required, const PackedComponentMask excluded, Fn&& fn) const
+	{
+		EntityIndex matchingIndices[MASK_SCAN_BATCH_SIZE];
+		EntityID matchingIds[MASK_SCAN_BATCH_SIZE];
+
+		const uint32_t end = mEntityAllocator.GetHighWaterMark();
+		for (uint32_t begin = 0; begin < end; begin += MASK_SCAN_BATCH_SIZE)
+		{
+			const uint32_t numMatching = ScanComponentMasks(mEntityMasks.data(), begin, std::min(begin + MASK_SCAN_BATCH_SIZE, end), required, excluded, matchingIndices);
+
+			uint32_t numIds = 0;
+			for (uint32_t i = 0; i < numMatching; ++i)
+			{
+				matchingIds[numIds] = mEntityIds[matchingIndices[i]];
+				numIds += required != 0 || IsEntityValid(matchingIds[numIds]);
+			}
+
+			if (numIds > 0)
+			{
+				fn(std::span<const EntityID>(matchingIds, numIds));
+			}
+		}
+	}
+
+	/**
+	 * RegisterQuery with masks of static ids
+	 */
+	QueryID RegisterStaticQuery(const PackedComponentMask required, const PackedComponentMask excluded)
+	{
+		const QueryID queryId = mQueries.Register(required, excluded);
+
+		ForEachMatchingStaticBatch(required, excluded, [this, queryId](const std::span<const EntityID> ids)
+		{
+			for (const EntityID id : ids)
+			{
+				mQueries.AddInitialMatch(queryId, id);
+			}
+		});
+
+		return queryId;
+	}
+
+	/**
+	 * Stamp the prefab component with the runtime id componentId into the pool of T if that is T's
+	 * @return Whether componentId was T's
+	 */
+	template<typename T>
+	bool StampPrefabComponents(const uint32_t componentId, const uint8_t* stamp, const std::span<const EntityID> ids)
+	{
+		if (componentId != GetComponentId<T>())
+		{
+			return false;
+		}
+
+		TypedComponentPool<T>& pool = GetPool<T>();
+
+		uint32_t numStamped = 0;
+		while (numStamped < ids.size())
+		{
+			numStamped += pool.StampComponents(ids.data() + numStamped, static_cast<uint32_t>(ids.size()) - numStamped, stamp);
+		}
+		return true;
+	}
+
+	EntityAllocator mEntityAllocator{MAX_ENTITIES};
+
+	std::vector<EntityID> mEntityIds;
+	std::vector<PackedComponentMask> mEntityMasks;
+
+	std::tuple<TypedComponentPool<Components>...> mPools;
+
+	std::vector<Prefab> mPrefabs;
+
+	SceneQueries mQueries;
+
+	EventChannels mEventChannels;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "VulkanCommon.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+class ThreadPool;
+
+// How texels are stored, the block compressed formats keep 4x4 texels per block
+enum class ETextureFormat : uint8_t
+{
+	// 4 bytes per texel
+	RGBA8 = 0,
+	// Opaque color in 8 bytes per block, 8:1 against RGBA8
+	BC1,
+	// BC1 color plus interpolated alpha in 16 bytes per block, 4:1
+	BC3,
+	// Higher quality color and alpha in 16 bytes per block, only loaded precompressed, never encoded at runtime
+	BC7,
+	Count
+};
+
+const char* GetTextureFormatName(ETextureFormat format);
+
+/**
+ * @param bSRGB Whether color is stored sRGB encoded, the sampler then returns linear values
+ */
+VkFormat GetTextureVkFormat(ETextureFormat format, bool bSRGB);
+
+/**
+ * @return Texels along each side of a block, 1 for uncompressed formats
+ */
+uint32_t GetTextureBlockExtent(ETextureFormat format);
+
+uint32_t GetTextureBlockBytes(ETextureFormat format);
+
+/**
+ * @return Bytes taken by a width x height mip, partial blocks at the edges count as whole ones
+ */
+uint64_t CalculateTextureMipSize(ETextureFormat format, uint32_t width, uint32_t height);
+
+/**
+ * @return Mips in a full chain down to 1x1
+ */
+uint32_t CalculateMipCount(uint32_t width, uint32_t height);
+
+struct TextureMip
+{
+	uint32_t width;
+	uint32_t height;
+	// Into TextureData::data
+	uint64_t offset;
+	uint64_t size;
+};
+
+/**
+ * A 2D texture and its mips, largest first, tightly packed one after another
+ */
+struct TextureData
+{
+	ETextureFormat format = ETextureFormat::RGBA8;
+	bool bSRGB = true;
+	std::vector<TextureMip> mips;
+	std::vector<uint8_t> data;
+
+	[[nodiscard]] uint32_t GetMipCount() const { return static_cast<uint32_t>(mips.size()); }
+};
+
+/**
+ * Build the full mip chain of an RGBA8 image
+ * Texels are averaged in linear space when bSRGB is set, and weighted by alpha so transparent texels do not bleed
+ * their color into the edges of what is visible.
+ * @param pixels width * height RGBA8 texels, rows top to bottom
+ */
+TextureData BuildMipChain(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, bool bSRGB);
+
+/**
+ * @return true if any texel of the RGBA8 texture is not fully opaque, such a texture needs BC3 rather than BC1
+ */
+bool HasTranslucentTexels(const TextureData& texture);
+
+/**
+ * Block compress every mip of an RGBA8 texture
+ * @param format BC1 or BC3
+ * @param pThreadPool Spreads the blocks over its threads if given, it must not be inside a ParallelFor already
+ */
+TextureData CompressTexture(const TextureData& source, ETextureFormat format, ThreadPool* pThreadPool = nullptr);
+
+/**
+ * @return Whether images of the format can be created optimally tiled, uploaded into and sampled with linear filtering
+ */
+bool IsTextureFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format);
+
+/**
+ * Mips and texels of a texture owned by something else, such as a mapped texture file
+ */
+struct TextureView
+{
+	ETextureFormat format = ETextureFormat::RGBA8;
+	bool bSRGB = true;
+	// Offsets are into data
+	std::vector<TextureMip> mips;
+	std::span<const uint8_t> data;
+
+	[[nodiscard]] uint32_t GetMipCount() const { return static_cast<uint32_t>(mips.size()); }
+};
+
+TextureView ViewTexture(const TextureData& texture);
+
+/**
+ * @return One copy per mip with bufferOffset relative to the start of the texture's data
+ */
+std::vector<VkBufferImageCopy> GetTextureCopyRegions(std::span<const TextureMip> mips);
+
+/// TEXTURE FILES
+
+// Cooked textures, ready to be copied into an image as they are
+constexpr const char* TEXTURE_FILE_EXTENSION = ".fftex";
+
+/**
+ * Write a .fftex file: a header, the mip table, then every mip starting on a 16 byte boundary of the file so the
+ * payload can be staged with a single copy and each mip copied into the image from where it lies
+ * Throws if the file cannot be written.
+ */
+void WriteTextureFile(const std::filesystem::path& path, const TextureData& texture);
+
+/**
+ * Read the header and mip table of a .fftex file held in memory, the texels stay where they are
+ * @param file The whole file, usually mapped, it must outlive outView
+ * @return false if the file is not a texture file of this version or is truncated
+ */
+bool ParseTextureFile(std::span<const uint8_t> file, TextureView& outView);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of distinct per-thread storage slots handed out by GetCurrentThreadSlot
+// Slots go back to the pool when their thread exits, so only more than this many live threads at once share slots.
+// Anything indexed by slot must still tolerate that contention.
+constexpr uint32_t MAX_THREAD_SLOTS = 64;
+
+/**
+ * @return A small index that is stable for the lifetime of the calling thread, in the range [0, MAX_THREAD_SLOTS)
+ * Unique among live threads unless more than MAX_THREAD_SLOTS of them asked for one.
+ */
+uint32_t GetCurrentThreadSlot();
+
+/**
+ * A fixed set of worker threads that split loops with the calling thread
+ * Thread index 0 is always the thread calling ParallelFor, workers are 1 to GetThreadCount() - 1, so callers can keep
+ * per thread state (command pools, scratch memory) in an array of GetThreadCount() entries without any locking.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * @param begin First index of the batch
+	 * @param end One past the last index of the batch
+	 * @param threadIdx The thread running the batch, in the range [0, GetThreadCount())
+	 */
+	typedef std::function<void(uint32_t begin, uint32_t end, uint32_t threadIdx)> RangeFn;
+
+	/**
+	 * @param numWorkers Threads to start besides the caller, 0 runs everything on the caller
+	 */
+	void Init(uint32_t numWorkers);
+
+	void Shutdown();
+
+	/**
+	 * Call fn on batches of at most batchSize indices covering [0, count) and return once all of them are done
+	 * The calling thread works through batches too. Not reentrant, fn must not call ParallelFor.
+	 */
+	void ParallelFor(uint32_t count, uint32_t batchSize, const RangeFn& fn);
+
+	[[nodiscard]] uint32_t GetThreadCount() const { return static_cast<uint32_t>(mWorkers.size()) + 1; }
+
+private:
+	void WorkerMain(uint32_t threadIdx);
+
+	void RunBatches(uint32_t threadIdx);
+
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+
+	// The current job, only written while no worker is running one
+	const RangeFn* mJobFn = nullptr;
+	uint32_t mJobCount = 0;
+	uint32_t mJobBatchSize = 1;
+	std::atomic<uint32_t> mNextBatch = 0;
+
+	// Bumped for every job so sleeping workers can tell a new job from a spurious wake up
+	uint64_t mJobGeneration = 0;
+	uint32_t mBusyWorkers = 0;
+	bool mStopping = false;
+};
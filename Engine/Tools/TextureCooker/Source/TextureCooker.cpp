@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+#include "AssetLoader.h"
+#include "Texture.h"
+#include "Threading.h"
+
+// Cooks an image into a .fftex the engine copies straight into an image, with every mip built and compressed here
+// Usage: TextureCooker <input> <output.fftex> [--format=auto|rgba8|bc1|bc3] [--linear]
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "Usage: TextureCooker <input> <output.fftex> [--format=auto|rgba8|bc1|bc3] [--linear]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const char* inputPath = argv[1];
+	const char* outputPath = argv[2];
+
+	// auto picks BC3 if any texel is translucent and BC1 otherwise
+	std::string_view format = "auto";
+	bool bSRGB = true;
+
+	const std::string_view formatArgument = "--format=";
+	for (int argIdx = 3; argIdx < argc; argIdx++)
+	{
+		const std::string_view argument = argv[argIdx];
+		if (argument.starts_with(formatArgument))
+		{
+			format = argument.substr(formatArgument.size());
+		}
+		else if (argument == "--linear")
+		{
+			bSRGB = false;
+		}
+		else
+		{
+			std::cerr << "Unknown argument: " << argument << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (format != "auto" && format != "rgba8" && format != "bc1" && format != "bc3")
+	{
+		std::cerr << "Unknown texture format: " << format << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	TextureData texture;
+	try
+	{
+		texture = DecodeTextureImage(inputPath, bSRGB);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool threadPool;
+	threadPool.Init(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+
+	if (format == "auto")
+	{
+		format = HasTranslucentTexels(texture) ? "bc3" : "bc1";
+	}
+
+	if (format == "bc1")
+	{
+		texture = CompressTexture(texture, ETextureFormat::BC1, &threadPool);
+	}
+	else if (format == "bc3")
+	{
+		texture = CompressTexture(texture, ETextureFormat::BC3, &threadPool);
+	}
+
+	threadPool.Shutdown();
+
+	try
+	{
+		WriteTextureFile(outputPath, texture);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << std::format("Cooked {} to {}: {}x{} with {} mips as {}, {} bytes\n", inputPath, outputPath, texture.mips[0].width, texture.mips[0].height, texture.GetMipCount(), GetTextureFormatName(texture.format), texture.data.size());
+
+	return EXIT_SUCCESS;
+}
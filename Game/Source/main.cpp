@@ -1,4 +1,6 @@
+#include <charconv>
 #include <cstdlib>
+#include <string_view>
 
 #include "Firefly.h"
 
@@ -6,6 +8,62 @@ int main(int argc, char *argv[])
 {
 	Engine engine;
 
+	// --frame-pacing=throughput|lowlatency|vsyncoff
+	const std::string_view framePacingArgument = "--frame-pacing=";
+	// --no-bindless, sample the texture in the per frame set even where descriptor indexing is supported
+	const std::string_view noBindlessArgument = "--no-bindless";
+	// --no-gpu-culling, cull the sprites and build one draw per mesh on the CPU
+	const std::string_view noGpuCullingArgument = "--no-gpu-culling";
+	// --cpu-culling-batch=N, cull on the CPU like --no-gpu-culling with N spheres per pool thread batch
+	const std::string_view cpuCullingBatchArgument = "--cpu-culling-batch=";
+	// --validate-gpu-culling=N, check the GPU culling of N frames against the CPU and exit, fails on the first difference
+	const std::string_view validateGpuCullingArgument = "--validate-gpu-culling=";
+	for (int argIdx = 1; argIdx < argc; argIdx++)
+	{
+		const std::string_view argument = argv[argIdx];
+		if (argument.starts_with(framePacingArgument))
+		{
+			EFramePacingMode framePacingMode;
+			if (!ParseFramePacingMode(argument.substr(framePacingArgument.size()), framePacingMode))
+			{
+				std::cerr << "Unknown frame pacing mode: " << argument.substr(framePacingArgument.size()) << std::endl;
+				return EXIT_FAILURE;
+			}
+			engine.setFramePacingMode(framePacingMode);
+		}
+		else if (argument == noBindlessArgument)
+		{
+			engine.setBindlessDescriptors(false);
+		}
+		else if (argument == noGpuCullingArgument)
+		{
+			engine.setGpuCulling(false);
+		}
+		else if (argument.starts_with(cpuCullingBatchArgument))
+		{
+			const std::string_view value = argument.substr(cpuCullingBatchArgument.size());
+			uint32_t batchSize = 0;
+			if (std::from_chars(value.data(), value.data() + value.size(), batchSize).ec != std::errc() || batchSize == 0)
+			{
+				std::cerr << "Invalid CPU culling batch size: " << value << std::endl;
+				return EXIT_FAILURE;
+			}
+			engine.setGpuCulling(false);
+			engine.setCpuCullingBatchSize(batchSize);
+		}
+		else if (argument.starts_with(validateGpuCullingArgument))
+		{
+			const std::string_view value = argument.substr(validateGpuCullingArgument.size());
+			uint32_t numFrames = 0;
+			if (std::from_chars(value.data(), value.data() + value.size(), numFrames).ec != std::errc() || numFrames == 0)
+			{
+				std::cerr << "Invalid number of GPU culling validation frames: " << value << std::endl;
+				return EXIT_FAILURE;
+			}
+			engine.setGpuCullingValidation(numFrames);
+		}
+	}
+
 	try
 	{
 		engine.run();